@@ -0,0 +1,976 @@
+/**************************************************************
+ *
+ *                     arena.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     arena.c contains the implementation of the per-UM memory arena.
+ *     Small blocks are bumped out of chunks that double in size up to
+ *     MAX_CHUNK and recycled through size-classed free lists; blocks above
+ *     LARGE_BYTES get a mapping of their own so they can be returned to
+ *     the kernel as soon as they are released, either directly or, above
+ *     the deferral threshold, through the reclamation thread. Freeing the
+ *     arena unmaps every chunk and large mapping without visiting
+ *     individual blocks.
+ *
+ *     Anonymous mappings without huge page advice are not unmapped but
+ *     given to the calling thread's mapping cache, and new ones are taken
+ *     from it first. A cached mapping keeps its old contents, so a chunk
+ *     taken from the cache hands out blocks that arena_calloc must clear,
+ *     and a cached large block is cleared only when zeros were asked for.
+ *
+ *     Compaction evacuates every small block into fresh chunks sized for
+ *     the live data, in the order the owner moves them, and then unmaps
+ *     the old chunks wholesale.
+ *
+ *     Depending on the huge page policy, mappings of HUGE_BYTES or more
+ *     are aligned to HUGE_BYTES, rounded up to a multiple of it, and
+ *     advised with MADV_HUGEPAGE so the kernel can back them with
+ *     transparent huge pages.
+ *
+ *     A file-backed arena instead reserves one MAP_SHARED mapping of a
+ *     sparse file and carves its chunks and large blocks out of that,
+ *     so the page cache can write cold memory back to disk. The arena
+ *     struct itself lives in the file's first page and every list it
+ *     heads is threaded through the file, so reopening the file at the
+ *     same address restores the arena exactly. Released extents of the
+ *     file have their pages removed with MADV_REMOVE and are kept on an
+ *     address-ordered, coalescing list for reuse.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <mem.h>
+#include "arena.h"
+#include "reclaim.h"
+#include "mcache.h"
+
+#define ALIGNMENT       16
+#define MIN_CHUNK       ((size_t)1 << 20)     /* first chunk, 1 MiB */
+#define MAX_CHUNK       ((size_t)64 << 20)    /* chunks stop doubling here */
+#define LARGE_BYTES     ((size_t)64 << 10)    /* larger blocks are mapped */
+#define HUGE_BYTES      ((size_t)2 << 20)     /* transparent huge page */
+#define FILE_PAGE       ((size_t)4096)        /* file extent granularity */
+#define FILE_MAGIC      UINT64_C(0x31504145484d55)  /* "UMHEAP1" */
+
+/*
+ * Where new arena files are mapped if that address is free. A reopened
+ * file must land at the same address, so it is placed well away from the
+ * randomized regions the kernel gives libraries and other mappings.
+ */
+#define FILE_BASE       ((void *)((uintptr_t)1 << 45))
+
+/*
+ * Size classes step by ALIGNMENT bytes up to FINE_BYTES, then by powers of
+ * two up to LARGE_BYTES
+ */
+#define FINE_BYTES      1024
+#define FINE_CLASSES    (FINE_BYTES / ALIGNMENT)
+#define NUM_CLASSES     (FINE_CLASSES + 6)    /* 2K, 4K, ... 64K */
+
+/* Header at the start of every chunk mapping, padded to ALIGNMENT */
+typedef struct Chunk {
+        struct Chunk   *next;
+        size_t          size;
+        size_t          huge;   /* nonzero if advised for huge pages */
+        size_t          pad;
+} Chunk;
+
+/* Header at the start of every large mapping, padded to ALIGNMENT */
+typedef struct Large {
+        struct Large   *prev;
+        struct Large   *next;
+        size_t          size;
+        size_t          huge;   /* nonzero if advised for huge pages */
+} Large;
+
+/* A released small block, threaded onto the free list of its class */
+typedef struct Free {
+        struct Free    *next;
+} Free;
+
+/* Header of a released extent of a backing file; the rest is zero */
+typedef struct Extent {
+        struct Extent  *next;
+        size_t          size;
+} Extent;
+
+/********** struct Arena_T ********
+ *
+ * Chunk *chunks: every chunk mapping, most recent first
+ * char *bump, *limit: unused tail of the most recent chunk
+ * size_t next_chunk: size of the next chunk to map
+ * Free *free[]: released small blocks, by size class
+ * Large *large: every large mapping still in use
+ * size_t mapped: bytes currently mapped by the arena
+ * size_t defer_bytes: large blocks at least this big are released by the
+ *                     reclamation thread; 0 releases all of them directly
+ * Arena_huge huge: huge page policy
+ * size_t huge_bytes: bytes currently advised for huge pages
+ * size_t small_bytes: bytes of small blocks currently allocated
+ * Chunk *old_chunks: chunks being evacuated by a compaction, else NULL
+ * size_t moved_bytes: bytes copied by the current compaction
+ * 
+ * For a file-backed arena, which is stored at the start of its file:
+ * uint64_t magic: FILE_MAGIC, identifying the file as an arena
+ * char *base: address the file is mapped at, and its first byte
+ * size_t span: size of the file and of the mapping
+ * size_t file_end: offset of the first extent never handed out
+ * Extent *extents: released extents, in address order
+ * void *root: owner's pointer to its own state in the file
+ * int fd: descriptor of the open file, or -1 for an anonymous arena
+ *
+ * bool bump_dirty: the most recent chunk came from the mapping cache, so
+ *                  its unused tail is not known to be zero
+ *
+ *****************************/
+struct Arena_T {
+        Chunk          *chunks;
+        char           *bump;
+        char           *limit;
+        size_t          next_chunk;
+        Free           *free[NUM_CLASSES];
+        Large          *large;
+        size_t          mapped;
+        size_t          defer_bytes;
+        Arena_huge      huge;
+        size_t          huge_bytes;
+        size_t          small_bytes;
+        Chunk          *old_chunks;
+        size_t          moved_bytes;
+        uint64_t        magic;
+        char           *base;
+        size_t          span;
+        size_t          file_end;
+        Extent         *extents;
+        void           *root;
+        int             fd;
+        bool            bump_dirty;
+};
+
+/********** size_class ********
+ *
+ * Returns the size class of a small block
+ *
+ * Parameters:
+ *      size_t bytes: requested size, at most LARGE_BYTES
+ * Return:
+ *      index into Arena_T's free lists
+ *****************************/
+static inline unsigned size_class(size_t bytes)
+{
+        if (bytes <= FINE_BYTES) {
+                return bytes <= ALIGNMENT ? 0
+                                          : (bytes - 1) / ALIGNMENT;
+        }
+        unsigned class = FINE_CLASSES;
+        for (size_t size = 2 * FINE_BYTES; size < bytes; size *= 2) {
+                class++;
+        }
+        return class;
+}
+
+/********** class_bytes ********
+ *
+ * Returns the size of the blocks in a size class
+ *
+ * Parameters:
+ *      unsigned class: a size class
+ * Return:
+ *      block size in bytes
+ *****************************/
+static inline size_t class_bytes(unsigned class)
+{
+        if (class < FINE_CLASSES) {
+                return (size_t)(class + 1) * ALIGNMENT;
+        }
+        return (size_t)2 * FINE_BYTES << (class - FINE_CLASSES);
+}
+
+/********** map_pages ********
+ *
+ * Maps zero-filled anonymous memory
+ *
+ * Parameters:
+ *      size_t bytes: size of the mapping
+ * Return:
+ *      the mapping
+ *
+ * Notes:
+ *      Will CRE if the kernel refuses the mapping
+ *****************************/
+static void *map_pages(size_t bytes)
+{
+        void *pages = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(pages != MAP_FAILED);
+        return pages;
+}
+
+/********** take_extent ********
+ *
+ * Hands out a zero-filled extent of a backing file, first fit from the
+ * released extents and otherwise from the never-used end of the file
+ *
+ * Parameters:
+ *      Arena_T arena: a file-backed arena
+ *      size_t bytes: size of the extent, a multiple of FILE_PAGE
+ * Return:
+ *      the extent
+ *
+ * Notes:
+ *      Will CRE if the file is full
+ *****************************/
+static void *take_extent(Arena_T arena, size_t bytes)
+{
+        for (Extent **link = &arena->extents; *link != NULL; 
+             link = &(*link)->next) {
+                Extent *extent = *link;
+                if (extent->size > bytes) {
+                        /* Keep the header in place and hand out the tail */
+                        extent->size -= bytes;
+                        return (char *)extent + extent->size;
+                }
+                if (extent->size == bytes) {
+                        *link = extent->next;
+                        memset(extent, 0, sizeof(Extent));
+                        return extent;
+                }
+        }
+        assert(bytes <= arena->span - arena->file_end);
+        void *extent = arena->base + arena->file_end;
+        arena->file_end += bytes;
+        return extent;
+}
+
+/********** give_extent ********
+ *
+ * Returns an extent to a backing file, dropping its pages and storage and
+ * merging it with the released extents on either side
+ *
+ * Parameters:
+ *      Arena_T arena: a file-backed arena
+ *      void *pages: the extent
+ *      size_t bytes: its size, a multiple of FILE_PAGE
+ * Return: None
+ *****************************/
+static void give_extent(Arena_T arena, void *pages, size_t bytes)
+{
+        madvise(pages, bytes, MADV_REMOVE);
+        Extent *extent = pages;
+        Extent *prev = NULL;
+        Extent *next = arena->extents;
+        while (next != NULL && next < extent) {
+                prev = next;
+                next = next->next;
+        }
+        if (next != NULL && (char *)extent + bytes == (char *)next) {
+                bytes += next->size;
+                Extent *after = next->next;
+                memset(next, 0, sizeof(Extent));
+                next = after;
+        }
+        if (prev != NULL && (char *)prev + prev->size == (char *)extent) {
+                prev->size += bytes;
+                prev->next = next;
+                return;
+        }
+        extent->next = next;
+        extent->size = bytes;
+        if (prev != NULL) {
+                prev->next = extent;
+        } else {
+                arena->extents = extent;
+        }
+}
+
+/********** map_region ********
+ *
+ * Maps memory for a chunk: a cached or new anonymous mapping, or a
+ * zero-filled extent of the backing file
+ *
+ * Parameters:
+ *      Arena_T arena: the owning arena
+ *      size_t *bytes: size of the region, a multiple of FILE_PAGE for a
+ *                     file-backed arena; set to the size actually mapped,
+ *                     which a cached mapping may exceed
+ *      bool *dirty: set to whether the region may hold old contents
+ * Return:
+ *      the region
+ *****************************/
+static void *map_region(Arena_T arena, size_t *bytes, bool *dirty)
+{
+        *dirty = false;
+        if (arena->fd >= 0) {
+                return take_extent(arena, *bytes);
+        }
+        void *pages = mcache_take(*bytes, bytes);
+        if (pages != NULL) {
+                *dirty = true;
+                return pages;
+        }
+        return map_pages(*bytes);
+}
+
+/********** unmap_region ********
+ *
+ * Releases a chunk or large block: to the backing file, to the kernel if
+ * it was advised for huge pages, and otherwise to the mapping cache
+ *
+ * Parameters:
+ *      Arena_T arena: the owning arena
+ *      void *pages: the region
+ *      size_t bytes: its size
+ *      bool huge: whether it was advised for huge pages
+ * Return: None
+ *****************************/
+static void unmap_region(Arena_T arena, void *pages, size_t bytes, bool huge)
+{
+        if (arena->fd >= 0) {
+                give_extent(arena, pages, bytes);
+        } else if (huge) {
+                munmap(pages, bytes);
+        } else {
+                mcache_give(pages, bytes);
+        }
+}
+
+/********** map_huge ********
+ *
+ * Maps zero-filled anonymous memory aligned to HUGE_BYTES and asks the
+ * kernel to back it with transparent huge pages
+ *
+ * Parameters:
+ *      size_t bytes: size of the mapping, a multiple of HUGE_BYTES
+ *      bool *advised: set to whether the kernel accepted MADV_HUGEPAGE
+ * Return:
+ *      the mapping
+ *
+ * Notes:
+ *      Will CRE if the kernel refuses the mapping
+ *      Over-maps by HUGE_BYTES and trims the misaligned ends
+ *****************************/
+static void *map_huge(size_t bytes, bool *advised)
+{
+        char *raw = map_pages(bytes + HUGE_BYTES);
+        char *aligned = (char *)(((uintptr_t)raw + HUGE_BYTES - 1) & 
+                                 ~(uintptr_t)(HUGE_BYTES - 1));
+        if (aligned > raw) {
+                munmap(raw, aligned - raw);
+        }
+        munmap(aligned + bytes, raw + HUGE_BYTES - aligned);
+        *advised = madvise(aligned, bytes, MADV_HUGEPAGE) == 0;
+        return aligned;
+}
+
+/********** unmap_chunks ********
+ *
+ * Unmaps every chunk on a list
+ *
+ * Parameters:
+ *      Arena_T arena: the owning arena
+ *      Chunk *chunk: first chunk of the list, or NULL
+ * Return:
+ *      total bytes unmapped
+ *****************************/
+static size_t unmap_chunks(Arena_T arena, Chunk *chunk)
+{
+        size_t bytes = 0;
+        while (chunk != NULL) {
+                Chunk *next = chunk->next;
+                bytes += chunk->size;
+                unmap_region(arena, chunk, chunk->size, chunk->huge);
+                chunk = next;
+        }
+        return bytes;
+}
+
+/********** arena_new ********
+ *
+ * Creates an empty arena; no memory is mapped until the first allocation
+ *
+ * Parameters: None
+ * Return:
+ *      the new arena
+ *
+ * Notes:
+ *      Will CRE if allocation fails
+ *****************************/
+extern Arena_T arena_new(void)
+{
+        Arena_T arena = CALLOC(1, sizeof(struct Arena_T));
+        assert(arena != NULL);
+        arena->next_chunk = MIN_CHUNK;
+        arena->fd = -1;
+        return arena;
+}
+
+/********** arena_new_file ********
+ *
+ * Creates an arena backed by a sparse file, or reopens one left by an
+ * earlier process. All of the file is mapped MAP_SHARED up front, but
+ * disk space and memory are only used for pages that are written.
+ *
+ * Parameters:
+ *      const char *path: the backing file
+ *      size_t span: most bytes the arena may use, rounded up to a whole
+ *                   number of pages; ignored when reopening
+ *      bool reopen: whether to reopen an existing arena file rather than
+ *                   create or truncate one
+ * Return:
+ *      the arena, or NULL if the file cannot be opened or mapped or, when
+ *      reopening, is not an arena file
+ *
+ * Expects:
+ *      path must not be NULL
+ * Notes:
+ *      Will CRE if path is NULL
+ *      A reopened file must be mapped at the address it was created at, so
+ *      reopening fails if that address is already in use
+ *      Huge page policies do not apply to file-backed memory
+ *      Writing a page when the disk is full raises SIGBUS
+ *****************************/
+extern Arena_T arena_new_file(const char *path, size_t span, bool reopen)
+{
+        assert(path != NULL);
+        int fd = open(path, reopen ? O_RDWR : O_RDWR | O_CREAT | O_TRUNC, 
+                      0600);
+        if (fd < 0) {
+                return NULL;
+        }
+
+        void *hint = FILE_BASE;
+        int flags = MAP_SHARED | MAP_NORESERVE;
+        if (reopen) {
+                struct Arena_T saved;
+                if (pread(fd, &saved, sizeof(saved), 0) != sizeof(saved) || 
+                    saved.magic != FILE_MAGIC) {
+                        close(fd);
+                        return NULL;
+                }
+                hint = saved.base;
+                span = saved.span;
+                flags |= MAP_FIXED_NOREPLACE;
+        } else {
+                span = (span + FILE_PAGE - 1) & ~(FILE_PAGE - 1);
+                if (span < 2 * FILE_PAGE || 
+                    ftruncate(fd, (off_t)span) != 0) {
+                        close(fd);
+                        return NULL;
+                }
+        }
+
+        char *base = mmap(hint, span, PROT_READ | PROT_WRITE, flags, fd, 0);
+        if (base == MAP_FAILED || (reopen && base != hint)) {
+                if (base != MAP_FAILED) {
+                        munmap(base, span);
+                }
+                close(fd);
+                return NULL;
+        }
+
+        Arena_T arena = (Arena_T)base;
+        if (!reopen) {
+                arena->next_chunk = MIN_CHUNK;
+                arena->magic = FILE_MAGIC;
+                arena->base = base;
+                arena->span = span;
+                arena->file_end = FILE_PAGE; /* the arena struct's page */
+        }
+        arena->fd = fd;
+        arena->huge = ARENA_HUGE_OFF;
+        arena->bump_dirty = false;
+        return arena;
+}
+
+/********** arena_free ********
+ *
+ * Unmaps every chunk and large mapping of an arena, releasing all blocks
+ * at once, and sets the caller's handle to NULL
+ *
+ * Parameters:
+ *      Arena_T *arena: pointer to the arena to free
+ * Return: None
+ *
+ * Expects:
+ *      arena and *arena must not be NULL
+ * Notes:
+ *      Will CRE if arena or *arena is NULL
+ *****************************/
+extern void arena_free(Arena_T *arena)
+{
+        assert(arena != NULL && *arena != NULL);
+        if ((*arena)->fd >= 0) {
+                /* Leave the file intact so that it can be reopened */
+                int fd = (*arena)->fd;
+                munmap((*arena)->base, (*arena)->span);
+                close(fd);
+                *arena = NULL;
+                return;
+        }
+        unmap_chunks(*arena, (*arena)->chunks);
+        unmap_chunks(*arena, (*arena)->old_chunks);
+        Large *large = (*arena)->large;
+        while (large != NULL) {
+                Large *next = large->next;
+                unmap_region(*arena, large, large->size, large->huge);
+                large = next;
+        }
+        free(*arena);
+        *arena = NULL;
+}
+
+/********** alloc_large ********
+ *
+ * Gives a block its own mapping, reusing one from the mapping cache or
+ * pooled by the reclamation thread if possible, and links it into the
+ * arena
+ *
+ * Parameters:
+ *      Arena_T arena: the owning arena
+ *      size_t bytes: size of the block
+ *      bool zero: whether the block must be zero-filled
+ * Return:
+ *      the block
+ *****************************/
+static void *alloc_large(Arena_T arena, size_t bytes, bool zero)
+{
+        size_t size = sizeof(Large) + bytes;
+        bool huge = arena->huge != ARENA_HUGE_OFF && size >= HUGE_BYTES;
+        if (huge) {
+                size = (size + HUGE_BYTES - 1) & ~(HUGE_BYTES - 1);
+        }
+
+        Large *large = NULL;
+        if (arena->fd >= 0) {
+                size = (size + FILE_PAGE - 1) & ~(FILE_PAGE - 1);
+                large = take_extent(arena, size);
+        } else if (!huge) {
+                size = mcache_round(size);
+                large = mcache_take(size, &size);
+                if (large != NULL && zero) {
+                        memset(large + 1, 0, bytes);
+                }
+        }
+        if (large == NULL && arena->fd < 0) {
+                large = reclaim_take(size, huge ? HUGE_BYTES : 1, huge,
+                                     &size);
+        }
+        if (large == NULL && huge) {
+                large = map_huge(size, &huge);
+        } else if (large == NULL) {
+                large = map_pages(size);
+        }
+        large->prev = NULL;
+        large->next = arena->large;
+        large->size = size;
+        large->huge = huge;
+        if (arena->large != NULL) {
+                arena->large->prev = large;
+        }
+        arena->large = large;
+        arena->mapped += size;
+        if (huge) {
+                arena->huge_bytes += size;
+        }
+        return large + 1;
+}
+
+/********** alloc_small ********
+ *
+ * Takes a block of a size class from its free list, or bumps a new one
+ * out of the current chunk, mapping a larger chunk when it runs out
+ *
+ * Parameters:
+ *      Arena_T arena: the owning arena
+ *      unsigned class: size class of the block
+ *      bool *fresh: set to whether the block is untouched (still zero)
+ * Return:
+ *      the block
+ *****************************/
+static void *alloc_small(Arena_T arena, unsigned class, bool *fresh)
+{
+        size_t bytes = class_bytes(class);
+        arena->small_bytes += bytes;
+
+        Free *block = arena->free[class];
+        if (block != NULL) {
+                arena->free[class] = block->next;
+                *fresh = false;
+                return block;
+        }
+
+        if ((size_t)(arena->limit - arena->bump) < bytes) {
+                bool huge = arena->huge == ARENA_HUGE_ALL && 
+                            arena->next_chunk >= HUGE_BYTES;
+                size_t size = arena->next_chunk;
+                bool dirty = false;
+                Chunk *chunk = huge ? map_huge(size, &huge)
+                                    : map_region(arena, &size, &dirty);
+                chunk->huge = huge;
+                if (huge) {
+                        arena->huge_bytes += size;
+                }
+                chunk->next = arena->chunks;
+                chunk->size = size;
+                arena->bump_dirty = dirty;
+                arena->chunks = chunk;
+                arena->mapped += chunk->size;
+                arena->bump = (char *)chunk + sizeof(Chunk);
+                arena->limit = (char *)chunk + chunk->size;
+                if (arena->next_chunk < MAX_CHUNK) {
+                        arena->next_chunk *= 2;
+                }
+        }
+        void *fresh_block = arena->bump;
+        arena->bump += bytes;
+        *fresh = !arena->bump_dirty;
+        return fresh_block;
+}
+
+/********** arena_alloc ********
+ *
+ * Allocates an uninitialized block
+ *
+ * Parameters:
+ *      Arena_T arena: arena to allocate from
+ *      size_t bytes: size of the block
+ * Return:
+ *      a block aligned to 16 bytes
+ *
+ * Expects:
+ *      arena must not be NULL
+ * Notes:
+ *      Will CRE if arena is NULL or the kernel refuses a mapping
+ *      The block must be released with the same size it was allocated with
+ *****************************/
+extern void *arena_alloc(Arena_T arena, size_t bytes)
+{
+        assert(arena != NULL);
+        if (bytes > LARGE_BYTES) {
+                return alloc_large(arena, bytes, false);
+        }
+        bool fresh;
+        return alloc_small(arena, size_class(bytes), &fresh);
+}
+
+/********** arena_calloc ********
+ *
+ * Allocates a zero-filled block. Blocks taken from never-used chunk space
+ * or from a new mapping are already zero, so only recycled blocks are
+ * cleared.
+ *
+ * Parameters:
+ *      Arena_T arena: arena to allocate from
+ *      size_t bytes: size of the block
+ * Return:
+ *      a zero-filled block aligned to 16 bytes
+ *
+ * Expects:
+ *      arena must not be NULL
+ * Notes:
+ *      Will CRE if arena is NULL or the kernel refuses a mapping
+ *****************************/
+extern void *arena_calloc(Arena_T arena, size_t bytes)
+{
+        assert(arena != NULL);
+        if (bytes > LARGE_BYTES) {
+                return alloc_large(arena, bytes, true);
+        }
+        bool fresh;
+        void *block = alloc_small(arena, size_class(bytes), &fresh);
+        if (!fresh) {
+                memset(block, 0, bytes);
+        }
+        return block;
+}
+
+/********** arena_release ********
+ *
+ * Returns a block to the arena. Small blocks go onto the free list of
+ * their class; large blocks are unmapped right away, or handed to the
+ * reclamation thread if they reach the deferral threshold.
+ *
+ * Parameters:
+ *      Arena_T arena: arena the block came from
+ *      void *ptr: the block
+ *      size_t bytes: size the block was allocated with
+ * Return: None
+ *
+ * Expects:
+ *      arena and ptr must not be NULL
+ * Notes:
+ *      Will CRE if arena or ptr is NULL
+ *****************************/
+extern void arena_release(Arena_T arena, void *ptr, size_t bytes)
+{
+        assert(arena != NULL && ptr != NULL);
+        if (bytes > LARGE_BYTES) {
+                Large *large = (Large *)ptr - 1;
+                if (large->prev != NULL) {
+                        large->prev->next = large->next;
+                } else {
+                        arena->large = large->next;
+                }
+                if (large->next != NULL) {
+                        large->next->prev = large->prev;
+                }
+                arena->mapped -= large->size;
+                if (large->huge) {
+                        arena->huge_bytes -= large->size;
+                }
+                if (arena->fd >= 0) {
+                        give_extent(arena, large, large->size);
+                } else if (arena->defer_bytes != 0 && 
+                           bytes >= arena->defer_bytes) {
+                        reclaim_defer(large, large->size, large->huge);
+                } else {
+                        unmap_region(arena, large, large->size,
+                                     large->huge);
+                }
+                return;
+        }
+        unsigned class = size_class(bytes);
+        arena->small_bytes -= class_bytes(class);
+        Free *block = ptr;
+        block->next = arena->free[class];
+        arena->free[class] = block;
+}
+
+/********** arena_mapped ********
+ *
+ * Returns the number of bytes the arena currently has mapped
+ *
+ * Parameters:
+ *      Arena_T arena: arena to report on
+ * Return:
+ *      mapped bytes, including free blocks and unused chunk space
+ *
+ * Expects:
+ *      arena must not be NULL
+ * Notes:
+ *      Will CRE if arena is NULL
+ *****************************/
+extern size_t arena_mapped(Arena_T arena)
+{
+        assert(arena != NULL);
+        return arena->mapped;
+}
+
+/********** arena_set_deferred ********
+ *
+ * Sets the size from which released large blocks are handed to the
+ * reclamation thread instead of being unmapped by the caller
+ *
+ * Parameters:
+ *      Arena_T arena: arena to configure
+ *      size_t bytes: threshold in bytes, or 0 to unmap every block directly
+ * Return: None
+ *
+ * Expects:
+ *      arena must not be NULL
+ * Notes:
+ *      Will CRE if arena is NULL
+ *****************************/
+extern void arena_set_deferred(Arena_T arena, size_t bytes)
+{
+        assert(arena != NULL);
+        arena->defer_bytes = bytes;
+}
+
+/********** arena_set_huge ********
+ *
+ * Sets which future mappings are aligned and advised for transparent huge
+ * pages; existing mappings keep their advice. A file-backed arena keeps
+ * huge pages off.
+ *
+ * Parameters:
+ *      Arena_T arena: arena to configure
+ *      Arena_huge policy: the new policy
+ * Return: None
+ *
+ * Expects:
+ *      arena must not be NULL
+ * Notes:
+ *      Will CRE if arena is NULL
+ *****************************/
+extern void arena_set_huge(Arena_T arena, Arena_huge policy)
+{
+        assert(arena != NULL);
+        arena->huge = arena->fd < 0 ? policy : ARENA_HUGE_OFF;
+}
+
+/********** arena_huge ********
+ *
+ * Returns the number of mapped bytes the kernel accepted MADV_HUGEPAGE for
+ *
+ * Parameters:
+ *      Arena_T arena: arena to report on
+ * Return:
+ *      bytes eligible for transparent huge pages
+ *
+ * Expects:
+ *      arena must not be NULL
+ * Notes:
+ *      Will CRE if arena is NULL
+ *      Whether the kernel actually found huge pages for them is reported
+ *      process-wide as AnonHugePages in /proc/self/smaps_rollup
+ *****************************/
+extern size_t arena_huge(Arena_T arena)
+{
+        assert(arena != NULL);
+        return arena->huge_bytes;
+}
+
+/********** arena_compact_begin ********
+ *
+ * Starts a compaction. Existing chunks and free lists are set aside, and
+ * new small blocks are bumped out of fresh chunks, the first of which is
+ * sized to hold every live small block.
+ *
+ * Parameters:
+ *      Arena_T arena: arena to compact
+ * Return: None
+ *
+ * Expects:
+ *      arena must not be NULL and must not already be compacting
+ * Notes:
+ *      Will CRE if arena is NULL or a compaction is in progress
+ *      Until arena_compact_end, the caller must arena_move every live
+ *      small block it wants to keep, and must not release any block
+ *****************************/
+extern void arena_compact_begin(Arena_T arena)
+{
+        assert(arena != NULL && arena->old_chunks == NULL);
+        arena->old_chunks = arena->chunks;
+        arena->chunks = NULL;
+        arena->bump = NULL;
+        arena->limit = NULL;
+        memset(arena->free, 0, sizeof(arena->free));
+
+        size_t live = arena->small_bytes + sizeof(Chunk);
+        arena->next_chunk = MIN_CHUNK;
+        while (arena->next_chunk < live && arena->next_chunk < MAX_CHUNK) {
+                arena->next_chunk *= 2;
+        }
+        arena->small_bytes = 0;
+        arena->moved_bytes = 0;
+}
+
+/********** arena_move ********
+ *
+ * During a compaction, copies a small block into the fresh chunks, next
+ * to the block moved before it. Large blocks have mappings of their own
+ * and stay where they are.
+ *
+ * Parameters:
+ *      Arena_T arena: arena being compacted
+ *      void *ptr: a live block
+ *      size_t bytes: size the block was allocated with
+ * Return:
+ *      the block's new address, which is ptr for a large block
+ *
+ * Expects:
+ *      arena and ptr must not be NULL; a compaction must be in progress
+ * Notes:
+ *      Will CRE if arena or ptr is NULL or no compaction is in progress
+ *      The old copy stays readable until arena_compact_end
+ *****************************/
+extern void *arena_move(Arena_T arena, void *ptr, size_t bytes)
+{
+        assert(arena != NULL && ptr != NULL && arena->old_chunks != NULL);
+        if (bytes > LARGE_BYTES) {
+                return ptr;
+        }
+        bool fresh;
+        void *moved = alloc_small(arena, size_class(bytes), &fresh);
+        memcpy(moved, ptr, bytes);
+        arena->moved_bytes += bytes;
+        return moved;
+}
+
+/********** arena_compact_end ********
+ *
+ * Finishes a compaction by unmapping the chunks that were set aside
+ *
+ * Parameters:
+ *      Arena_T arena: arena being compacted
+ * Return:
+ *      bytes moved by the compaction
+ *
+ * Expects:
+ *      arena must not be NULL
+ * Notes:
+ *      Will CRE if arena is NULL
+ *      Blocks that were not moved are gone
+ *****************************/
+extern size_t arena_compact_end(Arena_T arena)
+{
+        assert(arena != NULL);
+        Chunk *chunk = arena->old_chunks;
+        while (chunk != NULL) {
+                if (chunk->huge) {
+                        arena->huge_bytes -= chunk->size;
+                }
+                chunk = chunk->next;
+        }
+        arena->mapped -= unmap_chunks(arena, arena->old_chunks);
+        arena->old_chunks = NULL;
+        return arena->moved_bytes;
+}
+
+/********** arena_root ********
+ *
+ * Returns the slot in which the owner of a file-backed arena keeps a
+ * pointer to its own state, so that it can find that state again when the
+ * file is reopened
+ *
+ * Parameters:
+ *      Arena_T arena: a file-backed arena
+ * Return:
+ *      the slot, NULL in a new arena
+ *
+ * Expects:
+ *      arena must not be NULL and must be file-backed
+ * Notes:
+ *      Will CRE if arena is NULL or anonymous
+ *****************************/
+extern void **arena_root(Arena_T arena)
+{
+        assert(arena != NULL && arena->fd >= 0);
+        return &arena->root;
+}
+
+/********** arena_sync ********
+ *
+ * Writes every dirty page of a file-backed arena to disk and waits for
+ * the writes to finish; does nothing for an anonymous arena
+ *
+ * Parameters:
+ *      Arena_T arena: the arena to sync
+ * Return:
+ *      true if the pages reached the disk
+ *
+ * Expects:
+ *      arena must not be NULL
+ * Notes:
+ *      Will CRE if arena is NULL
+ *****************************/
+extern bool arena_sync(Arena_T arena)
+{
+        assert(arena != NULL);
+        if (arena->fd < 0) {
+                return true;
+        }
+        return msync(arena->base, arena->file_end, MS_SYNC) == 0;
+}
@@ -0,0 +1,49 @@
+/**************************************************************
+ *
+ *                     arena.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     arena.h contains the interface of a per-UM memory arena. Segment
+ *     memory is carved out of a handful of large anonymous mappings, so
+ *     destroying a UM releases all of it in a few munmap calls instead of
+ *     one free per segment. An arena can also be backed by a file, so
+ *     that segment memory may exceed RAM and outlive the process.
+ *
+ **************************************************************/
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct Arena_T *Arena_T;
+
+/* Which mappings are aligned to and advised for transparent huge pages */
+typedef enum Arena_huge {
+        ARENA_HUGE_LARGE = 0,   /* mappings for blocks of 2 MiB or more */
+        ARENA_HUGE_OFF,         /* none */
+        ARENA_HUGE_ALL          /* those, and chunks of 2 MiB or more */
+} Arena_huge;
+
+extern Arena_T arena_new(void);
+extern Arena_T arena_new_file(const char *path, size_t span, bool reopen);
+extern void arena_free(Arena_T *arena);
+extern void *arena_alloc(Arena_T arena, size_t bytes);
+extern void *arena_calloc(Arena_T arena, size_t bytes);
+extern void arena_release(Arena_T arena, void *ptr, size_t bytes);
+extern size_t arena_mapped(Arena_T arena);
+extern void arena_set_deferred(Arena_T arena, size_t bytes);
+extern void arena_set_huge(Arena_T arena, Arena_huge policy);
+extern size_t arena_huge(Arena_T arena);
+extern void arena_compact_begin(Arena_T arena);
+extern void *arena_move(Arena_T arena, void *ptr, size_t bytes);
+extern size_t arena_compact_end(Arena_T arena);
+extern void **arena_root(Arena_T arena);
+extern bool arena_sync(Arena_T arena);
+
+#endif
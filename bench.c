@@ -0,0 +1,344 @@
+/**************************************************************
+ *
+ *                     bench.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     bench.c contains the implementation of the scaling benchmark. Every
+ *     copy loads its program before a common start signal, a barrier for
+ *     threads and a pipe for processes, so only execution is timed. Each
+ *     copy reports its instructions, wall time and CPU time, and each row
+ *     of the report gives, for one program, mode and K:
+ *
+ *       instr/s     instructions of all copies over the time from the
+ *                   start signal until the last copy halted
+ *       efficiency  instr/s over K times instr/s with one copy, in the
+ *                   same mode
+ *       mean, cv    mean wall time of a copy and its coefficient of
+ *                   variation, which grows when some copies are starved
+ *       cpu         CPU time over wall time of the average copy; below
+ *                   100% means copies waited for a core, a lock or I/O
+ *
+ *     Efficiency well below 100% with cpu near 100% points at shared
+ *     resources such as caches and memory bandwidth; low cpu points at
+ *     oversubscription or blocking. Output goes to /dev/null and input
+ *     comes from it.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <mem.h>
+#include "bench.h"
+
+/* What one copy reports */
+typedef struct Run {
+        uint64_t        instructions;
+        uint64_t        wall_ns;        /* from the start signal to halt */
+        uint64_t        cpu_ns;
+        int             halted;         /* 0 if the UM faulted */
+} Run;
+
+/* A copy running as a thread */
+typedef struct Copy {
+        pthread_t       thread;
+        UM_T            um;
+        pthread_barrier_t *start;
+        Run             run;
+} Copy;
+
+/********** now_ns ********
+ *
+ * Reads a clock in nanoseconds
+ *****************************/
+static uint64_t now_ns(clockid_t clock)
+{
+        struct timespec now;
+        clock_gettime(clock, &now);
+        return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/********** load ********
+ *
+ * Loads a program for a copy, with its input and output on /dev/null
+ *****************************/
+static UM_T load(char *program, const UM_config *config, FILE *null_in,
+                 FILE *null_out)
+{
+        UM_T um = um_new(program, config);
+        um_set_io(um, null_in, null_out);
+        return um;
+}
+
+/********** measure ********
+ *
+ * Runs a loaded copy to completion, timing it from start_ns
+ *****************************/
+static Run measure(UM_T um, uint64_t start_ns)
+{
+        uint64_t cpu = now_ns(CLOCK_THREAD_CPUTIME_ID);
+        UM_status status = um_run(um);
+        Run run;
+        run.wall_ns = now_ns(CLOCK_MONOTONIC) - start_ns;
+        run.cpu_ns = now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu;
+        run.instructions = um_stats(um).instructions;
+        run.halted = status == UM_HALTED;
+        return run;
+}
+
+/********** run_thread ********
+ *
+ * Body of a thread copy: waits at the barrier, then runs
+ *****************************/
+static void *run_thread(void *cl)
+{
+        Copy *copy = cl;
+        pthread_barrier_wait(copy->start);
+        copy->run = measure(copy->um, now_ns(CLOCK_MONOTONIC));
+        return NULL;
+}
+
+/********** with_threads ********
+ *
+ * Runs copies of a program as threads of this process
+ *****************************/
+static void with_threads(char *program, unsigned copies,
+                         const UM_config *config, Run *runs)
+{
+        FILE *null_in = fopen("/dev/null", "r");
+        FILE *null_out = fopen("/dev/null", "w");
+        assert(null_in != NULL && null_out != NULL);
+        pthread_barrier_t start;
+        pthread_barrier_init(&start, NULL, copies);
+        Copy *threads = CALLOC(copies, sizeof(Copy));
+        assert(threads != NULL);
+        for (unsigned i = 0; i < copies; i++) {
+                threads[i].um = load(program, config, null_in, null_out);
+                threads[i].start = &start;
+        }
+        for (unsigned i = 0; i < copies; i++) {
+                int failed = pthread_create(&threads[i].thread, NULL,
+                                            run_thread, &threads[i]);
+                assert(failed == 0);
+                (void)failed;
+        }
+        for (unsigned i = 0; i < copies; i++) {
+                pthread_join(threads[i].thread, NULL);
+                runs[i] = threads[i].run;
+                um_free(&threads[i].um);
+        }
+        free(threads);
+        pthread_barrier_destroy(&start);
+        fclose(null_in);
+        fclose(null_out);
+}
+
+/********** read_full ********
+ *
+ * Reads exactly length bytes from a pipe
+ *
+ * Return:
+ *      false at end of file or on an error
+ *****************************/
+static bool read_full(int fd, void *buffer, size_t length)
+{
+        char *bytes = buffer;
+        while (length > 0) {
+                ssize_t got = read(fd, bytes, length);
+                if (got < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (got <= 0) {
+                        return false;
+                }
+                bytes += got;
+                length -= (size_t)got;
+        }
+        return true;
+}
+
+/********** run_child ********
+ *
+ * Body of a process copy: loads the program, says so on results, waits
+ * for the start pipe to close, runs, and writes its Run to results
+ *****************************/
+static void run_child(char *program, const UM_config *config, int go,
+                      int results)
+{
+        FILE *null_in = fopen("/dev/null", "r");
+        FILE *null_out = fopen("/dev/null", "w");
+        assert(null_in != NULL && null_out != NULL);
+        UM_T um = load(program, config, null_in, null_out);
+        char ready = 1;
+        char unused;
+        if (write(results, &ready, 1) != 1 || read(go, &unused, 1) != 0) {
+                _exit(EXIT_FAILURE);
+        }
+        Run run = measure(um, now_ns(CLOCK_MONOTONIC));
+        ssize_t ignored = write(results, &run, sizeof(run));
+        (void)ignored;
+        _exit(EXIT_SUCCESS);
+}
+
+/********** with_processes ********
+ *
+ * Runs copies of a program as child processes. Closing the start pipe
+ * releases every child at once; each answers on a pipe of its own.
+ *
+ * Return:
+ *      false if a child failed to report
+ *****************************/
+static bool with_processes(char *program, unsigned copies,
+                           const UM_config *config, Run *runs)
+{
+        int go[2];
+        int *results = CALLOC(copies, sizeof(int));
+        pid_t *children = CALLOC(copies, sizeof(pid_t));
+        assert(results != NULL && children != NULL);
+        int failed = pipe(go);
+        assert(failed == 0);
+        fflush(NULL);
+        for (unsigned i = 0; i < copies; i++) {
+                int answer[2];
+                failed = pipe(answer);
+                assert(failed == 0);
+                children[i] = fork();
+                assert(children[i] >= 0);
+                if (children[i] == 0) {
+                        close(go[1]);
+                        close(answer[0]);
+                        run_child(program, config, go[0], answer[1]);
+                }
+                close(answer[1]);
+                results[i] = answer[0];
+        }
+        close(go[0]);
+
+        bool ok = true;
+        for (unsigned i = 0; i < copies; i++) {
+                char ready;
+                ok = read_full(results[i], &ready, 1) && ok;
+        }
+        close(go[1]);
+        for (unsigned i = 0; i < copies; i++) {
+                ok = read_full(results[i], &runs[i], sizeof(Run)) && ok;
+                close(results[i]);
+                waitpid(children[i], NULL, 0);
+        }
+        free(results);
+        free(children);
+        return ok;
+}
+
+/********** report_row ********
+ *
+ * Summarizes the runs of one program, mode and number of copies
+ *
+ * Parameters:
+ *      FILE *report: where to write the row
+ *      const char *program, *mode: labels
+ *      unsigned copies: K
+ *      const Run *runs: one per copy
+ *      double *single: instr/s with one copy in this mode, set when K is 1
+ * Return: None
+ *****************************/
+static void report_row(FILE *report, const char *program, const char *mode,
+                       unsigned copies, const Run *runs, double *single)
+{
+        uint64_t instructions = 0;
+        uint64_t longest = 0;
+        double sum = 0, squares = 0, cpu = 0;
+        int halted = 0;
+        for (unsigned i = 0; i < copies; i++) {
+                instructions += runs[i].instructions;
+                if (runs[i].wall_ns > longest) {
+                        longest = runs[i].wall_ns;
+                }
+                double seconds = runs[i].wall_ns / 1e9;
+                sum += seconds;
+                squares += seconds * seconds;
+                cpu += runs[i].wall_ns == 0 ? 1.0 : (double)runs[i].cpu_ns / 
+                                                    runs[i].wall_ns;
+                halted += runs[i].halted;
+        }
+        double mean = sum / copies;
+        double variance = squares / copies - mean * mean;
+        double cv = mean > 0 ? sqrt(variance > 0 ? variance : 0) / mean : 0;
+        double rate = longest == 0 ? 0 : instructions / (longest / 1e9);
+        if (copies == 1) {
+                *single = rate;
+        }
+        double efficiency = *single > 0 ? rate / (copies * *single) : 0;
+        fprintf(report, "%-20s %-9s %3u %14.0f %9.1f%% %9.3f %6.1f%% "
+                "%5.1f%%%s\n", program, mode, copies, rate,
+                100 * efficiency, mean, 100 * cv, 100 * cpu / copies,
+                halted == (int)copies ? "" : "  (faulted)");
+        fflush(report);
+}
+
+/********** bench_run ********
+ *
+ * Runs the scaling benchmark and writes its report
+ *
+ * Parameters:
+ *      char **programs: paths of .um programs
+ *      int count: number of programs
+ *      unsigned max_copies: largest K, or 0 for the number of online
+ *                           cores
+ *      const UM_config *config: settings for every copy
+ *      FILE *report: where to write the report
+ * Return: None
+ *
+ * Expects:
+ *      programs, config and report must not be NULL
+ * Notes:
+ *      Will CRE if programs, config or report is NULL, or a thread,
+ *      process or pipe cannot be created
+ *      Exits with EXIT_FAILURE, like um_new, if a program cannot be found
+ *****************************/
+extern void bench_run(char **programs, int count, unsigned max_copies,
+                      const UM_config *config, FILE *report)
+{
+        assert(programs != NULL && config != NULL && report != NULL);
+        if (max_copies == 0) {
+                long cores = sysconf(_SC_NPROCESSORS_ONLN);
+                max_copies = cores > 0 ? (unsigned)cores : 1;
+        }
+        Run *runs = CALLOC(max_copies, sizeof(Run));
+        assert(runs != NULL);
+        fprintf(report, "%-20s %-9s %3s %14s %10s %9s %7s %6s\n", 
+                "program", "mode", "K", "instr/s", "efficiency", "mean s",
+                "cv", "cpu");
+        for (int p = 0; p < count; p++) {
+                const char *name = strrchr(programs[p], '/');
+                name = name == NULL ? programs[p] : name + 1;
+                double single = 0;
+                for (unsigned k = 1; k <= max_copies; k++) {
+                        if (!with_processes(programs[p], k, config, runs)) {
+                                fprintf(report, "%-20s %-9s %3u  (a copy "
+                                        "failed)\n", name, "processes", k);
+                                continue;
+                        }
+                        report_row(report, name, "processes", k, runs,
+                                   &single);
+                }
+                single = 0;
+                for (unsigned k = 1; k <= max_copies; k++) {
+                        with_threads(programs[p], k, config, runs);
+                        report_row(report, name, "threads", k, runs,
+                                   &single);
+                }
+        }
+        free(runs);
+}
@@ -0,0 +1,26 @@
+/**************************************************************
+ *
+ *                     bench.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     bench.h contains the interface of the scaling benchmark. It runs K
+ *     concurrent copies of each program, for K from 1 up to a limit,
+ *     first as threads of one process and then as separate processes, and
+ *     reports how aggregate throughput grows with K.
+ *
+ **************************************************************/
+#ifndef BENCH_INCLUDED
+#define BENCH_INCLUDED
+
+#include <stdio.h>
+#include "um_status.h"
+
+extern void bench_run(char **programs, int count, unsigned max_copies,
+                      const UM_config *config, FILE *report);
+
+#endif
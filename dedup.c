@@ -0,0 +1,187 @@
+/**************************************************************
+ *
+ *                     dedup.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     dedup.c contains the implementation of the shared content store: a
+ *     chained hash table of Shared bodies, each the words of a segment
+ *     after a header holding their hash and reference count. Lookups,
+ *     insertions and releases take the table lock; retaining a body the
+ *     caller already holds a reference to only increments its count, so
+ *     cloning a UM whose segments are shared takes no lock. A count can
+ *     only reach zero under the lock, where the body is also unlinked, so
+ *     a lookup never finds a body that is being freed.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <mem.h>
+#include "dedup.h"
+
+#define MIN_BUCKETS     256
+
+/* One distinct content, followed by its words */
+typedef struct Shared {
+        struct Shared  *next;           /* chain of its bucket */
+        uint64_t        hash;
+        atomic_size_t   refs;           /* segments using these words */
+        uint32_t        length;
+        uint32_t        words[];
+} Shared;
+
+#define SHARED_OF(words) \
+        ((Shared *)((char *)(words) - offsetof(Shared, words)))
+
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static Shared        **buckets;         /* by lock */
+static size_t          bucket_count;    /* a power of two, or 0 */
+static size_t          body_count;      /* bodies in the table */
+
+/********** hash_words ********
+ *
+ * Hashes a segment's contents, mixing in its length
+ *****************************/
+static uint64_t hash_words(const uint32_t *words, uint32_t length)
+{
+        uint64_t hash = 0xcbf29ce484222325u ^ length;
+        for (uint32_t i = 0; i < length; i++) {
+                hash = (hash ^ words[i]) * 0x100000001b3u;
+        }
+        return hash ^ hash >> 29;
+}
+
+/********** grow ********
+ *
+ * Doubles the number of buckets, rehashing every body; called with the
+ * table lock held
+ *****************************/
+static void grow(void)
+{
+        size_t count = bucket_count == 0 ? MIN_BUCKETS : bucket_count * 2;
+        Shared **table = CALLOC(count, sizeof(Shared *));
+        assert(table != NULL);
+        for (size_t i = 0; i < bucket_count; i++) {
+                Shared *body = buckets[i];
+                while (body != NULL) {
+                        Shared *next = body->next;
+                        Shared **bucket = &table[body->hash & (count - 1)];
+                        body->next = *bucket;
+                        *bucket = body;
+                        body = next;
+                }
+        }
+        free(buckets);
+        buckets = table;
+        bucket_count = count;
+}
+
+/********** dedup_intern ********
+ *
+ * Finds the shared body holding the given words, adding a copy of them
+ * if there is none, and takes a reference to it
+ *
+ * Parameters:
+ *      const uint32_t *words: contents of a segment
+ *      uint32_t length: number of words
+ * Return:
+ *      the shared words, which must not be written and are given back
+ *      with dedup_release
+ *
+ * Expects:
+ *      words must not be NULL
+ * Notes:
+ *      Will CRE if words is NULL or allocation fails
+ *      Safe to call from any thread
+ *****************************/
+extern const uint32_t *dedup_intern(const uint32_t *words, uint32_t length)
+{
+        assert(words != NULL);
+        uint64_t hash = hash_words(words, length);
+
+        pthread_mutex_lock(&table_lock);
+        if (body_count >= bucket_count) {
+                grow();
+        }
+        Shared **bucket = &buckets[hash & (bucket_count - 1)];
+        for (Shared *body = *bucket; body != NULL; body = body->next) {
+                if (body->hash == hash && body->length == length &&
+                    memcmp(body->words, words, (size_t)length * 4) == 0) {
+                        atomic_fetch_add(&body->refs, 1);
+                        pthread_mutex_unlock(&table_lock);
+                        return body->words;
+                }
+        }
+        Shared *body = ALLOC(sizeof(Shared) + (size_t)length * 4);
+        assert(body != NULL);
+        body->hash = hash;
+        atomic_init(&body->refs, 1);
+        body->length = length;
+        memcpy(body->words, words, (size_t)length * 4);
+        body->next = *bucket;
+        *bucket = body;
+        body_count++;
+        pthread_mutex_unlock(&table_lock);
+        return body->words;
+}
+
+/********** dedup_retain ********
+ *
+ * Takes another reference to shared words
+ *
+ * Parameters:
+ *      const uint32_t *words: words returned by dedup_intern, to which
+ *                             the caller holds a reference
+ * Return: None
+ *
+ * Expects:
+ *      words must not be NULL
+ * Notes:
+ *      Will CRE if words is NULL
+ *****************************/
+extern void dedup_retain(const uint32_t *words)
+{
+        assert(words != NULL);
+        atomic_fetch_add(&SHARED_OF(words)->refs, 1);
+}
+
+/********** dedup_release ********
+ *
+ * Gives back a reference to shared words, freeing them with the last one
+ *
+ * Parameters:
+ *      const uint32_t *words: words returned by dedup_intern
+ * Return: None
+ *
+ * Expects:
+ *      words must not be NULL, and the caller must hold a reference
+ * Notes:
+ *      Will CRE if words is NULL
+ *****************************/
+extern void dedup_release(const uint32_t *words)
+{
+        assert(words != NULL);
+        Shared *body = SHARED_OF(words);
+        pthread_mutex_lock(&table_lock);
+        if (atomic_fetch_sub(&body->refs, 1) != 1) {
+                pthread_mutex_unlock(&table_lock);
+                return;
+        }
+        Shared **link = &buckets[body->hash & (bucket_count - 1)];
+        while (*link != body) {
+                link = &(*link)->next;
+        }
+        *link = body->next;
+        body_count--;
+        pthread_mutex_unlock(&table_lock);
+        free(body);
+}
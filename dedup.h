@@ -0,0 +1,27 @@
+/**************************************************************
+ *
+ *                     dedup.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     dedup.h contains the interface of the process-wide store of shared
+ *     segment contents. UMs cloned from one program or snapshot often
+ *     hold many identical segments that are never written, such as tables
+ *     built at boot; the store keeps one reference-counted, read-only
+ *     copy of each distinct content, found by hash, for all of them.
+ *
+ **************************************************************/
+#ifndef DEDUP_INCLUDED
+#define DEDUP_INCLUDED
+
+#include <stdint.h>
+
+extern const uint32_t *dedup_intern(const uint32_t *words, uint32_t length);
+extern void dedup_retain(const uint32_t *words);
+extern void dedup_release(const uint32_t *words);
+
+#endif
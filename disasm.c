@@ -0,0 +1,879 @@
+/**************************************************************
+ *
+ *                     disasm.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     disasm.c contains the implementation of the disassembler. Blocks
+ *     start at word 0, after every halt and load program, and at every
+ *     jump target found. Register constants are propagated from word 0,
+ *     where all registers are 0, along fall-through and jump edges with a
+ *     worklist until they settle; a register is known on entry to a block
+ *     only if every edge into it agrees. A load program is a jump when its
+ *     segment and target are known, and a two-way branch when its target
+ *     came from a conditional move between two known values, which is how
+ *     compiled UM code branches. A target that lands inside a block splits
+ *     it and the solution is recomputed, so the final one describes the
+ *     final blocks. Unreached blocks are then flagged as data when nothing
+ *     else could reach them.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include <bitpack.h>
+#include <mem.h>
+#include "disasm.h"
+
+enum { OP_CMOV = 0, OP_SLOAD, OP_SSTORE, OP_ADD, OP_MUL, OP_DIV, OP_NAND,
+       OP_HALT, OP_MAP, OP_UNMAP, OP_OUT, OP_IN, OP_LOADP, OP_ORTHO };
+
+static const char *const mnemonics[DISASM_INVALID] = {
+        "cmov", "sload", "sstore", "add", "mul", "div", "nand", "halt",
+        "map", "unmap", "out", "in", "loadp", "ortho"
+};
+
+/********** struct Disasm_T ********
+ *
+ * const uint32_t *words: the image, owned by the caller
+ * uint32_t count: number of words
+ * Disasm_block *blocks: the basic blocks, in address order
+ * uint32_t block_count: number of blocks
+ * Disasm_regs *entries: registers known on entry to each block
+ * uint8_t *sites: DISASM_SITE_* flags of each word
+ *
+ *****************************/
+struct Disasm_T {
+        const uint32_t *words;
+        uint32_t        count;
+        Disasm_block   *blocks;
+        uint32_t        block_count;
+        Disasm_regs    *entries;
+        uint8_t        *sites;
+};
+
+/********** disasm_decode ********
+ *
+ * Splits an instruction word into its fields
+ *
+ * Parameters:
+ *      uint32_t word: the instruction
+ * Return:
+ *      its opcode, registers and, for orthography, value; an opcode of
+ *      DISASM_INVALID or more executes as a no-op
+ *****************************/
+extern Disasm_insn disasm_decode(uint32_t word)
+{
+        Disasm_insn insn;
+        insn.opcode = (unsigned)Bitpack_getu(word, 4, 28);
+        insn.value = 0;
+        if (insn.opcode == OP_ORTHO) {
+                insn.a = (unsigned)Bitpack_getu(word, 3, 25);
+                insn.b = insn.c = 0;
+                insn.value = (uint32_t)Bitpack_getu(word, 25, 0);
+        } else {
+                insn.a = (unsigned)Bitpack_getu(word, 3, 6);
+                insn.b = (unsigned)Bitpack_getu(word, 3, 3);
+                insn.c = (unsigned)Bitpack_getu(word, 3, 0);
+        }
+        return insn;
+}
+
+/********** disasm_format ********
+ *
+ * Writes an instruction as assembly text, showing only the registers it
+ * uses
+ *
+ * Parameters:
+ *      uint32_t word: the instruction
+ *      char *text: buffer for the text
+ *      size_t size: size of text
+ * Return:
+ *      length of the full text, as snprintf returns it
+ *
+ * Expects:
+ *      text must not be NULL
+ * Notes:
+ *      Will CRE if text is NULL
+ *****************************/
+extern int disasm_format(uint32_t word, char *text, size_t size)
+{
+        assert(text != NULL);
+        Disasm_insn insn = disasm_decode(word);
+        if (insn.opcode >= DISASM_INVALID) {
+                return snprintf(text, size, ".word   0x%08x", word);
+        }
+        const char *name = mnemonics[insn.opcode];
+        switch (insn.opcode) {
+        case OP_HALT:
+                return snprintf(text, size, "%s", name);
+        case OP_MAP:
+        case OP_LOADP:
+                return snprintf(text, size, "%-7s r%u, r%u", name, insn.b,
+                                insn.c);
+        case OP_ORTHO:
+                return snprintf(text, size, "%-7s r%u, 0x%x", name, insn.a,
+                                insn.value);
+        case OP_UNMAP:
+        case OP_OUT:
+        case OP_IN:
+                return snprintf(text, size, "%-7s r%u", name, insn.c);
+        default:
+                return snprintf(text, size, "%-7s r%u, r%u, r%u", name,
+                                insn.a, insn.b, insn.c);
+        }
+}
+
+/********** disasm_load ********
+ *
+ * Reads a UM image, whose words are stored big-endian
+ *
+ * Parameters:
+ *      const char *path: the image
+ *      uint32_t *count: receives the number of words
+ * Return:
+ *      the words, to be freed with free, or NULL if the file cannot be
+ *      read
+ *
+ * Expects:
+ *      path and count must not be NULL
+ * Notes:
+ *      Will CRE if path or count is NULL or allocation fails
+ *      Trailing bytes that do not make up a word are ignored, as the UM
+ *      ignores them
+ *****************************/
+extern uint32_t *disasm_load(const char *path, uint32_t *count)
+{
+        assert(path != NULL && count != NULL);
+        struct stat image;
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL || fstat(fileno(fp), &image) != 0) {
+                if (fp != NULL) {
+                        fclose(fp);
+                }
+                return NULL;
+        }
+        *count = (uint32_t)(image.st_size / 4);
+        uint32_t *words = ALLOC((size_t)*count * 4 + 4);
+        assert(words != NULL);
+        for (uint32_t i = 0; i < *count; i++) {
+                uint8_t bytes[4];
+                if (fread(bytes, 1, 4, fp) != 4) {
+                        free(words);
+                        fclose(fp);
+                        return NULL;
+                }
+                words[i] = (uint32_t)bytes[0] << 24 | bytes[1] << 16 |
+                           bytes[2] << 8 | bytes[3];
+        }
+        fclose(fp);
+        return words;
+}
+
+/********** known ********
+ *
+ * Returns whether a register's content is known
+ *****************************/
+static inline bool known(const Disasm_regs *state, unsigned r)
+{
+        return (state->known >> r & 1) != 0;
+}
+
+/********** set ********
+ *
+ * Records a register's content, or forgets it
+ *****************************/
+static inline void set(Disasm_regs *state, unsigned r, bool is_known,
+                       uint32_t value)
+{
+        state->known = is_known ? state->known | 1u << r
+                               : state->known & ~(1u << r);
+        state->values[r] = value;
+}
+
+/********** step ********
+ *
+ * Updates the known registers for one instruction that does not end a
+ * block
+ *****************************/
+static void step(Disasm_regs *state, Disasm_insn insn)
+{
+        bool both = known(state, insn.b) && known(state, insn.c);
+        uint32_t b = state->values[insn.b];
+        uint32_t c = state->values[insn.c];
+        switch (insn.opcode) {
+        case OP_ORTHO:
+                set(state, insn.a, true, insn.value);
+                break;
+        case OP_CMOV:
+                if (known(state, insn.c) && c != 0) {
+                        set(state, insn.a, known(state, insn.b), b);
+                } else if (!known(state, insn.c) &&
+                           (!known(state, insn.a) || !known(state, insn.b) ||
+                            state->values[insn.a] != b)) {
+                        set(state, insn.a, false, 0);
+                }
+                break;
+        case OP_ADD:
+                set(state, insn.a, both, b + c);
+                break;
+        case OP_MUL:
+                set(state, insn.a, both, b * c);
+                break;
+        case OP_DIV:
+                set(state, insn.a, both && c != 0, c != 0 ? b / c : 0);
+                break;
+        case OP_NAND:
+                set(state, insn.a, both, ~(b & c));
+                break;
+        case OP_SLOAD:
+                set(state, insn.a, false, 0);
+                break;
+        case OP_MAP:
+                set(state, insn.b, false, 0);
+                break;
+        case OP_IN:
+                set(state, insn.c, false, 0);
+                break;
+        default:
+                break;
+        }
+}
+
+/********** ends_block ********
+ *
+ * Returns whether an instruction transfers control away for good
+ *****************************/
+static inline bool ends_block(unsigned opcode)
+{
+        return opcode == OP_HALT || opcode == OP_LOADP;
+}
+
+/********** destination ********
+ *
+ * Returns the register an instruction writes, or -1 if it writes none
+ *****************************/
+static int destination(Disasm_insn insn)
+{
+        switch (insn.opcode) {
+        case OP_CMOV:
+        case OP_SLOAD:
+        case OP_ADD:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_NAND:
+        case OP_ORTHO:
+                return (int)insn.a;
+        case OP_MAP:
+                return (int)insn.b;
+        case OP_IN:
+                return (int)insn.c;
+        default:
+                return -1;
+        }
+}
+
+/********** site ********
+ *
+ * Returns the DISASM_SITE_* flags of an instruction, given the registers
+ * known just before it
+ *****************************/
+static uint8_t site(const Disasm_regs *state, Disasm_insn insn,
+                    uint32_t count)
+{
+        unsigned segment, offset;
+        if (insn.opcode == OP_SLOAD) {
+                segment = insn.b;
+                offset = insn.c;
+        } else if (insn.opcode == OP_SSTORE) {
+                segment = insn.a;
+                offset = insn.b;
+        } else if (insn.opcode == OP_LOADP) {
+                return known(state, insn.b) && known(state, insn.c) &&
+                       state->values[insn.b] == 0 ? DISASM_SITE_JUMP : 0;
+        } else {
+                return 0;
+        }
+        if (!known(state, segment) || state->values[segment] != 0) {
+                return 0;
+        }
+        if (known(state, offset) && state->values[offset] < count) {
+                return DISASM_SITE_SEGMENT0 | DISASM_SITE_BOUNDED;
+        }
+        return DISASM_SITE_SEGMENT0;
+}
+
+/********** walk ********
+ *
+ * Runs a block forward from the registers known on entry, leaving in
+ * *state those known at its end, and sets how the block ends. If sites
+ * is not NULL, the flags of each of its words are recorded there.
+ *****************************/
+static void walk(Disasm_T disasm, Disasm_block *block, Disasm_regs *state,
+                 uint8_t *sites)
+{
+        /* Registers that a conditional move left holding one of two known
+           values, first[r] if it did not move */
+        unsigned either = 0;
+        uint32_t first[8], second[8];
+        uint32_t end = block->start + block->length;
+        for (uint32_t i = block->start; i < end; i++) {
+                Disasm_insn insn = disasm_decode(disasm->words[i]);
+                int written = destination(insn);
+                bool choice = insn.opcode == OP_CMOV &&
+                              !known(state, insn.c) &&
+                              known(state, insn.a) && known(state, insn.b) &&
+                              state->values[insn.a] != state->values[insn.b];
+                if (written >= 0) {
+                        either &= ~(1u << written);
+                }
+                if (choice) {
+                        either |= 1u << insn.a;
+                        first[insn.a] = state->values[insn.a];
+                        second[insn.a] = state->values[insn.b];
+                }
+                if (sites != NULL) {
+                        sites[i] = site(state, insn, disasm->count);
+                        if (insn.opcode == OP_LOADP && sites[i] == 0 &&
+                            known(state, insn.b) &&
+                            state->values[insn.b] == 0 &&
+                            (either >> insn.c & 1)) {
+                                sites[i] = DISASM_SITE_BRANCH;
+                        }
+                }
+                step(state, insn);
+        }
+
+        /* Neither halt nor load program changes a register, so *state
+           also holds before the last instruction */
+        Disasm_insn last = disasm_decode(disasm->words[end - 1]);
+        block->flags &= DISASM_REACHED;
+        block->target = block->other = UINT32_MAX;
+        if (last.opcode == OP_HALT) {
+                block->flags |= DISASM_HALTS;
+        } else if (last.opcode != OP_LOADP) {
+                block->flags |= end < disasm->count ? DISASM_FALLS
+                                                    : DISASM_HALTS;
+        } else if (known(state, last.b) && known(state, last.c) &&
+                   state->values[last.b] == 0) {
+                block->flags |= DISASM_JUMPS;
+                block->target = state->values[last.c];
+        } else if (known(state, last.b) && state->values[last.b] == 0 &&
+                   (either >> last.c & 1)) {
+                block->flags |= DISASM_BRANCHES;
+                block->target = first[last.c];
+                block->other = second[last.c];
+        } else {
+                block->flags |= DISASM_INDIRECT;
+        }
+}
+
+/********** block_at ********
+ *
+ * Returns the index of the block starting at a word, or -1 if none does
+ *****************************/
+static long block_at(Disasm_T disasm, uint32_t start)
+{
+        uint32_t low = 0, high = disasm->block_count;
+        while (low < high) {
+                uint32_t middle = low + (high - low) / 2;
+                if (disasm->blocks[middle].start < start) {
+                        low = middle + 1;
+                } else {
+                        high = middle;
+                }
+        }
+        return low < disasm->block_count &&
+               disasm->blocks[low].start == start ? (long)low : -1;
+}
+
+/********** split ********
+ *
+ * Rebuilds the blocks so that one starts at each word marked in leaders,
+ * forgetting all that was known about the old ones
+ *****************************/
+static void split(Disasm_T disasm, const bool *leaders)
+{
+        free(disasm->blocks);
+        free(disasm->entries);
+        disasm->block_count = 0;
+        for (uint32_t i = 0; i < disasm->count; i++) {
+                disasm->block_count += leaders[i];
+        }
+        disasm->blocks = CALLOC(disasm->block_count + 1,
+                                sizeof(Disasm_block));
+        disasm->entries = CALLOC(disasm->block_count + 1,
+                                 sizeof(Disasm_regs));
+        assert(disasm->blocks != NULL && disasm->entries != NULL);
+        uint32_t index = 0;
+        for (uint32_t i = 0; i < disasm->count; i++) {
+                if (leaders[i]) {
+                        disasm->blocks[index++].start = i;
+                }
+                disasm->blocks[index - 1].length++;
+        }
+}
+
+/********** merge ********
+ *
+ * Meets the registers known at the end of a predecessor with those known
+ * on entry to a block, marking it reached. Returns whether the entry
+ * registers changed, so that the block must be walked again.
+ *****************************/
+static bool merge(Disasm_T disasm, uint32_t index, const Disasm_regs *state)
+{
+        Disasm_block *block = &disasm->blocks[index];
+        Disasm_regs *entry = &disasm->entries[index];
+        if (!(block->flags & DISASM_REACHED)) {
+                block->flags |= DISASM_REACHED;
+                *entry = *state;
+                return true;
+        }
+        unsigned agree = entry->known & state->known;
+        for (unsigned r = 0; r < 8; r++) {
+                if (entry->values[r] != state->values[r]) {
+                        agree &= ~(1u << r);
+                }
+        }
+        if (agree == entry->known) {
+                return false;
+        }
+        entry->known = agree;
+        return true;
+}
+
+/* Blocks whose entry registers changed and must be walked again */
+typedef struct Worklist {
+        uint32_t       *stack;
+        bool           *queued;
+        uint32_t        depth;
+} Worklist;
+
+/********** follow ********
+ *
+ * Carries the registers known at the end of a block along a jump edge.
+ * Returns false, after marking the target in leaders, if it lands inside
+ * a block.
+ *****************************/
+static bool follow(Disasm_T disasm, uint32_t target, const Disasm_regs *state,
+                   bool *leaders, Worklist *work)
+{
+        if (target >= disasm->count) {
+                return true;
+        }
+        long next = block_at(disasm, target);
+        if (next < 0) {
+                leaders[target] = true;
+                return false;
+        }
+        if (merge(disasm, (uint32_t)next, state) && !work->queued[next]) {
+                work->queued[next] = true;
+                work->stack[work->depth++] = (uint32_t)next;
+        }
+        return true;
+}
+
+/********** solve ********
+ *
+ * Propagates the registers known from word 0, where all are 0, along
+ * fall-through, jump and branch edges until nothing changes. Each
+ * register is known in a block only if it holds the same value on every
+ * edge that reaches it; on a branch edge, the target register holds that
+ * target. Returns false, after marking the targets in leaders, if a jump
+ * lands inside a block, since the blocks must then be split and solved
+ * again.
+ *****************************/
+static bool solve(Disasm_T disasm, bool *leaders)
+{
+        if (disasm->block_count == 0) {
+                return true;
+        }
+        Worklist work = {
+                CALLOC(disasm->block_count, sizeof(uint32_t)),
+                CALLOC(disasm->block_count, sizeof(bool)), 0
+        };
+        assert(work.stack != NULL && work.queued != NULL);
+        bool whole = true;
+        Disasm_regs start = { 0xff, { 0 } };
+        merge(disasm, 0, &start);
+        work.stack[work.depth++] = 0;
+        work.queued[0] = true;
+        while (work.depth > 0) {
+                uint32_t index = work.stack[--work.depth];
+                work.queued[index] = false;
+                Disasm_block *block = &disasm->blocks[index];
+                Disasm_regs state = disasm->entries[index];
+                walk(disasm, block, &state, NULL);
+                if (block->flags & DISASM_FALLS) {
+                        whole = follow(disasm, block->start + block->length,
+                                       &state, leaders, &work) && whole;
+                } else if (block->flags & DISASM_JUMPS) {
+                        whole = follow(disasm, block->target, &state,
+                                       leaders, &work) && whole;
+                } else if (block->flags & DISASM_BRANCHES) {
+                        unsigned c = disasm_decode(disasm->words[
+                                block->start + block->length - 1]).c;
+                        set(&state, c, true, block->target);
+                        whole = follow(disasm, block->target, &state,
+                                       leaders, &work) && whole;
+                        set(&state, c, true, block->other);
+                        whole = follow(disasm, block->other, &state,
+                                       leaders, &work) && whole;
+                }
+        }
+        free(work.queued);
+        free(work.stack);
+        return whole;
+}
+
+/********** disasm_new ********
+ *
+ * Builds the control-flow graph of a UM image and the registers known
+ * along it
+ *
+ * Parameters:
+ *      const uint32_t *words: the image, as loaded into segment 0
+ *      uint32_t count: number of words
+ * Return:
+ *      the graph, which refers to words
+ *
+ * Expects:
+ *      words must not be NULL unless count is 0, and must stay valid
+ *      until disasm_free
+ * Notes:
+ *      Will CRE if words is NULL with a nonzero count, or allocation fails
+ *****************************/
+extern Disasm_T disasm_new(const uint32_t *words, uint32_t count)
+{
+        assert(words != NULL || count == 0);
+        bool *leaders = CALLOC((size_t)count + 1, sizeof(bool));
+        assert(leaders != NULL);
+        leaders[0] = true;
+        for (uint32_t i = 0; i < count; i++) {
+                if (ends_block(disasm_decode(words[i]).opcode)) {
+                        leaders[i + 1] = true;
+                }
+        }
+
+        /* Splitting a block adds no edge that was not already taken by
+           falling through, so each round only finds more targets */
+        Disasm_T disasm = CALLOC(1, sizeof(struct Disasm_T));
+        assert(disasm != NULL);
+        disasm->words = words;
+        disasm->count = count;
+        do {
+                split(disasm, leaders);
+        } while (!solve(disasm, leaders));
+        free(leaders);
+
+        disasm->sites = CALLOC((size_t)count + 1, sizeof(uint8_t));
+        assert(disasm->sites != NULL);
+        bool indirect = false;
+        for (uint32_t b = 0; b < disasm->block_count; b++) {
+                Disasm_block *block = &disasm->blocks[b];
+                Disasm_regs state = disasm->entries[b];
+                walk(disasm, block, &state, disasm->sites);
+                indirect = indirect || ((block->flags & DISASM_REACHED) &&
+                                        (block->flags & DISASM_INDIRECT));
+        }
+        for (uint32_t b = 0; b < disasm->block_count; b++) {
+                Disasm_block *block = &disasm->blocks[b];
+                if (block->flags & DISASM_REACHED) {
+                        continue;
+                }
+                bool invalid = false;
+                for (uint32_t i = 0; i < block->length && !invalid; i++) {
+                        invalid = disasm_decode(words[block->start + i])
+                                  .opcode >= DISASM_INVALID;
+                }
+                if (invalid || !indirect) {
+                        block->flags |= DISASM_DATA;
+                }
+        }
+        return disasm;
+}
+
+/********** disasm_blocks ********
+ *
+ * Returns the basic blocks of an image
+ *
+ * Parameters:
+ *      Disasm_T disasm: the graph
+ *      uint32_t *count: receives the number of blocks
+ * Return:
+ *      the blocks, in address order, owned by disasm
+ *
+ * Expects:
+ *      disasm and count must not be NULL
+ * Notes:
+ *      Will CRE if disasm or count is NULL
+ *****************************/
+extern const Disasm_block *disasm_blocks(Disasm_T disasm, uint32_t *count)
+{
+        assert(disasm != NULL && count != NULL);
+        *count = disasm->block_count;
+        return disasm->blocks;
+}
+
+/********** disasm_entry ********
+ *
+ * Returns the registers known on entry to a block
+ *
+ * Parameters:
+ *      Disasm_T disasm: the graph
+ *      uint32_t block: index of the block in disasm_blocks
+ * Return:
+ *      the registers, owned by disasm; none are known in an unreached
+ *      block
+ *
+ * Expects:
+ *      disasm must not be NULL and block must be less than the number of
+ *      blocks
+ * Notes:
+ *      Will CRE if disasm is NULL or block is out of range
+ *****************************/
+extern const Disasm_regs *disasm_entry(Disasm_T disasm, uint32_t block)
+{
+        assert(disasm != NULL && block < disasm->block_count);
+        return &disasm->entries[block];
+}
+
+/********** disasm_site ********
+ *
+ * Returns what is known at a word's segmented load, segmented store or
+ * load program
+ *
+ * Parameters:
+ *      Disasm_T disasm: the graph
+ *      uint32_t address: the word
+ * Return:
+ *      its DISASM_SITE_* flags, 0 for any other instruction
+ *
+ * Expects:
+ *      disasm must not be NULL and address must be within the image
+ * Notes:
+ *      Will CRE if disasm is NULL or address is out of range
+ *****************************/
+extern unsigned disasm_site(Disasm_T disasm, uint32_t address)
+{
+        assert(disasm != NULL && address < disasm->count);
+        return disasm->sites[address];
+}
+
+/********** print_flags ********
+ *
+ * Writes how a block is reached, how it ends and the registers known on
+ * entry
+ *****************************/
+static void print_flags(const Disasm_block *block, const Disasm_regs *entry,
+                        FILE *fp)
+{
+        fprintf(fp, "%s", block->flags & DISASM_DATA ? "data" :
+                          block->flags & DISASM_REACHED ? "reached"
+                                                        : "unreached");
+        if (block->flags & DISASM_FALLS) {
+                fprintf(fp, ", falls through");
+        }
+        if (block->flags & DISASM_JUMPS) {
+                fprintf(fp, ", jumps to 0x%08x", block->target);
+        }
+        if (block->flags & DISASM_BRANCHES) {
+                fprintf(fp, ", branches to 0x%08x or 0x%08x", block->target,
+                        block->other);
+        }
+        if (block->flags & DISASM_INDIRECT) {
+                fprintf(fp, ", jumps indirectly");
+        }
+        if (block->flags & DISASM_HALTS) {
+                fprintf(fp, ", halts");
+        }
+        fputc('\n', fp);
+        if (entry->known == 0) {
+                return;
+        }
+        fprintf(fp, "  ; entry");
+        for (unsigned r = 0; r < 8; r++) {
+                if (entry->known >> r & 1) {
+                        fprintf(fp, " r%u=0x%x", r, entry->values[r]);
+                }
+        }
+        fputc('\n', fp);
+}
+
+/********** disasm_print ********
+ *
+ * Writes a listing of the image, block by block; the words of data
+ * blocks are shown with their bytes as characters, and instructions are
+ * annotated with their DISASM_SITE_* flags
+ *
+ * Parameters:
+ *      Disasm_T disasm: the graph
+ *      FILE *fp: stream to write to
+ * Return: None
+ *
+ * Expects:
+ *      disasm and fp must not be NULL
+ * Notes:
+ *      Will CRE if disasm or fp is NULL
+ *****************************/
+extern void disasm_print(Disasm_T disasm, FILE *fp)
+{
+        assert(disasm != NULL && fp != NULL);
+        uint32_t reached = 0;
+        for (uint32_t b = 0; b < disasm->block_count; b++) {
+                reached += (disasm->blocks[b].flags & DISASM_REACHED) != 0;
+        }
+        fprintf(fp, "; %u words, %u blocks, %u reached\n", disasm->count,
+                disasm->block_count, reached);
+
+        for (uint32_t b = 0; b < disasm->block_count; b++) {
+                const Disasm_block *block = &disasm->blocks[b];
+                fprintf(fp, "\nblock 0x%08x, %u words: ", block->start,
+                        block->length);
+                print_flags(block, &disasm->entries[b], fp);
+                for (uint32_t i = block->start;
+                     i < block->start + block->length; i++) {
+                        uint32_t word = disasm->words[i];
+                        fprintf(fp, "  %08x  %08x  ", i, word);
+                        if (block->flags & DISASM_DATA) {
+                                char chars[5];
+                                for (int byte = 0; byte < 4; byte++) {
+                                        int c = word >> (24 - 8 * byte) &
+                                                0xff;
+                                        chars[byte] = isprint(c) ? c : '.';
+                                }
+                                chars[4] = '\0';
+                                fprintf(fp, ".word   0x%08x  \"%s\"\n",
+                                        word, chars);
+                                continue;
+                        }
+                        char text[48];
+                        disasm_format(word, text, sizeof(text));
+                        unsigned flags = disasm->sites[i];
+                        if (flags == 0) {
+                                fprintf(fp, "%s\n", text);
+                        } else {
+                                fprintf(fp, "%-24s; %s\n", text,
+                                        flags & DISASM_SITE_JUMP ? "direct" :
+                                        flags & DISASM_SITE_BRANCH ?
+                                                "two-way" :
+                                        flags & DISASM_SITE_BOUNDED ?
+                                                "segment 0, in bounds" :
+                                                "segment 0");
+                        }
+                }
+        }
+}
+
+/********** disasm_dot ********
+ *
+ * Writes the control-flow graph in Graphviz DOT. Unreached blocks are
+ * dashed and data blocks grey; unresolved jumps lead to one shared node.
+ *
+ * Parameters:
+ *      Disasm_T disasm: the graph
+ *      FILE *fp: stream to write to
+ * Return: None
+ *
+ * Expects:
+ *      disasm and fp must not be NULL
+ * Notes:
+ *      Will CRE if disasm or fp is NULL
+ *****************************/
+extern void disasm_dot(Disasm_T disasm, FILE *fp)
+{
+        assert(disasm != NULL && fp != NULL);
+        fprintf(fp, "digraph cfg {\n"
+                "        node [shape=box, fontname=monospace];\n"
+                "        indirect [shape=ellipse];\n");
+        for (uint32_t b = 0; b < disasm->block_count; b++) {
+                const Disasm_block *block = &disasm->blocks[b];
+                fprintf(fp, "        b%u [label=\"0x%x-0x%x\"%s];\n",
+                        block->start, block->start,
+                        block->start + block->length - 1,
+                        block->flags & DISASM_DATA ?
+                                ", style=filled, fillcolor=grey" :
+                        block->flags & DISASM_REACHED ? ""
+                                                      : ", style=dashed");
+                if (block->flags & DISASM_FALLS) {
+                        fprintf(fp, "        b%u -> b%u;\n", block->start,
+                                block->start + block->length);
+                }
+                if ((block->flags & (DISASM_JUMPS | DISASM_BRANCHES)) &&
+                    block_at(disasm, block->target) >= 0) {
+                        fprintf(fp, "        b%u -> b%u [color=blue];\n",
+                                block->start, block->target);
+                }
+                if ((block->flags & DISASM_BRANCHES) &&
+                    block_at(disasm, block->other) >= 0) {
+                        fprintf(fp, "        b%u -> b%u [color=blue];\n",
+                                block->start, block->other);
+                }
+                if (block->flags & DISASM_INDIRECT) {
+                        fprintf(fp, "        b%u -> indirect "
+                                "[style=dotted];\n", block->start);
+                }
+        }
+        fprintf(fp, "}\n");
+}
+
+/********** disasm_write_cfg ********
+ *
+ * Writes the control-flow graph in the binary form described in
+ * disasm.h
+ *
+ * Parameters:
+ *      Disasm_T disasm: the graph
+ *      FILE *fp: stream to write to
+ * Return:
+ *      false if a write failed
+ *
+ * Expects:
+ *      disasm and fp must not be NULL
+ * Notes:
+ *      Will CRE if disasm or fp is NULL
+ *****************************/
+extern bool disasm_write_cfg(Disasm_T disasm, FILE *fp)
+{
+        assert(disasm != NULL && fp != NULL);
+        uint32_t header[2] = { disasm->count, disasm->block_count };
+        bool ok = fwrite("UMCFG1\0\0", 1, 8, fp) == 8 &&
+                  fwrite(header, 4, 2, fp) == 2;
+        for (uint32_t b = 0; b < disasm->block_count && ok; b++) {
+                const Disasm_block *block = &disasm->blocks[b];
+                uint32_t fields[5] = { block->start, block->length,
+                                       block->flags, block->target,
+                                       block->other };
+                ok = fwrite(fields, 4, 5, fp) == 5;
+        }
+        return ok;
+}
+
+/********** disasm_free ********
+ *
+ * Frees a control-flow graph, but not the image it refers to
+ *
+ * Parameters:
+ *      Disasm_T *disasm: pointer to the graph; set to NULL
+ * Return: None
+ *
+ * Expects:
+ *      disasm and *disasm must not be NULL
+ * Notes:
+ *      Will CRE if disasm or *disasm is NULL
+ *****************************/
+extern void disasm_free(Disasm_T *disasm)
+{
+        assert(disasm != NULL && *disasm != NULL);
+        free((*disasm)->blocks);
+        free((*disasm)->entries);
+        free((*disasm)->sites);
+        free(*disasm);
+        *disasm = NULL;
+}
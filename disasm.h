@@ -0,0 +1,114 @@
+/**************************************************************
+ *
+ *                     disasm.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     disasm.h contains the interface of the UM image disassembler. It
+ *     decodes words with the same field layout as execute_instruction and
+ *     splits an image into basic blocks, and marks words that can only be
+ *     data. Register constants are propagated from word 0 within and
+ *     across blocks to resolve load program jumps, and to find segmented
+ *     loads and stores that always hit segment 0.
+ *
+ *     What is known holds while segment 0 is the image as loaded, and
+ *     when control enters each block at its start along the graph's
+ *     edges. A translator that reaches a block through an unresolved jump
+ *     must check the block's entry registers first, and must handle
+ *     stores into code and load program from another segment itself.
+ *
+ *     The control-flow graph can be printed as text or DOT, or written in
+ *     a binary form for other tools:
+ *
+ *       "UMCFG1\0\0", then native 32-bit words: the number of words in
+ *       the image, the number of blocks, and for each block, in address
+ *       order, its start, length, flags, target and other target
+ *
+ *     Blocks cover the image without gaps or overlap.
+ *
+ **************************************************************/
+#ifndef DISASM_INCLUDED
+#define DISASM_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct Disasm_T *Disasm_T;
+
+/* Fields of an instruction word */
+typedef struct Disasm_insn {
+        unsigned        opcode;
+        unsigned        a, b, c;  /* registers; for orthography, a is the
+                                     register loaded and b, c are 0 */
+        uint32_t        value;    /* value loaded by orthography */
+} Disasm_insn;
+
+/* Opcodes past the last instruction, which the UM executes as no-ops */
+#define DISASM_INVALID  14
+
+/* Flags of a basic block */
+enum {
+        DISASM_REACHED  = 1 << 0, /* reachable from word 0 by falling
+                                     through and constant jumps */
+        DISASM_DATA     = 1 << 1, /* unreached, and either holds an invalid
+                                     opcode or no jump is unresolved */
+        DISASM_FALLS    = 1 << 2, /* continues with the next block */
+        DISASM_JUMPS    = 1 << 3, /* ends in load program from segment 0
+                                     to a target known on every path */
+        DISASM_INDIRECT = 1 << 4, /* ends in load program whose segment or
+                                     target is unknown */
+        DISASM_HALTS    = 1 << 5, /* ends in halt */
+        DISASM_BRANCHES = 1 << 6  /* ends in load program from segment 0
+                                     to one of two known targets, chosen
+                                     by a conditional move */
+};
+
+/* Registers known at a point: bit r of known is set if register r holds
+   values[r] */
+typedef struct Disasm_regs {
+        unsigned        known;
+        uint32_t        values[8];
+} Disasm_regs;
+
+/* What is known at a word */
+enum {
+        DISASM_SITE_JUMP     = 1 << 0, /* load program from segment 0 to a
+                                          constant target */
+        DISASM_SITE_SEGMENT0 = 1 << 1, /* segmented load or store whose
+                                          segment is always 0 */
+        DISASM_SITE_BOUNDED  = 1 << 2, /* and whose offset is a constant
+                                          within the image */
+        DISASM_SITE_BRANCH   = 1 << 3  /* load program from segment 0 to
+                                          one of two constant targets */
+};
+
+/* A basic block; target is the jump target if DISASM_JUMPS is set, and
+   target and other are the targets if the conditional move does not and
+   does move if DISASM_BRANCHES is set */
+typedef struct Disasm_block {
+        uint32_t        start;
+        uint32_t        length;
+        uint32_t        flags;
+        uint32_t        target;
+        uint32_t        other;
+} Disasm_block;
+
+extern Disasm_insn disasm_decode(uint32_t word);
+extern int disasm_format(uint32_t word, char *text, size_t size);
+extern uint32_t *disasm_load(const char *path, uint32_t *count);
+extern Disasm_T disasm_new(const uint32_t *words, uint32_t count);
+extern const Disasm_block *disasm_blocks(Disasm_T disasm, uint32_t *count);
+extern const Disasm_regs *disasm_entry(Disasm_T disasm, uint32_t block);
+extern unsigned disasm_site(Disasm_T disasm, uint32_t address);
+extern void disasm_print(Disasm_T disasm, FILE *fp);
+extern void disasm_dot(Disasm_T disasm, FILE *fp);
+extern bool disasm_write_cfg(Disasm_T disasm, FILE *fp);
+extern void disasm_free(Disasm_T *disasm);
+
+#endif
@@ -0,0 +1,237 @@
+/**************************************************************
+ *
+ *                     lz.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     lz.c contains the implementation of the LZ77-style codec. The
+ *     compressed form is a series of sequences, each a token byte whose
+ *     high nibble is a literal count and low nibble a match length minus
+ *     MIN_MATCH, the literals, a two-byte little-endian match offset, and
+ *     any length bytes that did not fit in the nibbles (runs of 255 ended
+ *     by a smaller byte). The last sequence carries literals only. Matches
+ *     are found through a hash of the next four bytes, so compression is a
+ *     single pass and long zero runs, common in UM segments, collapse into
+ *     a few bytes.
+ *
+ **************************************************************/
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "lz.h"
+
+#define MIN_MATCH       4
+#define MAX_OFFSET      65535
+#define HASH_BITS       12
+
+/* Bounded output cursor; full is set once a write would overflow */
+typedef struct Output {
+        uint8_t        *dst;
+        size_t          length;
+        size_t          capacity;
+        bool            full;
+} Output;
+
+/********** read32 ********
+ *
+ * Reads four possibly unaligned bytes
+ *****************************/
+static inline uint32_t read32(const uint8_t *p)
+{
+        uint32_t value;
+        memcpy(&value, p, 4);
+        return value;
+}
+
+/********** hash ********
+ *
+ * Hashes four bytes into an index of the match table
+ *****************************/
+static inline unsigned hash(uint32_t value)
+{
+        return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/********** put ********
+ *
+ * Appends bytes to the output unless they would overflow it
+ *****************************/
+static inline void put(Output *out, const uint8_t *bytes, size_t n)
+{
+        if (out->full || n > out->capacity - out->length) {
+                out->full = true;
+                return;
+        }
+        memcpy(out->dst + out->length, bytes, n);
+        out->length += n;
+}
+
+/********** put_extra ********
+ *
+ * Appends the part of a length that did not fit in its token nibble
+ *****************************/
+static void put_extra(Output *out, size_t n)
+{
+        uint8_t b = 255;
+        for (; n >= 255; n -= 255) {
+                put(out, &b, 1);
+        }
+        b = (uint8_t)n;
+        put(out, &b, 1);
+}
+
+/********** put_sequence ********
+ *
+ * Appends one sequence: literals, then a match unless match is 0
+ *****************************/
+static void put_sequence(Output *out, const uint8_t *literals, size_t count,
+                         size_t match, size_t offset)
+{
+        size_t extra = match == 0 ? 0 : match - MIN_MATCH;
+        uint8_t token = (uint8_t)((count < 15 ? count : 15) << 4 |
+                                  (extra < 15 ? extra : 15));
+        put(out, &token, 1);
+        if (count >= 15) {
+                put_extra(out, count - 15);
+        }
+        put(out, literals, count);
+        if (match == 0) {
+                return;
+        }
+        uint8_t distance[2] = { (uint8_t)offset, (uint8_t)(offset >> 8) };
+        put(out, distance, 2);
+        if (extra >= 15) {
+                put_extra(out, extra - 15);
+        }
+}
+
+/********** lz_compress ********
+ *
+ * Compresses a buffer
+ *
+ * Parameters:
+ *      const uint8_t *src: bytes to compress
+ *      size_t length: number of bytes
+ *      uint8_t *dst: buffer for the compressed form
+ *      size_t capacity: size of dst
+ * Return:
+ *      size of the compressed form, or 0 if it did not fit in capacity
+ *
+ * Expects:
+ *      src and dst must not be NULL
+ * Notes:
+ *      Will CRE if src or dst is NULL
+ *****************************/
+extern size_t lz_compress(const uint8_t *src, size_t length,
+                          uint8_t *dst, size_t capacity)
+{
+        assert(src != NULL && dst != NULL);
+        uint32_t table[1 << HASH_BITS];
+        memset(table, 0, sizeof(table));
+        Output out = { dst, 0, capacity, false };
+
+        size_t anchor = 0;
+        size_t pos = 0;
+        while (pos + MIN_MATCH <= length && !out.full) {
+                uint32_t next = read32(src + pos);
+                unsigned slot = hash(next);
+                size_t candidate = table[slot];
+                table[slot] = (uint32_t)pos;
+
+                if (candidate >= pos || pos - candidate > MAX_OFFSET ||
+                    read32(src + candidate) != next) {
+                        pos++;
+                        continue;
+                }
+                size_t match = MIN_MATCH;
+                while (pos + match < length &&
+                       src[candidate + match] == src[pos + match]) {
+                        match++;
+                }
+                put_sequence(&out, src + anchor, pos - anchor, match,
+                             pos - candidate);
+                pos += match;
+                anchor = pos;
+        }
+        put_sequence(&out, src + anchor, length - anchor, 0, 0);
+        return out.full ? 0 : out.length;
+}
+
+/********** get_extra ********
+ *
+ * Reads the continuation bytes of a length
+ *****************************/
+static size_t get_extra(const uint8_t *src, size_t length, size_t *in)
+{
+        size_t n = 0;
+        uint8_t b;
+        do {
+                assert(*in < length);
+                b = src[(*in)++];
+                n += b;
+        } while (b == 255);
+        return n;
+}
+
+/********** lz_decompress ********
+ *
+ * Restores a buffer compressed by lz_compress
+ *
+ * Parameters:
+ *      const uint8_t *src: the compressed form
+ *      size_t length: size of the compressed form
+ *      uint8_t *dst: buffer for the original bytes
+ *      size_t expected: number of original bytes
+ * Return: None
+ *
+ * Expects:
+ *      src and dst must not be NULL; src must hold exactly expected bytes
+ *      as compressed by lz_compress
+ * Notes:
+ *      Will CRE if src or dst is NULL or the compressed form is corrupt
+ *****************************/
+extern void lz_decompress(const uint8_t *src, size_t length,
+                          uint8_t *dst, size_t expected)
+{
+        assert(src != NULL && dst != NULL);
+        size_t in = 0;
+        size_t out = 0;
+        while (in < length) {
+                uint8_t token = src[in++];
+                size_t count = token >> 4;
+                if (count == 15) {
+                        count += get_extra(src, length, &in);
+                }
+                assert(count <= length - in && count <= expected - out);
+                memcpy(dst + out, src + in, count);
+                in += count;
+                out += count;
+                if (in == length) {
+                        break;
+                }
+
+                assert(length - in >= 2);
+                size_t offset = src[in] | (size_t)src[in + 1] << 8;
+                in += 2;
+                size_t match = (token & 15) + MIN_MATCH;
+                if ((token & 15) == 15) {
+                        match += get_extra(src, length, &in);
+                }
+                assert(offset > 0 && offset <= out &&
+                       match <= expected - out);
+                if (offset >= match) {
+                        memcpy(dst + out, dst + out - offset, match);
+                } else {
+                        /* Overlapping copy repeats the last offset bytes */
+                        for (size_t i = 0; i < match; i++) {
+                                dst[out + i] = dst[out + i - offset];
+                        }
+                }
+                out += match;
+        }
+        assert(out == expected);
+}
@@ -0,0 +1,28 @@
+/**************************************************************
+ *
+ *                     lz.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     lz.h contains the interface of a small LZ77-style byte codec, used
+ *     to keep cold segments compressed in memory. It favors speed over
+ *     ratio and needs no memory beyond the caller's buffers and a table
+ *     on the stack.
+ *
+ **************************************************************/
+#ifndef LZ_INCLUDED
+#define LZ_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern size_t lz_compress(const uint8_t *src, size_t length,
+                          uint8_t *dst, size_t capacity);
+extern void lz_decompress(const uint8_t *src, size_t length,
+                          uint8_t *dst, size_t expected);
+
+#endif
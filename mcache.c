@@ -0,0 +1,301 @@
+/**************************************************************
+ *
+ *                     mcache.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     mcache.c contains the implementation of the mapping cache.
+ *     Mappings from MIN_BYTES to MAX_BYTES fall into size classes four to
+ *     an octave, so rounding a request up to its class wastes at most a
+ *     quarter of it. A released mapping is filed under the largest class
+ *     it can serve and keeps its contents: callers that need zeros clear
+ *     what they use, which costs no more than faulting in fresh pages and
+ *     saves the munmap, the mmap and the TLB shootdowns between them.
+ *
+ *     The cache of the calling thread is reached through a thread-local
+ *     variable and is only ever touched by that thread, so the fast path
+ *     takes no lock. A class that overflows moves a batch of BATCH
+ *     mappings to the global pool under one lock acquisition, and an
+ *     empty class refills a batch from it the same way, unless the pool's
+ *     lock-free byte count shows it is empty. A thread's cache is handed
+ *     to the global pool when the thread exits. Past THREAD_LIMIT and
+ *     GLOBAL_LIMIT bytes, mappings are unmapped.
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "mcache.h"
+
+#define PAGE_BYTES      ((size_t)4096)
+#define MIN_SHIFT       17                      /* 128 KiB */
+#define MAX_SHIFT       24                      /* 16 MiB */
+#define MIN_BYTES       ((size_t)1 << MIN_SHIFT)
+#define MAX_BYTES       ((size_t)1 << MAX_SHIFT)
+#define STEPS           4                       /* classes per octave */
+#define NUM_CLASSES     ((MAX_SHIFT - MIN_SHIFT) * STEPS + 1)
+#define BATCH           4                       /* mappings moved at once */
+#define CLASS_DEPTH     (2 * BATCH)             /* most kept per class */
+#define THREAD_LIMIT    ((size_t)64 << 20)      /* bytes cached per thread */
+#define GLOBAL_LIMIT    ((size_t)256 << 20)     /* bytes in the pool */
+
+/* Header written over the first bytes of a cached mapping */
+typedef struct Cached {
+        struct Cached  *next;
+        size_t          bytes;
+} Cached;
+
+/* Mappings of every class, with counts */
+typedef struct Shelf {
+        Cached         *lists[NUM_CLASSES];
+        unsigned        counts[NUM_CLASSES];
+        size_t          bytes;
+} Shelf;
+
+static _Thread_local Shelf local;           /* the calling thread's cache */
+static _Thread_local bool registered;       /* exit handler is set */
+
+static Shelf           global;              /* shared pool, by lock */
+static atomic_size_t   pooled;              /* global.bytes, lock-free */
+static pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t   exit_key;
+static pthread_once_t  key_once = PTHREAD_ONCE_INIT;
+
+/********** class_bytes ********
+ *
+ * Returns the size of a class
+ *****************************/
+static size_t class_bytes(unsigned class)
+{
+        size_t octave = MIN_BYTES << (class / STEPS);
+        return octave + octave / STEPS * (class % STEPS);
+}
+
+/********** class_above ********
+ *
+ * Returns the smallest class at least as big as a size
+ *
+ * Parameters:
+ *      size_t bytes: between MIN_BYTES and MAX_BYTES
+ *****************************/
+static unsigned class_above(size_t bytes)
+{
+        unsigned class = 0;
+        while (class_bytes(class) < bytes) {
+                class++;
+        }
+        return class;
+}
+
+/********** class_below ********
+ *
+ * Returns the largest class no bigger than a size
+ *
+ * Parameters:
+ *      size_t bytes: between MIN_BYTES and MAX_BYTES
+ *****************************/
+static unsigned class_below(size_t bytes)
+{
+        unsigned class = NUM_CLASSES - 1;
+        while (class_bytes(class) > bytes) {
+                class--;
+        }
+        return class;
+}
+
+/********** shelve ********
+ *
+ * Files a mapping under a class of a shelf
+ *****************************/
+static void shelve(Shelf *shelf, unsigned class, Cached *mapping)
+{
+        mapping->next = shelf->lists[class];
+        shelf->lists[class] = mapping;
+        shelf->counts[class]++;
+        shelf->bytes += mapping->bytes;
+}
+
+/********** unshelve ********
+ *
+ * Takes a mapping of a class off a shelf
+ *
+ * Return:
+ *      the mapping, or NULL if the class is empty
+ *****************************/
+static Cached *unshelve(Shelf *shelf, unsigned class)
+{
+        Cached *mapping = shelf->lists[class];
+        if (mapping != NULL) {
+                shelf->lists[class] = mapping->next;
+                shelf->counts[class]--;
+                shelf->bytes -= mapping->bytes;
+        }
+        return mapping;
+}
+
+/********** spill ********
+ *
+ * Moves up to count mappings of a class from the thread's cache to the
+ * global pool, unmapping those the pool has no room for
+ *****************************/
+static void spill(unsigned class, unsigned count)
+{
+        Cached *batch = NULL;
+        for (unsigned i = 0; i < count && local.lists[class] != NULL; i++) {
+                Cached *mapping = unshelve(&local, class);
+                mapping->next = batch;
+                batch = mapping;
+        }
+        pthread_mutex_lock(&global_lock);
+        while (batch != NULL && global.bytes + batch->bytes <= GLOBAL_LIMIT) {
+                Cached *next = batch->next;
+                shelve(&global, class, batch);
+                batch = next;
+        }
+        atomic_store(&pooled, global.bytes);
+        pthread_mutex_unlock(&global_lock);
+        while (batch != NULL) {
+                Cached *next = batch->next;
+                munmap(batch, batch->bytes);
+                batch = next;
+        }
+}
+
+/********** flush_thread ********
+ *
+ * Destructor of exit_key: hands an exiting thread's cache to the pool
+ *****************************/
+static void flush_thread(void *unused)
+{
+        (void)unused;
+        for (unsigned class = 0; class < NUM_CLASSES; class++) {
+                spill(class, local.counts[class]);
+        }
+}
+
+/********** make_key ********
+ *
+ * Creates exit_key; run once through pthread_once
+ *****************************/
+static void make_key(void)
+{
+        int failed = pthread_key_create(&exit_key, flush_thread);
+        assert(failed == 0);
+        (void)failed;
+}
+
+/********** mcache_round ********
+ *
+ * Returns the size to map for a request, so that the mapping can be
+ * cached and reused for requests of the same class
+ *
+ * Parameters:
+ *      size_t bytes: bytes needed
+ * Return:
+ *      the size of bytes' class, or bytes rounded up to whole pages if
+ *      mappings that size are not cached
+ *****************************/
+extern size_t mcache_round(size_t bytes)
+{
+        if (bytes < MIN_BYTES || bytes > MAX_BYTES) {
+                return (bytes + PAGE_BYTES - 1) & ~(PAGE_BYTES - 1);
+        }
+        return class_bytes(class_above(bytes));
+}
+
+/********** mcache_take ********
+ *
+ * Takes a cached mapping big enough for a request, from the thread's
+ * cache or, failing that, with a batch from the global pool
+ *
+ * Parameters:
+ *      size_t bytes: bytes needed
+ *      size_t *mapped: set to the size of the returned mapping
+ * Return:
+ *      a page-aligned mapping of unspecified contents, or NULL if none is
+ *      cached
+ *
+ * Expects:
+ *      mapped must not be NULL
+ * Notes:
+ *      Will CRE if mapped is NULL
+ *****************************/
+extern void *mcache_take(size_t bytes, size_t *mapped)
+{
+        assert(mapped != NULL);
+        if (bytes < MIN_BYTES || bytes > MAX_BYTES) {
+                return NULL;
+        }
+        unsigned class = class_above(bytes);
+        Cached *mapping = unshelve(&local, class);
+        if (mapping == NULL && atomic_load(&pooled) != 0) {
+                pthread_mutex_lock(&global_lock);
+                for (unsigned i = 0; i < BATCH; i++) {
+                        Cached *next = unshelve(&global, class);
+                        if (next == NULL) {
+                                break;
+                        }
+                        shelve(&local, class, next);
+                }
+                atomic_store(&pooled, global.bytes);
+                pthread_mutex_unlock(&global_lock);
+                mapping = unshelve(&local, class);
+        }
+        if (mapping == NULL) {
+                return NULL;
+        }
+        *mapped = mapping->bytes;
+        return mapping;
+}
+
+/********** mcache_give ********
+ *
+ * Caches a mapping that is no longer used, or unmaps it if it is outside
+ * the cached sizes or the caches are full
+ *
+ * Parameters:
+ *      void *pages: start of an anonymous mapping
+ *      size_t bytes: its size
+ * Return: None
+ *
+ * Expects:
+ *      pages must not be NULL and must start a private anonymous mapping
+ *      of bytes bytes, with no huge page advice
+ * Notes:
+ *      Will CRE if pages is NULL
+ *****************************/
+extern void mcache_give(void *pages, size_t bytes)
+{
+        assert(pages != NULL);
+        if (bytes < MIN_BYTES || bytes > MAX_BYTES) {
+                munmap(pages, bytes);
+                return;
+        }
+        if (!registered) {
+                pthread_once(&key_once, make_key);
+                pthread_setspecific(exit_key, &local);
+                registered = true;
+        }
+
+        unsigned class = class_below(bytes);
+        Cached *mapping = pages;
+        mapping->bytes = bytes;
+        shelve(&local, class, mapping);
+        if (local.counts[class] > CLASS_DEPTH) {
+                spill(class, BATCH);
+        }
+        while (local.bytes > THREAD_LIMIT) {
+                unsigned biggest = NUM_CLASSES - 1;
+                while (local.counts[biggest] == 0) {
+                        biggest--;
+                }
+                spill(biggest, 1);
+        }
+}
@@ -0,0 +1,28 @@
+/**************************************************************
+ *
+ *                     mcache.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     mcache.h contains the interface of the mapping cache. Arenas give
+ *     it the anonymous mappings they release instead of unmapping them,
+ *     and take mappings from it before asking the kernel for new ones.
+ *     Each thread keeps a cache of its own, so a process running many UMs
+ *     on many threads reuses memory without contending for a lock or for
+ *     the kernel's mapping lock.
+ *
+ **************************************************************/
+#ifndef MCACHE_INCLUDED
+#define MCACHE_INCLUDED
+
+#include <stddef.h>
+
+extern size_t mcache_round(size_t bytes);
+extern void *mcache_take(size_t bytes, size_t *mapped);
+extern void mcache_give(void *pages, size_t bytes);
+
+#endif
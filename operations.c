@@ -149,27 +149,28 @@ extern void um_nand(uint32_t* ra, uint32_t* rb, uint32_t* rc)
 
 /********** um_output ********
  *
- * Writes the value in register c to standard output as an ASCII character. 
- * Includes error-handling for out of range values.
+ * Writes the value in register c to the output stream as an ASCII 
+ * character. Includes error-handling for out of range values.
  *
  * Parameters:
+ *      FILE* fp: the UM's output stream
  *      uint32_t* rc: pointer to the register whose value will be written
  * 
  * Return: None
  *
  * Expects
- *      rc must not be NULL
+ *      fp and rc must not be NULL
  *      rc must be less than or equal to 255
  * Notes:
- *      Will CRE if rc is NULL.
+ *      Will CRE if fp or rc is NULL.
  *      Will CRE if the value in rc evaluates to an integer greater than 255. 
  ************************/
-extern void um_output(uint32_t* rc)
+extern void um_output(FILE* fp, uint32_t* rc)
 {
-        assert(rc != NULL);
+        assert(fp != NULL && rc != NULL);
         unsigned int val = *rc;
         assert(val <= 255);
-        putc(val, stdout);
+        putc(val, fp);
 }
 
 /********** um_input ********
@@ -177,6 +178,7 @@ extern void um_output(uint32_t* rc)
  * Loads register c with input given via the IO device 
  *
  * Parameters:
+ *      FILE* fp: the UM's input stream
  *      uint32_t* rc: pointer to the register whose value will be written
  * 
  * Return: None
@@ -193,10 +195,10 @@ extern void um_input(FILE* fp, uint32_t* rc)
 {
         assert(fp != NULL && rc != NULL);
         int curr_val = fgetc(fp);
-        assert(curr_val >= 0 && curr_val <= 255);
         if (curr_val == EOF) {
                 *rc = ~0;
         } else {
+                assert(curr_val >= 0 && curr_val <= 255);
                 *rc = curr_val;
         }
 }
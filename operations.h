@@ -27,7 +27,7 @@ extern void um_divide(uint32_t* ra, uint32_t* rb, uint32_t* rc);
 
 extern void um_nand(uint32_t* ra, uint32_t* rb, uint32_t* rc);
 
-extern void um_output(uint32_t* rc);
+extern void um_output(FILE* fp, uint32_t* rc);
 
 extern void um_input(FILE* fp, uint32_t* rc);
 
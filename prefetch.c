@@ -0,0 +1,315 @@
+/**************************************************************
+ *
+ *                     prefetch.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     prefetch.c contains the implementation of the input prefetcher. It
+ *     is the mirror image of writer.c: the reader thread owns head and
+ *     reads straight into the free part of the ring, the consumer owns
+ *     tail, and either side sleeps only after announcing it and checking
+ *     the ring once more. End of input is a flag the reader sets after its
+ *     last head update, so the consumer reports EOF only once the ring is
+ *     empty. A full ring puts the reader to sleep until half of it is
+ *     free, so that it goes back to large reads rather than being woken
+ *     for every byte taken.
+ *
+ *     The reader waits for input in poll rather than read, together with
+ *     an eventfd, so that prefetch_free can stop it while the descriptor
+ *     is idle.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <mem.h>
+#include "prefetch.h"
+
+#define MIN_BYTES       4096
+
+/********** struct Prefetch_T ********
+ *
+ * atomic_size_t head: bytes ever read, stored by the reader thread
+ * atomic_size_t tail: bytes ever taken, stored by the consumer
+ * size_t mask: ring size minus one
+ * uint8_t *ring: the buffer
+ * int fd: descriptor read from
+ * int stop: eventfd written by prefetch_free
+ * atomic_bool reader_sleeping: the reader is waiting for space
+ * atomic_bool consumer_sleeping: the consumer is waiting for bytes
+ * atomic_bool eof: the reader has reached end of input or an error
+ * atomic_bool closing: prefetch_free wants the reader to finish
+ * pthread_mutex_t lock: taken to sleep on or signal the conditions
+ * pthread_cond_t filled: signaled when head moves or eof is set
+ * pthread_cond_t drained: signaled when tail moves or closing is set
+ * pthread_t thread: the reader thread
+ *
+ *****************************/
+struct Prefetch_T {
+        atomic_size_t   head;
+        atomic_size_t   tail;
+        size_t          mask;
+        uint8_t        *ring;
+        int             fd;
+        int             stop;
+        atomic_bool     reader_sleeping;
+        atomic_bool     consumer_sleeping;
+        atomic_bool     eof;
+        atomic_bool     closing;
+        pthread_mutex_t lock;
+        pthread_cond_t  filled;
+        pthread_cond_t  drained;
+        pthread_t       thread;
+};
+
+/********** signal_under ********
+ *
+ * Signals a condition with the lock held, so the sleeper cannot miss it
+ *****************************/
+static void signal_under(Prefetch_T prefetch, pthread_cond_t *cond)
+{
+        pthread_mutex_lock(&prefetch->lock);
+        pthread_cond_signal(cond);
+        pthread_mutex_unlock(&prefetch->lock);
+}
+
+/********** wait_space ********
+ *
+ * Sleeps the reader until at most half of the ring is in use, or closing
+ *
+ * Return:
+ *      false if prefetch_free is stopping the reader
+ *****************************/
+static bool wait_space(Prefetch_T prefetch, size_t head)
+{
+        pthread_mutex_lock(&prefetch->lock);
+        atomic_store(&prefetch->reader_sleeping, true);
+        while (head - atomic_load(&prefetch->tail) > prefetch->mask / 2 &&
+               !atomic_load(&prefetch->closing)) {
+                pthread_cond_wait(&prefetch->drained, &prefetch->lock);
+        }
+        atomic_store(&prefetch->reader_sleeping, false);
+        pthread_mutex_unlock(&prefetch->lock);
+        return !atomic_load(&prefetch->closing);
+}
+
+/********** fill ********
+ *
+ * Body of the reader thread: reads into the free part of the ring until
+ * end of input, an error, or prefetch_free
+ *****************************/
+static void *fill(void *cl)
+{
+        Prefetch_T prefetch = cl;
+        size_t head = atomic_load(&prefetch->head);
+        for (;;) {
+                size_t used = head - atomic_load(&prefetch->tail);
+                if (used > prefetch->mask) {
+                        if (!wait_space(prefetch, head)) {
+                                return NULL;
+                        }
+                        continue;
+                }
+
+                struct pollfd fds[2] = {
+                        { prefetch->fd, POLLIN, 0 },
+                        { prefetch->stop, POLLIN, 0 }
+                };
+                if (poll(fds, 2, -1) < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (fds[1].revents != 0) {
+                        return NULL;
+                }
+
+                size_t start = head & prefetch->mask;
+                size_t room = prefetch->mask + 1 - used;
+                if (room > prefetch->mask + 1 - start) {
+                        room = prefetch->mask + 1 - start;
+                }
+                ssize_t got = read(prefetch->fd, prefetch->ring + start,
+                                   room);
+                if (got < 0 && (errno == EINTR || errno == EAGAIN)) {
+                        continue;
+                }
+                if (got <= 0) {
+                        atomic_store(&prefetch->eof, true);
+                } else {
+                        head += (size_t)got;
+                        atomic_store(&prefetch->head, head);
+                }
+                if (atomic_load(&prefetch->consumer_sleeping)) {
+                        signal_under(prefetch, &prefetch->filled);
+                }
+                if (got <= 0) {
+                        return NULL;
+                }
+        }
+}
+
+/********** prefetch_new ********
+ *
+ * Starts a reader thread filling a new ring from a descriptor
+ *
+ * Parameters:
+ *      int fd: descriptor to read; it stays owned by the caller, and
+ *              nothing else may read it until prefetch_free
+ *      size_t bytes: ring size, rounded up to a power of two of at least
+ *                    4096
+ * Return:
+ *      the prefetcher
+ *
+ * Notes:
+ *      Will CRE if allocation fails or the thread cannot be started
+ *****************************/
+extern Prefetch_T prefetch_new(int fd, size_t bytes)
+{
+        size_t size = MIN_BYTES;
+        while (size < bytes && size <= (SIZE_MAX >> 1)) {
+                size <<= 1;
+        }
+        Prefetch_T prefetch = CALLOC(1, sizeof(struct Prefetch_T));
+        assert(prefetch != NULL);
+        prefetch->ring = ALLOC(size);
+        assert(prefetch->ring != NULL);
+        prefetch->mask = size - 1;
+        prefetch->fd = fd;
+        prefetch->stop = eventfd(0, EFD_CLOEXEC);
+        assert(prefetch->stop >= 0);
+        atomic_init(&prefetch->head, 0);
+        atomic_init(&prefetch->tail, 0);
+        atomic_init(&prefetch->reader_sleeping, false);
+        atomic_init(&prefetch->consumer_sleeping, false);
+        atomic_init(&prefetch->eof, false);
+        atomic_init(&prefetch->closing, false);
+        pthread_mutex_init(&prefetch->lock, NULL);
+        pthread_cond_init(&prefetch->filled, NULL);
+        pthread_cond_init(&prefetch->drained, NULL);
+        int failed = pthread_create(&prefetch->thread, NULL, fill,
+                                    prefetch);
+        assert(failed == 0);
+        (void)failed;
+        return prefetch;
+}
+
+/********** wait_bytes ********
+ *
+ * Sleeps the consumer until the reader has moved head past tail or
+ * reached end of input
+ *****************************/
+static void wait_bytes(Prefetch_T prefetch, size_t tail)
+{
+        pthread_mutex_lock(&prefetch->lock);
+        atomic_store(&prefetch->consumer_sleeping, true);
+        while (atomic_load(&prefetch->head) == tail &&
+               !atomic_load(&prefetch->eof)) {
+                pthread_cond_wait(&prefetch->filled, &prefetch->lock);
+        }
+        atomic_store(&prefetch->consumer_sleeping, false);
+        pthread_mutex_unlock(&prefetch->lock);
+}
+
+/********** prefetch_get ********
+ *
+ * Takes the next byte of input, waiting for the reader if none is
+ * buffered
+ *
+ * Parameters:
+ *      Prefetch_T prefetch: the prefetcher
+ * Return:
+ *      the byte, or -1 at end of input or after a read error
+ *
+ * Expects:
+ *      prefetch must not be NULL, and only one thread may take from it
+ * Notes:
+ *      Will CRE if prefetch is NULL
+ *****************************/
+extern int prefetch_get(Prefetch_T prefetch)
+{
+        assert(prefetch != NULL);
+        size_t tail = atomic_load_explicit(&prefetch->tail,
+                                           memory_order_relaxed);
+        if (atomic_load_explicit(&prefetch->head, 
+                                 memory_order_acquire) == tail) {
+                wait_bytes(prefetch, tail);
+                if (atomic_load(&prefetch->head) == tail) {
+                        return -1;
+                }
+        }
+        int byte = prefetch->ring[tail & prefetch->mask];
+        atomic_store(&prefetch->tail, tail + 1);
+        if (atomic_load(&prefetch->reader_sleeping) &&
+            atomic_load(&prefetch->head) - (tail + 1) <= prefetch->mask / 2) {
+                signal_under(prefetch, &prefetch->drained);
+        }
+        return byte;
+}
+
+/********** prefetch_ready ********
+ *
+ * Tells whether prefetch_get would return without waiting
+ *
+ * Parameters:
+ *      Prefetch_T prefetch: the prefetcher
+ * Return:
+ *      true if a byte is buffered or input has ended
+ *
+ * Expects:
+ *      prefetch must not be NULL, and must be called by the consumer
+ * Notes:
+ *      Will CRE if prefetch is NULL
+ *****************************/
+extern bool prefetch_ready(Prefetch_T prefetch)
+{
+        assert(prefetch != NULL);
+        return atomic_load(&prefetch->head) != 
+               atomic_load_explicit(&prefetch->tail, memory_order_relaxed) ||
+               atomic_load(&prefetch->eof);
+}
+
+/********** prefetch_free ********
+ *
+ * Stops the reader thread, frees the prefetcher and sets it to NULL.
+ * Input read ahead and not taken is lost.
+ *
+ * Parameters:
+ *      Prefetch_T *prefetch: the prefetcher
+ * Return: None
+ *
+ * Expects:
+ *      prefetch and *prefetch must not be NULL
+ * Notes:
+ *      Will CRE if prefetch or *prefetch is NULL
+ *      The descriptor is left open
+ *****************************/
+extern void prefetch_free(Prefetch_T *prefetch)
+{
+        assert(prefetch != NULL && *prefetch != NULL);
+        Prefetch_T p = *prefetch;
+        uint64_t one = 1;
+        ssize_t ignored = write(p->stop, &one, sizeof(one));
+        (void)ignored;
+        pthread_mutex_lock(&p->lock);
+        atomic_store(&p->closing, true);
+        pthread_cond_signal(&p->drained);
+        pthread_mutex_unlock(&p->lock);
+        pthread_join(p->thread, NULL);
+        close(p->stop);
+        pthread_mutex_destroy(&p->lock);
+        pthread_cond_destroy(&p->filled);
+        pthread_cond_destroy(&p->drained);
+        free(p->ring);
+        free(p);
+        *prefetch = NULL;
+}
@@ -0,0 +1,30 @@
+/**************************************************************
+ *
+ *                     prefetch.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     prefetch.h contains the interface of an input prefetcher. A reader
+ *     thread keeps a ring buffer filled ahead of one consumer with large
+ *     reads from a file descriptor, so that taking a byte is a memory read
+ *     whenever input has already arrived.
+ *
+ **************************************************************/
+#ifndef PREFETCH_INCLUDED
+#define PREFETCH_INCLUDED
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct Prefetch_T *Prefetch_T;
+
+extern Prefetch_T prefetch_new(int fd, size_t bytes);
+extern int prefetch_get(Prefetch_T prefetch);
+extern bool prefetch_ready(Prefetch_T prefetch);
+extern void prefetch_free(Prefetch_T *prefetch);
+
+#endif
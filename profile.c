@@ -0,0 +1,533 @@
+/**************************************************************
+ *
+ *                     profile.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     profile.c contains the implementation of the call-graph profiler.
+ *     Counts are kept in a calling context tree: one node per distinct
+ *     chain of calls from the entry, found through a hash table keyed by
+ *     parent node and callee, so a call or return costs a few compares
+ *     and a lookup. The shadow stack holds the node and return address of
+ *     every call in progress. Only the few frames nearest its top are
+ *     searched for a return, so a jump that is neither call nor return
+ *     costs the same however deep the stack is; a function left without
+ *     returning is popped when one of its callers returns.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <mem.h>
+#include "profile.h"
+
+/* Deepest shadow stack; deeper calls are charged to their caller */
+#define MAX_DEPTH       4096
+
+/* Frames nearest the top of the stack searched for a return */
+#define RETURN_SEARCH   16
+
+/* Functions listed by profile_print */
+#define HOTTEST         30
+
+/* Opcode of load value, which loads a call's target */
+#define ORTHO_OPCODE    13
+
+/* The node of the entry, which has no callee address */
+#define ROOT            0
+
+/********** Node ********
+ *
+ * uint32_t function: address of the callee, or 0 for the entry
+ * uint32_t parent: index of the caller's node
+ * bool recursive: function also appears further up the chain
+ * uint64_t self: instructions executed in function on this chain
+ * uint64_t calls: times this chain was called
+ *
+ *****************************/
+typedef struct Node {
+        uint32_t        function;
+        uint32_t        parent;
+        bool            recursive;
+        uint64_t        self;
+        uint64_t        calls;
+} Node;
+
+/* A call in progress */
+typedef struct Frame {
+        uint32_t        node;
+        uint32_t        return_address;
+} Frame;
+
+/* Totals of one function, for profile_print */
+typedef struct Function {
+        uint32_t        address;
+        uint64_t        inclusive;
+        uint64_t        exclusive;
+        uint64_t        calls;
+} Function;
+
+/********** struct Profile_T ********
+ *
+ * Node *nodes: the calling context tree, each node after its parent
+ * uint32_t node_count, node_cap: nodes used and allocated
+ * uint32_t *children: hash table of node indices by parent and function,
+ *                     0 for an empty slot
+ * uint32_t child_mask: slots in children less one, a power of two less one
+ * Frame *stack: the shadow stack, with the entry at the bottom
+ * uint32_t depth: frames on the stack
+ * uint32_t last_store: value of the last segmented store since the last
+ *                      jump, if stored
+ * bool stored: whether the block ending at the next jump stored a word
+ * uint32_t registers[8]: the registers at the last jump
+ * bool started: whether last holds an instruction count yet
+ * uint64_t last: instruction count already charged
+ *
+ *****************************/
+struct Profile_T {
+        Node           *nodes;
+        uint32_t        node_count;
+        uint32_t        node_cap;
+        uint32_t       *children;
+        uint32_t        child_mask;
+        Frame          *stack;
+        uint32_t        depth;
+        uint32_t        last_store;
+        bool            stored;
+        uint32_t        registers[8];
+        bool            started;
+        uint64_t        last;
+};
+
+/********** hash_child ********
+ *
+ * Returns the first slot of the children table to probe for the node of
+ * function called from parent
+ *****************************/
+static uint32_t hash_child(Profile_T profile, uint32_t parent,
+                           uint32_t function)
+{
+        uint64_t key = (uint64_t)parent << 32 | function;
+        return (uint32_t)(key * 0x9e3779b97f4a7c15ull >> 32) &
+               profile->child_mask;
+}
+
+/********** grow_children ********
+ *
+ * Doubles the children table and rehashes every node but the root
+ *****************************/
+static void grow_children(Profile_T profile)
+{
+        free(profile->children);
+        profile->child_mask = profile->child_mask * 2 + 1;
+        profile->children = CALLOC((size_t)profile->child_mask + 1,
+                                   sizeof(uint32_t));
+        assert(profile->children != NULL);
+        for (uint32_t i = 1; i < profile->node_count; i++) {
+                Node *node = &profile->nodes[i];
+                uint32_t slot = hash_child(profile, node->parent,
+                                           node->function);
+                while (profile->children[slot] != 0) {
+                        slot = (slot + 1) & profile->child_mask;
+                }
+                profile->children[slot] = i;
+        }
+}
+
+/********** find_child ********
+ *
+ * Returns the node of function called from parent, adding it if this is
+ * the first such call
+ *****************************/
+static uint32_t find_child(Profile_T profile, uint32_t parent,
+                           uint32_t function)
+{
+        uint32_t slot = hash_child(profile, parent, function);
+        for (uint32_t i; (i = profile->children[slot]) != 0;
+             slot = (slot + 1) & profile->child_mask) {
+                Node *node = &profile->nodes[i];
+                if (node->parent == parent && node->function == function) {
+                        return i;
+                }
+        }
+
+        if (profile->node_count == profile->node_cap) {
+                profile->node_cap *= 2;
+                profile->nodes = realloc(profile->nodes, profile->node_cap *
+                                         sizeof(Node));
+                assert(profile->nodes != NULL);
+        }
+        uint32_t index = profile->node_count++;
+        Node *node = &profile->nodes[index];
+        node->function = function;
+        node->parent = parent;
+        node->recursive = false;
+        node->self = 0;
+        node->calls = 0;
+        for (uint32_t up = parent; up != ROOT;
+             up = profile->nodes[up].parent) {
+                if (profile->nodes[up].function == function) {
+                        node->recursive = true;
+                        break;
+                }
+        }
+        profile->children[slot] = index;
+        if (profile->node_count * 2 > profile->child_mask) {
+                grow_children(profile);
+        }
+        return index;
+}
+
+/********** profile_new ********
+ *
+ * Creates an empty profile with only the entry on its shadow stack
+ *
+ * Parameters: None
+ * Return:
+ *      the profile, to pass to profile_jump and profile_charge
+ *
+ * Notes:
+ *      Will CRE if allocation fails
+ *****************************/
+extern Profile_T profile_new(void)
+{
+        Profile_T profile = ALLOC(sizeof(struct Profile_T));
+        assert(profile != NULL);
+        profile->node_cap = 1024;
+        profile->nodes = ALLOC(profile->node_cap * sizeof(Node));
+        assert(profile->nodes != NULL);
+        profile->node_count = 1;
+        memset(&profile->nodes[ROOT], 0, sizeof(Node));
+        profile->nodes[ROOT].calls = 1;
+        profile->child_mask = 2047;
+        profile->children = CALLOC((size_t)profile->child_mask + 1,
+                                   sizeof(uint32_t));
+        assert(profile->children != NULL);
+        profile->stack = ALLOC(MAX_DEPTH * sizeof(Frame));
+        assert(profile->stack != NULL);
+        profile->stack[0].node = ROOT;
+        profile->stack[0].return_address = 0;
+        profile->depth = 1;
+        profile->stored = false;
+        memset(profile->registers, 0, sizeof(profile->registers));
+        profile->started = false;
+        profile->last = 0;
+        return profile;
+}
+
+/********** profile_store ********
+ *
+ * Notes a value the UM stored to a segment, which may be the return
+ * address of a call
+ *
+ * Parameters:
+ *      Profile_T profile: the profile
+ *      uint32_t value: the word stored
+ * Return: None
+ *
+ * Expects:
+ *      profile must not be NULL
+ * Notes:
+ *      Will CRE if profile is NULL
+ *****************************/
+extern void profile_store(Profile_T profile, uint32_t value)
+{
+        assert(profile != NULL);
+        profile->last_store = value;
+        profile->stored = true;
+}
+
+/********** profile_charge ********
+ *
+ * Charges the instructions executed since the last charge to the
+ * function on top of the shadow stack
+ *
+ * Parameters:
+ *      Profile_T profile: the profile
+ *      uint64_t count: instructions the UM has executed in all
+ * Return: None
+ *
+ * Expects:
+ *      profile must not be NULL
+ * Notes:
+ *      Will CRE if profile is NULL
+ *      The first charge only notes the count, so a profile can start on
+ *      a UM that has already run
+ *****************************/
+extern void profile_charge(Profile_T profile, uint64_t count)
+{
+        assert(profile != NULL);
+        if (profile->started) {
+                Frame *top = &profile->stack[profile->depth - 1];
+                profile->nodes[top->node].self += count - profile->last;
+        }
+        profile->started = true;
+        profile->last = count;
+}
+
+/********** profile_jump ********
+ *
+ * Follows a load program: pops the shadow stack if the jump returns to a
+ * call in progress, and pushes a call if it leaves a return address, the
+ * pc after the jump, in a register or the word it last stored
+ *
+ * Parameters:
+ *      Profile_T profile: the profile
+ *      uint32_t site: pc of the load program
+ *      uint32_t target: pc it jumps to
+ *      uint32_t previous: the instruction before it, or ~0 if none
+ *      bool reload: whether it replaced segment 0
+ *      const uint32_t *registers: the eight registers at the jump
+ *      uint64_t count: instructions the UM has executed, including the
+ *                      load program
+ * Return: None
+ *
+ * Expects:
+ *      profile and registers must not be NULL
+ * Notes:
+ *      Will CRE if profile or registers is NULL
+ *      Replacing segment 0 starts a new program, so the stack is cut
+ *      back to the entry
+ *      A jump with no return address, such as a tail call or a branch, is
+ *      charged to the function it leaves
+ *****************************/
+extern void profile_jump(Profile_T profile, uint32_t site, uint32_t target,
+                         uint32_t previous, bool reload,
+                         const uint32_t *registers, uint64_t count)
+{
+        assert(profile != NULL && registers != NULL);
+        profile_charge(profile, count);
+        bool stored = profile->stored;
+        profile->stored = false;
+        if (reload) {
+                memcpy(profile->registers, registers,
+                       sizeof(profile->registers));
+                profile->depth = 1;
+                return;
+        }
+
+        uint32_t bottom = profile->depth > RETURN_SEARCH
+                          ? profile->depth - RETURN_SEARCH : 1;
+        for (uint32_t i = profile->depth; i > bottom; i--) {
+                if (profile->stack[i - 1].return_address == target) {
+                        memcpy(profile->registers, registers,
+                               sizeof(profile->registers));
+                        profile->depth = i - 1;
+                        return;
+                }
+        }
+
+        /* A call jumps to a constant loaded just before it, which rules
+           out jump tables, often placed right after the jump, and leaves
+           its return address in a register it set or the word it stored
+           since the previous jump. A register left over from an earlier
+           block is often a branch's other target, not a return address */
+        uint32_t return_address = site + 1;
+        bool call = false;
+        if (previous >> 28 == ORTHO_OPCODE &&
+            (previous & 0x1ffffff) == target) {
+                call = stored && profile->last_store == return_address;
+                for (int r = 0; r < 8 && !call; r++) {
+                        call = registers[r] == return_address &&
+                               profile->registers[r] != return_address;
+                }
+        }
+        memcpy(profile->registers, registers, sizeof(profile->registers));
+        if (!call || target == return_address ||
+            profile->depth == MAX_DEPTH) {
+                return;
+        }
+        uint32_t caller = profile->stack[profile->depth - 1].node;
+        uint32_t node = find_child(profile, caller, target);
+        profile->nodes[node].calls++;
+        profile->stack[profile->depth].node = node;
+        profile->stack[profile->depth].return_address = return_address;
+        profile->depth++;
+}
+
+/********** put_name ********
+ *
+ * Writes the name of a node's function: "entry" or its address in hex
+ *****************************/
+static void put_name(Node *node, bool root, FILE *fp)
+{
+        if (root) {
+                fputs("entry", fp);
+        } else {
+                fprintf(fp, "0x%08x", node->function);
+        }
+}
+
+/********** profile_write ********
+ *
+ * Writes the profile as folded stacks: for each chain of calls that
+ * executed instructions itself, its functions from the entry down,
+ * separated by semicolons, then a space and the instruction count
+ *
+ * Parameters:
+ *      Profile_T profile: the profile
+ *      FILE *fp: stream to write to
+ * Return:
+ *      false if a write failed
+ *
+ * Expects:
+ *      profile and fp must not be NULL
+ * Notes:
+ *      Will CRE if profile or fp is NULL
+ *      speedscope and flamegraph.pl read the format directly, and pprof
+ *      through its folded-stack converters
+ *****************************/
+extern bool profile_write(Profile_T profile, FILE *fp)
+{
+        assert(profile != NULL && fp != NULL);
+        uint32_t *chain = CALLOC(MAX_DEPTH, sizeof(uint32_t));
+        assert(chain != NULL);
+        for (uint32_t i = 0; i < profile->node_count; i++) {
+                if (profile->nodes[i].self == 0) {
+                        continue;
+                }
+                uint32_t length = 0;
+                for (uint32_t up = i; up != ROOT;
+                     up = profile->nodes[up].parent) {
+                        chain[length++] = up;
+                }
+                put_name(&profile->nodes[ROOT], true, fp);
+                while (length > 0) {
+                        fputc(';', fp);
+                        put_name(&profile->nodes[chain[--length]], false,
+                                 fp);
+                }
+                fprintf(fp, " %llu\n",
+                        (unsigned long long)profile->nodes[i].self);
+        }
+        free(chain);
+        return !ferror(fp);
+}
+
+/********** compare_inclusive ********
+ *
+ * Orders functions by decreasing inclusive count, then address
+ *****************************/
+static int compare_inclusive(const void *x, const void *y)
+{
+        const Function *a = x, *b = y;
+        if (a->inclusive != b->inclusive) {
+                return a->inclusive < b->inclusive ? 1 : -1;
+        }
+        return a->address < b->address ? -1 : a->address > b->address;
+}
+
+/********** compare_address ********
+ *
+ * Orders functions by address
+ *****************************/
+static int compare_address(const void *x, const void *y)
+{
+        const Function *a = x, *b = y;
+        return a->address < b->address ? -1 : a->address > b->address;
+}
+
+/********** profile_print ********
+ *
+ * Writes the functions that executed the most instructions, with their
+ * inclusive and exclusive counts and the calls made to them
+ *
+ * Parameters:
+ *      Profile_T profile: the profile
+ *      FILE *fp: stream to write to
+ * Return: None
+ *
+ * Expects:
+ *      profile and fp must not be NULL
+ * Notes:
+ *      Will CRE if profile or fp is NULL
+ *      A recursive function's inclusive count includes its recursion
+ *      once, not once per level
+ *****************************/
+extern void profile_print(Profile_T profile, FILE *fp)
+{
+        assert(profile != NULL && fp != NULL);
+        uint32_t count = profile->node_count;
+        uint64_t *total = CALLOC(count, sizeof(uint64_t));
+        assert(total != NULL);
+        for (uint32_t i = count; i-- > 0; ) {
+                total[i] += profile->nodes[i].self;
+                if (i != ROOT) {
+                        total[profile->nodes[i].parent] += total[i];
+                }
+        }
+
+        /* One entry per node, sorted so that each function's are adjacent
+           and summed into the first */
+        Function *functions = CALLOC(count, sizeof(Function));
+        assert(functions != NULL);
+        for (uint32_t i = 1; i < count; i++) {
+                Node *node = &profile->nodes[i];
+                functions[i - 1].address = node->function;
+                functions[i - 1].exclusive = node->self;
+                functions[i - 1].calls = node->calls;
+                functions[i - 1].inclusive = node->recursive ? 0 : total[i];
+        }
+        qsort(functions, count - 1, sizeof(Function), compare_address);
+        uint32_t function_count = 0;
+        for (uint32_t i = 0; i + 1 < count; i++) {
+                Function *last = function_count > 0
+                                 ? &functions[function_count - 1] : NULL;
+                if (last != NULL && last->address == functions[i].address) {
+                        last->inclusive += functions[i].inclusive;
+                        last->exclusive += functions[i].exclusive;
+                        last->calls += functions[i].calls;
+                } else {
+                        functions[function_count++] = functions[i];
+                }
+        }
+        qsort(functions, function_count, sizeof(Function),
+              compare_inclusive);
+
+        uint64_t all = total[ROOT] == 0 ? 1 : total[ROOT];
+        fprintf(fp, "%llu instructions, %u functions, %u call chains; "
+                "entry itself %llu\n", (unsigned long long)total[ROOT],
+                function_count, count - 1,
+                (unsigned long long)profile->nodes[ROOT].self);
+        fprintf(fp, "function       inclusive  percent      exclusive  "
+                "percent        calls\n");
+        for (uint32_t i = 0; i < function_count && i < HOTTEST; i++) {
+                Function *function = &functions[i];
+                fprintf(fp, "0x%08x %13llu  %6.2f%% %14llu  %6.2f%% %12llu\n",
+                        function->address,
+                        (unsigned long long)function->inclusive,
+                        100.0 * function->inclusive / all,
+                        (unsigned long long)function->exclusive,
+                        100.0 * function->exclusive / all,
+                        (unsigned long long)function->calls);
+        }
+        free(functions);
+        free(total);
+}
+
+/********** profile_free ********
+ *
+ * Frees a profile and sets the caller's handle to NULL
+ *
+ * Parameters:
+ *      Profile_T *profile: pointer to the profile to free
+ * Return: None
+ *
+ * Expects:
+ *      profile and *profile must not be NULL
+ * Notes:
+ *      Will CRE if profile or *profile is NULL
+ *****************************/
+extern void profile_free(Profile_T *profile)
+{
+        assert(profile != NULL && *profile != NULL);
+        free((*profile)->nodes);
+        free((*profile)->children);
+        free((*profile)->stack);
+        free(*profile);
+        *profile = NULL;
+}
@@ -0,0 +1,42 @@
+/**************************************************************
+ *
+ *                     profile.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     profile.h contains the interface of the call-graph profiler. The UM
+ *     has no call instruction, so the profiler infers calls from the code
+ *     compilers emit for them: a load program into segment 0 made while a
+ *     register, or the word just stored, holds the address after the jump
+ *     is a call of its target, and a later jump to that return address
+ *     returns from it. A shadow stack of the calls in progress charges
+ *     every instruction to the chain of functions it ran in, which is
+ *     written as folded stacks (one line per chain, its functions
+ *     separated by semicolons and followed by its instruction count) for
+ *     flame graph tools such as speedscope, or summed per function.
+ *
+ **************************************************************/
+#ifndef PROFILE_INCLUDED
+#define PROFILE_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct Profile_T *Profile_T;
+
+extern Profile_T profile_new(void);
+extern void profile_store(Profile_T profile, uint32_t value);
+extern void profile_jump(Profile_T profile, uint32_t site, uint32_t target,
+                         uint32_t previous, bool reload,
+                         const uint32_t *registers, uint64_t count);
+extern void profile_charge(Profile_T profile, uint64_t count);
+extern bool profile_write(Profile_T profile, FILE *fp);
+extern void profile_print(Profile_T profile, FILE *fp);
+extern void profile_free(Profile_T *profile);
+
+#endif
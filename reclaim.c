@@ -0,0 +1,209 @@
+/**************************************************************
+ *
+ *                     reclaim.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     reclaim.c contains the implementation of the reclamation thread.
+ *     Interpreter threads push released mappings onto a lock-free stack
+ *     whose nodes live in the mappings themselves, then post a semaphore.
+ *     The reclamation thread takes the whole stack with one exchange, so
+ *     there is no ABA problem, and releases each mapping off the
+ *     interpreter thread. While the pool holds less than POOL_LIMIT bytes,
+ *     mappings are emptied with madvise(MADV_DONTNEED) and pooled, since
+ *     reusing them avoids both the munmap and a fresh mmap.
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "reclaim.h"
+
+#define POOL_LIMIT      ((size_t)256 << 20)  /* most bytes kept for reuse */
+
+/* Header written over the first bytes of a deferred or pooled mapping */
+typedef struct Deferred {
+        struct Deferred *next;
+        size_t           bytes;
+        bool             huge;      /* advised for transparent huge pages */
+} Deferred;
+
+static _Atomic(Deferred *) queue;           /* mappings awaiting release */
+static sem_t               wakeup;          /* posted once per push */
+static pthread_once_t      started = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t     pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static Deferred           *pool;            /* emptied mappings, by lock */
+static atomic_size_t       pool_bytes;      /* readable without the lock */
+static size_t              page_bytes;
+
+/********** round_to_pages ********
+ *
+ * Rounds a size up to a whole number of pages
+ *****************************/
+static inline size_t round_to_pages(size_t bytes)
+{
+        return (bytes + page_bytes - 1) & ~(page_bytes - 1);
+}
+
+/********** release ********
+ *
+ * Pools a mapping after dropping its pages, or unmaps it if the pool is
+ * full. The first page keeps the pool header and stays resident.
+ *
+ * Parameters:
+ *      Deferred *mapping: the mapping, at least one page long
+ *      size_t bytes: page-rounded size of the mapping
+ * Return: None
+ *****************************/
+static void release(Deferred *mapping, size_t bytes)
+{
+        if (atomic_load(&pool_bytes) + bytes > POOL_LIMIT ||
+            bytes <= page_bytes) {
+                munmap(mapping, bytes);
+                return;
+        }
+        madvise((char *)mapping + page_bytes, bytes - page_bytes,
+                MADV_DONTNEED);
+        mapping->bytes = bytes;
+
+        pthread_mutex_lock(&pool_lock);
+        mapping->next = pool;
+        pool = mapping;
+        atomic_fetch_add(&pool_bytes, bytes);
+        pthread_mutex_unlock(&pool_lock);
+}
+
+/********** reclaimer ********
+ *
+ * Body of the reclamation thread: sleeps until mappings are pushed, then
+ * takes the whole stack and releases each mapping on it
+ *****************************/
+static void *reclaimer(void *unused)
+{
+        (void)unused;
+        for (;;) {
+                while (sem_wait(&wakeup) != 0) {
+                        assert(errno == EINTR);
+                }
+                Deferred *list = atomic_exchange(&queue, NULL);
+                while (list != NULL) {
+                        Deferred *next = list->next;
+                        release(list, list->bytes);
+                        list = next;
+                }
+        }
+        return NULL;
+}
+
+/********** start ********
+ *
+ * Starts the detached reclamation thread; run once through pthread_once
+ *****************************/
+static void start(void)
+{
+        page_bytes = (size_t)sysconf(_SC_PAGESIZE);
+        int failed = sem_init(&wakeup, 0, 0);
+        assert(failed == 0);
+
+        pthread_t thread;
+        failed = pthread_create(&thread, NULL, reclaimer, NULL);
+        assert(failed == 0);
+        pthread_detach(thread);
+}
+
+/********** reclaim_defer ********
+ *
+ * Hands a mapping to the reclamation thread. Never blocks: the push is a
+ * compare-and-swap loop and the wakeup a semaphore post.
+ *
+ * Parameters:
+ *      void *pages: start of a mapping that is no longer referenced
+ *      size_t bytes: size the mapping was created with
+ *      bool huge: whether it was advised for transparent huge pages
+ * Return: None
+ *
+ * Expects:
+ *      pages must not be NULL and must start a mapping of at least
+ *      sizeof(Deferred) bytes
+ * Notes:
+ *      Will CRE if pages is NULL
+ *      Starts the reclamation thread on first use
+ *****************************/
+extern void reclaim_defer(void *pages, size_t bytes, bool huge)
+{
+        assert(pages != NULL && bytes >= sizeof(Deferred));
+        pthread_once(&started, start);
+
+        Deferred *mapping = pages;
+        mapping->bytes = round_to_pages(bytes);
+        mapping->huge = huge;
+        mapping->next = atomic_load(&queue);
+        while (!atomic_compare_exchange_weak(&queue, &mapping->next,
+                                             mapping)) {
+        }
+        sem_post(&wakeup);
+}
+
+/********** reclaim_take ********
+ *
+ * Takes a pooled mapping big enough for a request, preferring not to
+ * waste more than a quarter of it. Mappings advised for huge pages and
+ * mappings that were not are pooled apart, so each keeps its advice.
+ *
+ * Parameters:
+ *      size_t bytes: bytes needed
+ *      size_t align: required alignment of the mapping, a power of two
+ *      bool huge: whether the mapping must be advised for huge pages
+ *      size_t *mapped: set to the size of the returned mapping
+ * Return:
+ *      a zero-filled mapping, or NULL if the pool has none that fits
+ *
+ * Expects:
+ *      mapped must not be NULL
+ * Notes:
+ *      Will CRE if mapped is NULL
+ *      Takes no lock when the pool is empty
+ *****************************/
+extern void *reclaim_take(size_t bytes, size_t align, bool huge,
+                          size_t *mapped)
+{
+        assert(mapped != NULL);
+        if (atomic_load(&pool_bytes) == 0) {
+                return NULL;
+        }
+        size_t need = round_to_pages(bytes);
+
+        pthread_mutex_lock(&pool_lock);
+        Deferred **link = &pool;
+        while (*link != NULL && ((*link)->huge != huge ||
+                                 (*link)->bytes < need ||
+                                 (*link)->bytes > need + need / 4 ||
+                                 ((uintptr_t)*link & (align - 1)) != 0)) {
+                link = &(*link)->next;
+        }
+        Deferred *mapping = *link;
+        if (mapping != NULL) {
+                *link = mapping->next;
+                atomic_fetch_sub(&pool_bytes, mapping->bytes);
+        }
+        pthread_mutex_unlock(&pool_lock);
+
+        if (mapping == NULL) {
+                return NULL;
+        }
+        *mapped = mapping->bytes;
+        memset(mapping, 0, page_bytes); /* the rest was dropped already */
+        return mapping;
+}
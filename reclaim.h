@@ -0,0 +1,27 @@
+/**************************************************************
+ *
+ *                     reclaim.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     reclaim.h contains the interface of the process-wide reclamation
+ *     thread. Large mappings are handed to it instead of being unmapped on
+ *     the interpreter thread, and it either unmaps them or, after
+ *     madvise(MADV_DONTNEED), keeps them in a pool for reuse.
+ *
+ **************************************************************/
+#ifndef RECLAIM_INCLUDED
+#define RECLAIM_INCLUDED
+
+#include <stddef.h>
+#include <stdbool.h>
+
+extern void reclaim_defer(void *pages, size_t bytes, bool huge);
+extern void *reclaim_take(size_t bytes, size_t align, bool huge,
+                          size_t *mapped);
+
+#endif
@@ -0,0 +1,248 @@
+/**************************************************************
+ *
+ *                     replay.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     replay.c contains the implementation of input logs. A log starts
+ *     with LOG_MAGIC, followed by one entry per input instruction: a
+ *     varint (seven bits per byte, low bits first, high bit set on all
+ *     but the last byte) holding the instructions executed since the
+ *     previous entry shifted left by one, with the low bit set for end of
+ *     input, then the byte read unless it was end of input. Interactive
+ *     programs read in bursts, so most entries take two or three bytes.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <mem.h>
+#include "replay.h"
+
+#define LOG_MAGIC       "UMLOG1\n"
+#define MAGIC_BYTES     (sizeof(LOG_MAGIC) - 1)
+#define END_OF_INPUT    (~(uint32_t)0)
+
+/********** struct Replay_T ********
+ *
+ * FILE *log: the log, owned by the caller
+ * bool recording: whether entries are written rather than read
+ * uint64_t last: instruction count of the previous entry
+ * bool failed: a write failed, or a read found the log corrupt
+ *
+ *****************************/
+struct Replay_T {
+        FILE           *log;
+        bool            recording;
+        uint64_t        last;
+        bool            failed;
+};
+
+/********** new_replay ********
+ *
+ * Allocates a log positioned before its first entry
+ *****************************/
+static Replay_T new_replay(FILE *log, bool recording)
+{
+        Replay_T replay = ALLOC(sizeof(struct Replay_T));
+        assert(replay != NULL);
+        replay->log = log;
+        replay->recording = recording;
+        replay->last = 0;
+        replay->failed = false;
+        return replay;
+}
+
+/********** replay_record ********
+ *
+ * Starts recording input to a log
+ *
+ * Parameters:
+ *      FILE *log: stream to write the log to
+ * Return:
+ *      the log, to pass to replay_put
+ *
+ * Expects:
+ *      log must not be NULL
+ * Notes:
+ *      Will CRE if log is NULL or allocation fails
+ *      The stream stays owned by the caller, who must keep it open until
+ *      replay_free
+ *****************************/
+extern Replay_T replay_record(FILE *log)
+{
+        assert(log != NULL);
+        Replay_T replay = new_replay(log, true);
+        replay->failed = fwrite(LOG_MAGIC, 1, MAGIC_BYTES, log) != 
+                         MAGIC_BYTES;
+        return replay;
+}
+
+/********** replay_open ********
+ *
+ * Starts replaying a log written by replay_record
+ *
+ * Parameters:
+ *      FILE *log: stream to read the log from, at its start
+ * Return:
+ *      the log, to pass to replay_get, or NULL if the stream does not hold
+ *      one
+ *
+ * Expects:
+ *      log must not be NULL
+ * Notes:
+ *      Will CRE if log is NULL or allocation fails
+ *      The stream stays owned by the caller, who must keep it open until
+ *      replay_free
+ *****************************/
+extern Replay_T replay_open(FILE *log)
+{
+        assert(log != NULL);
+        char magic[MAGIC_BYTES];
+        if (fread(magic, 1, MAGIC_BYTES, log) != MAGIC_BYTES ||
+            memcmp(magic, LOG_MAGIC, MAGIC_BYTES) != 0) {
+                return NULL;
+        }
+        return new_replay(log, false);
+}
+
+/********** replay_put ********
+ *
+ * Records the value an input instruction returned
+ *
+ * Parameters:
+ *      Replay_T replay: a log being recorded
+ *      uint64_t count: instructions executed when the value was read,
+ *                      including the input instruction
+ *      uint32_t value: the byte read, or all ones at end of input
+ * Return: None
+ *
+ * Expects:
+ *      replay must not be NULL and must be recording; count must not be
+ *      less than that of the previous entry
+ * Notes:
+ *      Will CRE if replay is NULL or is being replayed, if count goes
+ *      backwards, or if value is neither a byte nor end of input
+ *****************************/
+extern void replay_put(Replay_T replay, uint64_t count, uint32_t value)
+{
+        assert(replay != NULL && replay->recording);
+        assert(count >= replay->last);
+        assert(value <= 255 || value == END_OF_INPUT);
+        uint64_t delta = count - replay->last;
+        replay->last = count;
+
+        /* The top bit of delta is lost to the flag; no run gets that far */
+        uint64_t field = delta << 1 | (value == END_OF_INPUT);
+        while (field >= 0x80) {
+                putc((int)(field & 0x7f) | 0x80, replay->log);
+                field >>= 7;
+        }
+        putc((int)field, replay->log);
+        if (value != END_OF_INPUT) {
+                putc((int)value, replay->log);
+        }
+}
+
+/********** replay_get ********
+ *
+ * Returns the next value of a log being replayed, if it was recorded at
+ * the given instruction count
+ *
+ * Parameters:
+ *      Replay_T replay: a log being replayed
+ *      uint64_t count: instructions executed by the replaying UM,
+ *                      including the input instruction
+ *      uint32_t *value: receives the byte, or all ones at end of input
+ * Return:
+ *      false if the log has ended, is corrupt, or recorded the value at a
+ *      different count, meaning the run has departed from the log
+ *
+ * Expects:
+ *      replay and value must not be NULL; replay must be replaying
+ * Notes:
+ *      Will CRE if replay or value is NULL, or replay is recording
+ *****************************/
+extern bool replay_get(Replay_T replay, uint64_t count, uint32_t *value)
+{
+        assert(replay != NULL && !replay->recording && value != NULL);
+        uint64_t field = 0;
+        int c;
+        for (unsigned shift = 0; !replay->failed; shift += 7) {
+                c = getc(replay->log);
+                if (c == EOF || shift > 63) {
+                        replay->failed = true;
+                        break;
+                }
+                field |= (uint64_t)(c & 0x7f) << shift;
+                if ((c & 0x80) == 0) {
+                        break;
+                }
+        }
+        if (replay->failed) {
+                return false;
+        }
+        replay->last += field >> 1;
+        if ((field & 1) != 0) {
+                *value = END_OF_INPUT;
+        } else if ((c = getc(replay->log)) != EOF) {
+                *value = (uint32_t)c;
+        } else {
+                replay->failed = true;
+                return false;
+        }
+        return replay->last == count;
+}
+
+/********** replay_flush ********
+ *
+ * Writes out the entries of a log being recorded
+ *
+ * Parameters:
+ *      Replay_T replay: the log
+ * Return:
+ *      false if a write to the log has failed
+ *
+ * Expects:
+ *      replay must not be NULL
+ * Notes:
+ *      Will CRE if replay is NULL
+ *      Does nothing but report for a log being replayed
+ *****************************/
+extern bool replay_flush(Replay_T replay)
+{
+        assert(replay != NULL);
+        if (replay->recording && (fflush(replay->log) != 0 ||
+                                  ferror(replay->log))) {
+                replay->failed = true;
+        }
+        return !replay->failed;
+}
+
+/********** replay_free ********
+ *
+ * Flushes a log being recorded and frees it, leaving its stream open
+ *
+ * Parameters:
+ *      Replay_T *replay: pointer to the log; set to NULL
+ * Return:
+ *      false if a write to a recorded log has failed, or a replayed log
+ *      was found corrupt
+ *
+ * Expects:
+ *      replay and *replay must not be NULL
+ * Notes:
+ *      Will CRE if replay or *replay is NULL
+ *****************************/
+extern bool replay_free(Replay_T *replay)
+{
+        assert(replay != NULL && *replay != NULL);
+        bool ok = replay_flush(*replay);
+        free(*replay);
+        *replay = NULL;
+        return ok;
+}
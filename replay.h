@@ -0,0 +1,34 @@
+/**************************************************************
+ *
+ *                     replay.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     replay.h contains the interface of input logs. A log records every
+ *     value an input instruction returned together with the number of
+ *     instructions the UM had executed when it did, so that a session can
+ *     be rerun exactly: replaying the log returns the same values at the
+ *     same instruction counts, and notices when a run departs from it.
+ *
+ **************************************************************/
+#ifndef REPLAY_INCLUDED
+#define REPLAY_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct Replay_T *Replay_T;
+
+extern Replay_T replay_record(FILE *log);
+extern Replay_T replay_open(FILE *log);
+extern void replay_put(Replay_T replay, uint64_t count, uint32_t value);
+extern bool replay_get(Replay_T replay, uint64_t count, uint32_t *value);
+extern bool replay_flush(Replay_T replay);
+extern bool replay_free(Replay_T *replay);
+
+#endif
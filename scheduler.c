@@ -0,0 +1,569 @@
+/**************************************************************
+ *
+ *                     scheduler.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     scheduler.c contains the implementation of the cooperative UM
+ *     scheduler. Runnable UMs wait in one FIFO queue per priority; the
+ *     scheduler gives the head of the highest nonempty queue a quantum of
+ *     basic blocks through um_set_quantum and um_run, then puts it at the
+ *     back of its queue if it yielded. A UM's input is fed to it with
+ *     um_feed_input, so the UM itself never reads: one that stops with
+ *     UM_NEEDS_INPUT has its descriptor armed in an epoll set, one shot,
+ *     and once the descriptor is readable the scheduler reads what has
+ *     arrived, feeds it, and requeues the UM. The set is polled without
+ *     waiting between slices while anything is watched, and waited on
+ *     only when no UM can run.
+ *
+ *     UMs can be added from any thread: they are passed through a locked
+ *     inbox, and an eventfd in the epoll set wakes an idle scheduler.
+ *
+ *     A slice's CPU time is measured with the thread CPU clock, so time
+ *     the thread spends descheduled by the kernel is not charged to the
+ *     UM that happened to be running.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <mem.h>
+#include "scheduler.h"
+
+#define DEFAULT_QUANTUM 1024    /* basic blocks per slice */
+#define MAX_EVENTS      64
+#define FEED_BYTES      4096    /* input read for a UM at a time */
+
+/* A UM owned by the scheduler */
+typedef struct Task {
+        UM_T            um;
+        int             fd;             /* input descriptor, or -1 */
+        bool            watched;        /* fd has been added to the set */
+        unsigned        priority;
+        UM_status       status;         /* why the UM last stopped */
+        Sched_done      done;
+        void           *cl;
+        Sched_usage     usage;
+        struct Task    *prev;           /* in parked only */
+        struct Task    *next;           /* in a queue, inbox or parked */
+} Task;
+
+/* FIFO of tasks */
+typedef struct Queue {
+        Task           *head;
+        Task          **tail;
+} Queue;
+
+/********** struct Sched_T ********
+ *
+ * uint64_t quantum: basic blocks per slice
+ * int epoll: input descriptors of parked tasks, and wakeup
+ * int wakeup: eventfd written when a task is added or stopping is set
+ * Queue ready[]: runnable tasks, one queue per priority
+ * unsigned runnable: tasks in the ready queues
+ * Task *parked: tasks waiting for input
+ * unsigned waiting: tasks in parked
+ * Sched_usage usage: totals over finished slices
+ * pthread_mutex_t lock: guards inbox, stopping and current
+ * Queue inbox: tasks added and not yet queued
+ * bool stopping: set by sched_stop
+ * UM_T current: the UM running a slice, or NULL
+ *
+ *****************************/
+struct Sched_T {
+        uint64_t        quantum;
+        int             epoll;
+        int             wakeup;
+        Queue           ready[SCHED_PRIORITIES];
+        unsigned        runnable;
+        Task           *parked;
+        unsigned        waiting;
+        Sched_usage     usage;
+        pthread_mutex_t lock;
+        Queue           inbox;
+        bool            stopping;
+        UM_T            current;
+};
+
+/********** sched_new ********
+ *
+ * Creates an empty scheduler
+ *
+ * Parameters:
+ *      uint64_t quantum: basic blocks a UM runs before yielding, 0 for
+ *                        the default of 1024
+ * Return:
+ *      the scheduler
+ *
+ * Notes:
+ *      Will CRE if allocation or creating the epoll set fails
+ *****************************/
+extern Sched_T sched_new(uint64_t quantum)
+{
+        Sched_T sched = CALLOC(1, sizeof(struct Sched_T));
+        assert(sched != NULL);
+        sched->quantum = quantum == 0 ? DEFAULT_QUANTUM : quantum;
+        sched->epoll = epoll_create1(EPOLL_CLOEXEC);
+        sched->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        assert(sched->epoll >= 0 && sched->wakeup >= 0);
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        int failed = epoll_ctl(sched->epoll, EPOLL_CTL_ADD, sched->wakeup,
+                               &event);
+        assert(failed == 0);
+        (void)failed;
+        for (unsigned i = 0; i < SCHED_PRIORITIES; i++) {
+                sched->ready[i].tail = &sched->ready[i].head;
+        }
+        sched->inbox.tail = &sched->inbox.head;
+        pthread_mutex_init(&sched->lock, NULL);
+        return sched;
+}
+
+/********** push ********
+ *
+ * Appends a task to a queue
+ *****************************/
+static void push(Queue *queue, Task *task)
+{
+        task->next = NULL;
+        *queue->tail = task;
+        queue->tail = &task->next;
+}
+
+/********** pop ********
+ *
+ * Removes the task at the head of a queue
+ *
+ * Return:
+ *      the task, or NULL if the queue is empty
+ *****************************/
+static Task *pop(Queue *queue)
+{
+        Task *task = queue->head;
+        if (task != NULL) {
+                queue->head = task->next;
+                if (queue->head == NULL) {
+                        queue->tail = &queue->head;
+                }
+        }
+        return task;
+}
+
+/********** make_ready ********
+ *
+ * Appends a task to the queue of its priority
+ *****************************/
+static void make_ready(Sched_T sched, Task *task)
+{
+        push(&sched->ready[task->priority], task);
+        sched->runnable++;
+}
+
+/********** take_ready ********
+ *
+ * Removes the task at the head of the highest priority nonempty queue
+ *
+ * Return:
+ *      the task, or NULL if no task is runnable
+ *****************************/
+static Task *take_ready(Sched_T sched)
+{
+        for (unsigned i = 0; i < SCHED_PRIORITIES; i++) {
+                Task *task = pop(&sched->ready[i]);
+                if (task != NULL) {
+                        sched->runnable--;
+                        return task;
+                }
+        }
+        return NULL;
+}
+
+/********** wake ********
+ *
+ * Interrupts the scheduler's wait for input
+ *****************************/
+static void wake(Sched_T sched)
+{
+        uint64_t one = 1;
+        ssize_t ignored = write(sched->wakeup, &one, sizeof(one));
+        (void)ignored;
+}
+
+/********** sched_add ********
+ *
+ * Hands a UM to the scheduler; safe to call from any thread, including
+ * from a done callback. If an input descriptor is given, the scheduler
+ * reads it and feeds the UM, so the UM must not read input otherwise.
+ *
+ * Parameters:
+ *      Sched_T sched: the scheduler
+ *      UM_T um: the UM, loaded and ready to run
+ *      int input_fd: readable descriptor for the UM's input, or -1 to
+ *                    leave its input alone; it stays owned by the caller
+ *      unsigned priority: 0 to SCHED_PRIORITIES - 1, lowest runs first
+ *      Sched_done done: called, if not NULL, once the UM leaves the
+ *                       scheduler; the UM then belongs to the callback
+ *      void *cl: closure passed to done
+ * Return: None
+ *
+ * Expects:
+ *      sched and um must not be NULL, priority must be in range, and the
+ *      UM must not already be scheduled
+ * Notes:
+ *      Will CRE if sched or um is NULL, priority is out of range, or
+ *      allocation fails
+ *****************************/
+extern void sched_add(Sched_T sched, UM_T um, int input_fd,
+                      unsigned priority, Sched_done done, void *cl)
+{
+        assert(sched != NULL && um != NULL && priority < SCHED_PRIORITIES);
+        if (input_fd >= 0) {
+                um_feed_input(um, NULL, 0);
+        }
+        Task *task = CALLOC(1, sizeof(Task));
+        assert(task != NULL);
+        task->um = um;
+        task->fd = input_fd;
+        task->priority = priority;
+        task->status = UM_RUNNING;
+        task->done = done;
+        task->cl = cl;
+        pthread_mutex_lock(&sched->lock);
+        push(&sched->inbox, task);
+        pthread_mutex_unlock(&sched->lock);
+        wake(sched);
+}
+
+/********** take_inbox ********
+ *
+ * Queues the tasks added since the last call
+ *
+ * Return:
+ *      whether sched_stop has been called
+ *****************************/
+static bool take_inbox(Sched_T sched)
+{
+        pthread_mutex_lock(&sched->lock);
+        Task *task = sched->inbox.head;
+        sched->inbox.head = NULL;
+        sched->inbox.tail = &sched->inbox.head;
+        bool stopping = sched->stopping;
+        pthread_mutex_unlock(&sched->lock);
+        while (task != NULL) {
+                Task *next = task->next;
+                make_ready(sched, task);
+                task = next;
+        }
+        return stopping;
+}
+
+/********** park ********
+ *
+ * Sets a task aside until its input descriptor is readable
+ *
+ * Return:
+ *      false if the descriptor cannot be watched
+ *****************************/
+static bool park(Sched_T sched, Task *task)
+{
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLONESHOT;
+        event.data.ptr = task;
+        int op = task->watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(sched->epoll, op, task->fd, &event) != 0) {
+                return false;
+        }
+        task->watched = true;
+        task->prev = NULL;
+        task->next = sched->parked;
+        if (sched->parked != NULL) {
+                sched->parked->prev = task;
+        }
+        sched->parked = task;
+        sched->waiting++;
+        return true;
+}
+
+/********** unpark ********
+ *
+ * Removes a task from the parked list
+ *****************************/
+static void unpark(Sched_T sched, Task *task)
+{
+        if (task->prev != NULL) {
+                task->prev->next = task->next;
+        } else {
+                sched->parked = task->next;
+        }
+        if (task->next != NULL) {
+                task->next->prev = task->prev;
+        }
+        sched->waiting--;
+}
+
+/********** feed ********
+ *
+ * Reads what has arrived on a parked task's descriptor, feeds it to the
+ * UM, and requeues the task; end of file or an error ends its input
+ *****************************/
+static void feed(Sched_T sched, Task *task)
+{
+        uint8_t buffer[FEED_BYTES];
+        unpark(sched, task);
+        ssize_t got = read(task->fd, buffer, sizeof(buffer));
+        if (got > 0) {
+                um_feed_input(task->um, buffer, (size_t)got);
+        } else if (got == 0 || (errno != EAGAIN && errno != EINTR)) {
+                um_end_input(task->um);
+        } else if (park(sched, task)) {
+                return;
+        }
+        make_ready(sched, task);
+}
+
+/********** poll_input ********
+ *
+ * Feeds the parked tasks whose input has arrived and clears wakeups
+ *
+ * Parameters:
+ *      Sched_T sched: the scheduler
+ *      int timeout: milliseconds to wait, -1 for as long as it takes
+ * Return: None
+ *****************************/
+static void poll_input(Sched_T sched, int timeout)
+{
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(sched->epoll, events, MAX_EVENTS, timeout);
+        for (int i = 0; i < n; i++) {
+                if (events[i].data.ptr == NULL) {
+                        uint64_t count;
+                        ssize_t ignored = read(sched->wakeup, &count,
+                                               sizeof(count));
+                        (void)ignored;
+                } else {
+                        feed(sched, events[i].data.ptr);
+                }
+        }
+}
+
+/********** retire ********
+ *
+ * Hands a task's UM back to its done callback and frees the task
+ *****************************/
+static void retire(Sched_T sched, Task *task)
+{
+        if (task->watched) {
+                epoll_ctl(sched->epoll, EPOLL_CTL_DEL, task->fd, NULL);
+        }
+        um_set_quantum(task->um, 0);
+        if (task->done != NULL) {
+                task->done(task->cl, task->um, task->status, &task->usage);
+        }
+        free(task);
+}
+
+/********** thread_ns ********
+ *
+ * Returns the CPU time the calling thread has used
+ *****************************/
+static uint64_t thread_ns(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+        return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/********** run_slice ********
+ *
+ * Runs a task for one quantum, charges it for the slice, and requeues,
+ * parks or retires it according to why it stopped
+ *****************************/
+static void run_slice(Sched_T sched, Task *task)
+{
+        UM_T um = task->um;
+        uint64_t before = um_stats(um).instructions;
+        uint64_t start = thread_ns();
+        pthread_mutex_lock(&sched->lock);
+        sched->current = um;
+        bool stopping = sched->stopping;
+        pthread_mutex_unlock(&sched->lock);
+        um_set_quantum(um, sched->quantum);
+        task->status = stopping ? task->status : um_run(um);
+        pthread_mutex_lock(&sched->lock);
+        sched->current = NULL;
+        pthread_mutex_unlock(&sched->lock);
+        uint64_t cpu = thread_ns() - start;
+        uint64_t executed = um_stats(um).instructions - before;
+
+        task->usage.cpu_ns += cpu;
+        task->usage.slices++;
+        task->usage.instructions += executed;
+        sched->usage.cpu_ns += cpu;
+        sched->usage.slices++;
+        sched->usage.instructions += executed;
+
+        if (task->status == UM_YIELDED && !stopping) {
+                make_ready(sched, task);
+        } else if (task->status != UM_NEEDS_INPUT || task->fd < 0 ||
+                   stopping || !park(sched, task)) {
+                retire(sched, task);
+        }
+}
+
+/********** run ********
+ *
+ * Runs slices and feeds input until sched_stop is called or, unless
+ * forever is set, no UM is left; on stopping, hands every UM back
+ *****************************/
+static void run(Sched_T sched, bool forever)
+{
+        bool stopping;
+        while (!(stopping = take_inbox(sched))) {
+                if (sched->runnable == 0 && sched->waiting == 0 &&
+                    !forever) {
+                        return;
+                }
+                if (sched->waiting > 0 || sched->runnable == 0) {
+                        poll_input(sched, sched->runnable > 0 ? 0 : -1);
+                }
+                Task *task = take_ready(sched);
+                if (task != NULL) {
+                        run_slice(sched, task);
+                }
+        }
+        for (Task *task; (task = take_ready(sched)) != NULL;) {
+                retire(sched, task);
+        }
+        while (sched->parked != NULL) {
+                Task *task = sched->parked;
+                unpark(sched, task);
+                retire(sched, task);
+        }
+}
+
+/********** sched_run ********
+ *
+ * Runs the scheduled UMs until every one has left the scheduler: halted,
+ * faulted, run out of budget, or stopped needing input with no descriptor
+ * for the scheduler to wait on
+ *
+ * Parameters:
+ *      Sched_T sched: the scheduler
+ * Return: None
+ *
+ * Expects:
+ *      sched must not be NULL
+ * Notes:
+ *      Will CRE if sched is NULL
+ *      UMs added by done callbacks run before sched_run returns; a UM
+ *      added by another thread as the last one leaves may wait for the
+ *      next call
+ *****************************/
+extern void sched_run(Sched_T sched)
+{
+        assert(sched != NULL);
+        run(sched, false);
+}
+
+/********** sched_serve ********
+ *
+ * Runs scheduled UMs, waiting for more when there are none, until
+ * sched_stop is called; every UM still scheduled then is handed to its
+ * done callback with the status it last stopped with
+ *
+ * Parameters:
+ *      Sched_T sched: the scheduler
+ * Return: None
+ *
+ * Expects:
+ *      sched must not be NULL
+ * Notes:
+ *      Will CRE if sched is NULL
+ *****************************/
+extern void sched_serve(Sched_T sched)
+{
+        assert(sched != NULL);
+        run(sched, true);
+}
+
+/********** sched_stop ********
+ *
+ * Makes sched_run or sched_serve return as soon as the current slice
+ * ends, which it interrupts; safe to call from any thread. The scheduler
+ * runs nothing more afterwards.
+ *
+ * Parameters:
+ *      Sched_T sched: the scheduler
+ * Return: None
+ *
+ * Expects:
+ *      sched must not be NULL
+ * Notes:
+ *      Will CRE if sched is NULL
+ *****************************/
+extern void sched_stop(Sched_T sched)
+{
+        assert(sched != NULL);
+        pthread_mutex_lock(&sched->lock);
+        sched->stopping = true;
+        um_interrupt(sched->current);
+        pthread_mutex_unlock(&sched->lock);
+        wake(sched);
+}
+
+/********** sched_usage ********
+ *
+ * Returns the CPU time and work of every slice the scheduler has run
+ *
+ * Parameters:
+ *      Sched_T sched: the scheduler
+ * Return:
+ *      the totals
+ *
+ * Expects:
+ *      sched must not be NULL
+ * Notes:
+ *      Will CRE if sched is NULL
+ *****************************/
+extern Sched_usage sched_usage(Sched_T sched)
+{
+        assert(sched != NULL);
+        return sched->usage;
+}
+
+/********** sched_free ********
+ *
+ * Frees a scheduler and sets it to NULL
+ *
+ * Parameters:
+ *      Sched_T *sched: the scheduler
+ * Return: None
+ *
+ * Expects:
+ *      sched and *sched must not be NULL, and no UM may be scheduled
+ * Notes:
+ *      Will CRE if sched or *sched is NULL or UMs are still scheduled
+ *****************************/
+extern void sched_free(Sched_T *sched)
+{
+        assert(sched != NULL && *sched != NULL);
+        Sched_T s = *sched;
+        assert(s->runnable == 0 && s->waiting == 0 && s->inbox.head == NULL);
+        close(s->epoll);
+        close(s->wakeup);
+        pthread_mutex_destroy(&s->lock);
+        free(s);
+        *sched = NULL;
+}
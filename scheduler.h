@@ -0,0 +1,49 @@
+/**************************************************************
+ *
+ *                     scheduler.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     scheduler.h contains the interface of a cooperative scheduler that runs
+ *     many UMs on one thread. Each UM runs for a quantum of basic blocks
+ *     and then yields to the next; a UM whose input has run out is set
+ *     aside, and fed once more arrives, instead of blocking the thread.
+ *     UMs of a higher priority always run before those of a lower one,
+ *     and UMs of equal priority take turns.
+ *
+ **************************************************************/
+#ifndef SCHEDULER_INCLUDED
+#define SCHEDULER_INCLUDED
+
+#include <stdint.h>
+#include "um_status.h"
+
+#define SCHED_PRIORITIES 4      /* priorities are 0 (first) to 3 (last) */
+
+typedef struct Sched_T *Sched_T;
+
+/* CPU time and work done by one UM, or by all UMs of a scheduler */
+typedef struct Sched_usage {
+        uint64_t        cpu_ns;        /* thread CPU time spent running */
+        uint64_t        slices;        /* times given the thread */
+        uint64_t        instructions;  /* instructions executed */
+} Sched_usage;
+
+/* Called once a UM leaves the scheduler, with the status it stopped with */
+typedef void (*Sched_done)(void *cl, UM_T um, UM_status status,
+                           const Sched_usage *usage);
+
+extern Sched_T sched_new(uint64_t quantum);
+extern void sched_add(Sched_T sched, UM_T um, int input_fd,
+                      unsigned priority, Sched_done done, void *cl);
+extern void sched_run(Sched_T sched);
+extern void sched_serve(Sched_T sched);
+extern void sched_stop(Sched_T sched);
+extern Sched_usage sched_usage(Sched_T sched);
+extern void sched_free(Sched_T *sched);
+
+#endif
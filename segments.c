@@ -14,13 +14,154 @@
  *     and updating or retrieving a word within a segment of memory. 
  * 
  *     Also includes struct definition for Segments_T, which represents 
- *     segments used by the UM. 
+ *     segments used by the UM as a radix table keyed by segment ID, with
+ *     unmapped IDs kept on a stack threaded through their own free slots.
+ *     The segments themselves are allocated from a per-UM arena, either
+ *     densely or, above the sparse threshold, as a table of word pages
+ *     that stay shared zeros until first written. Dense segments that go
+ *     unused between two sweeps are compressed into a cold tier and
+ *     decompressed on their next access. Long segments can also be
+ *     shared, read-only, with identical segments of other tables in the
+ *     process, and get words of their own on their first write.
+ *
+ *     A table can also be saved to and loaded from a checkpoint file,
+ *     independent of how its segments are represented in memory.
  *
  **************************************************************/
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <mem.h>
 #include "segments.h"
+#include "lz.h"
+#include "dedup.h"
+
+/* 
+ * Segment IDs index a three-level radix table: the top 10 bits select a
+ * middle table, the next 11 bits a leaf, and the low 11 bits a slot. Middle
+ * tables and leaves are allocated the first time an ID inside them is handed
+ * out, so the table never moves and lookups always take three loads.
+ */
+#define TOP_BITS        10
+#define MID_BITS        11
+#define LEAF_BITS       11
+#define TOP_SIZE        (1u << TOP_BITS)
+#define MID_SIZE        (1u << MID_BITS)
+#define LEAF_SIZE       (1u << LEAF_BITS)
+#define NO_FREE_ID      UINT32_MAX
+
+/* 
+ * A slot holds either the Segment of a live segment or, when the ID has been
+ * unmapped, the next ID on the free stack shifted left and tagged with a 1 in
+ * the low bit. Segments are aligned, so the tag cannot collide.
+ */
+typedef uintptr_t Slot;
+
+#define IS_FREE(slot)     (((slot) & 1) != 0)
+#define FREE_SLOT(next)   (((Slot)(next) << 1) | 1)
+#define NEXT_FREE(slot)   ((uint32_t)((slot) >> 1))
+
+/* Representations of a segment's words */
+enum { SEG_DENSE = 0, SEG_SPARSE, SEG_COLD, SEG_SHARED };
+
+/* Values of Segment.touched, kept by dense segments while tracking use */
+enum { IDLE = 0, TOUCHED, INCOMPRESSIBLE };
+
+/********** struct Segment ********
+ *
+ * A mapped segment, allocated from the arena together with its words
+ *
+ * uint32_t length: number of words in the segment
+ * uint8_t kind: SEG_DENSE, SEG_SPARSE, SEG_COLD or SEG_SHARED
+ * uint8_t touched: TOUCHED if accessed since the last cold sweep, IDLE if
+ *                  not, INCOMPRESSIBLE if idle but not worth compressing
+ * uint32_t *words: for a dense segment, the words, stored directly after
+ *                  the header; NULL for a sparse segment, whose header is
+ *                  followed instead by one pointer per PAGE_WORDS words;
+ *                  for a cold segment, its Packed words; for a shared
+ *                  segment, words held by the dedup store, which must
+ *                  not be written
+ *
+ *****************************/
+typedef struct Segment {
+        uint32_t        length;
+        uint8_t         kind;
+        uint8_t         touched;
+        uint32_t       *words;
+} Segment;
+
+#define SEGMENT_BYTES(length) (sizeof(Segment) + (size_t)(length) * 4)
+
+/*
+ * A sparse segment's words live in 4 KB pages. Pages that have never been
+ * written point at zero_page, which is read-only, so untouched parts of a
+ * huge segment cost one table pointer per page and no committed memory.
+ */
+#define PAGE_BITS       10
+#define PAGE_WORDS      (1u << PAGE_BITS)
+#define PAGE_COUNT(length) (((size_t)(length) + PAGE_WORDS - 1) >> PAGE_BITS)
+#define SPARSE_BYTES(length) \
+        (sizeof(Segment) + PAGE_COUNT(length) * sizeof(uint32_t *))
+#define PAGES(segment)  ((uint32_t **)((segment) + 1))
+
+static const uint32_t zero_page[PAGE_WORDS];
+
+/*
+ * A cold segment is a bare header whose words pointer leads to its
+ * compressed words. Only segments of COLD_MIN_WORDS or more are worth
+ * compressing, and only if they shrink to 3/4 of their size or less.
+ */
+#define COLD_MIN_WORDS  256
+
+typedef struct Packed {
+        uint32_t        bytes;          /* size of data */
+        uint8_t         data[];
+} Packed;
+
+#define PACKED(segment) ((Packed *)(segment)->words)
+#define PACKED_BYTES(packed) (sizeof(Packed) + (packed)->bytes)
+
+/*
+ * A checkpoint of file-backed segments: the table, the owner's state, and
+ * the address zero_page had, since a later process may load it elsewhere.
+ * The arena's root points at the current checkpoint, if any.
+ */
+typedef struct Directory {
+        uint32_t        next_id;
+        uint32_t        free_head;
+        uint32_t        sparse_length;
+        uint32_t        state[SEGMENT_STATE_WORDS];
+        Segments_usage  usage;
+        const uint32_t *zero_page;
+        Slot            slots[];
+} Directory;
+
+#define DIRECTORY_BYTES(next_id) \
+        (sizeof(Directory) + (size_t)(next_id) * sizeof(Slot))
+
+/*
+ * A checkpoint file is a sequence of native 32-bit words: SAVE_MAGIC, the
+ * owner's state, next_id, free_head and sparse_length, then for each ID a
+ * tag, SAVE_LIVE followed by the length and words of the segment or
+ * SAVE_FREE followed by the next ID on the free stack, and SAVE_END.
+ */
+#define SAVE_MAGIC      0x31504b43u     /* "CKP1" */
+#define SAVE_END        0x444e4543u     /* "CEND" */
+enum { SAVE_LIVE = 0, SAVE_FREE };
+
+/* Buffered output of write_segments, which makes only system calls */
+#define SINK_BYTES      65536
+
+typedef struct Sink {
+        int             fd;
+        size_t          used;
+        bool            failed;
+        uint8_t         buffer[SINK_BYTES];
+} Sink;
 
 /********** struct Segments_T ********
  *
@@ -28,16 +169,418 @@
  * to be executed. Specifically, each component corresponds to the following
  * data representation:
  * 
- * Seq_T segments: a sequence of sequences, which store instructions in words 
- * Seq_T unmapped_ids: a sequence of unmapped IDs, which can be used when a new
- *                     memory segment is mapped.
+ * Slot **top[]: radix table from segment ID to the segment's Segment
+ * Arena_T arena: memory holding every Segment and its words
+ * uint32_t next_id: one past the highest ID ever handed out
+ * uint32_t free_head: most recently unmapped ID, the top of a stack threaded
+ *                     through the free slots (NO_FREE_ID when empty)
+ * Segments_usage usage: live and peak words and segments
+ * Segments_limits limits: soft and hard quotas on usage
+ * bool over_soft: whether usage is currently above a soft limit
+ * uint32_t sparse_length: segments this long or longer are mapped sparse
+ * uint8_t *scratch: buffer that cold segments are compressed into
+ * Directory *directory: current checkpoint of a file-backed table, or NULL
+ * uint32_t dedup_length: segments this long or longer are shared when
+ *                        copied or passed to share_segments, or 0
+ * bool track_use: whether get_word and set_word mark segments other than
+ *                 segment 0 TOUCHED, which only cold sweeps need
  * 
  *****************************/
 struct Segments_T {
-        Seq_T     segments;        /* Sequence of sequence of instructions */
-        Seq_T     unmapped_ids;    /* Sequence of recycled IDs (uint32_t) */
+        Slot            **top[TOP_SIZE];  /* Middle tables, on demand */
+        Arena_T           arena;          /* Backing for all segments */
+        uint32_t          next_id;        /* IDs below this are handed out */
+        uint32_t          free_head;      /* Stack of recycled IDs */
+        Segments_usage    usage;          /* Accounting for quotas/stats */
+        Segments_limits   limits;         /* Quotas, 0 meaning unlimited */
+        bool              over_soft;      /* Soft limit already reported */
+        uint32_t          sparse_length;  /* Sparse from this length, or 0 */
+        uint8_t          *scratch;        /* Compression output buffer */
+        size_t            scratch_bytes;  /* Size of scratch */
+        Directory        *directory;      /* Checkpoint, if any */
+        uint32_t          dedup_length;   /* Shared from this length, or 0 */
+        bool              track_use;      /* Cold sweeps are configured */
 };
 
+/********** slot_at ********
+ *
+ * Returns the table slot for a segment ID that has already been handed out
+ *
+ * Parameters: 
+ *      Segments_T Segments: table to search
+ *      uint32_t seg_ID: identifier of the slot
+ * Return: 
+ *      pointer to the slot for seg_ID
+ *
+ * Expects:
+ *      seg_ID must be less than Segments->next_id
+ * Notes:
+ *      Will CRE if seg_ID has never been handed out
+ *****************************/
+static inline Slot *slot_at(Segments_T Segments, uint32_t seg_ID)
+{
+        assert(seg_ID < Segments->next_id);
+        return &Segments->top[seg_ID >> (MID_BITS + LEAF_BITS)]
+                             [(seg_ID >> LEAF_BITS) & (MID_SIZE - 1)]
+                             [seg_ID & (LEAF_SIZE - 1)];
+}
+
+/********** new_slot ********
+ *
+ * Hands out a never-used ID, allocating the middle table and leaf that hold
+ * its slot if this is the first ID inside them
+ *
+ * Parameters: 
+ *      Segments_T Segments: table to grow
+ * Return: 
+ *      the new ID
+ *
+ * Expects:
+ *      Fewer than 2^32 - 1 IDs have been handed out
+ * Notes:
+ *      Will CRE if the ID space is exhausted or allocation fails
+ *****************************/
+static uint32_t new_slot(Segments_T Segments)
+{
+        uint32_t seg_ID = Segments->next_id;
+        assert(seg_ID != NO_FREE_ID);
+
+        Slot ***mid = &Segments->top[seg_ID >> (MID_BITS + LEAF_BITS)];
+        if (*mid == NULL) {
+                *mid = CALLOC(MID_SIZE, sizeof(Slot *));
+                assert(*mid != NULL);
+        }
+        Slot **leaf = &(*mid)[(seg_ID >> LEAF_BITS) & (MID_SIZE - 1)];
+        if (*leaf == NULL) {
+                *leaf = CALLOC(LEAF_SIZE, sizeof(Slot));
+                assert(*leaf != NULL);
+        }
+        Segments->next_id++;
+        return seg_ID;
+}
+
+/********** segment_at ********
+ *
+ * Returns a live segment
+ *
+ * Parameters: 
+ *      Segments_T Segments: table to search
+ *      uint32_t seg_ID: identifier of a mapped segment
+ * Return: 
+ *      the Segment holding the segment's words
+ *
+ * Expects:
+ *      seg_ID must identify a mapped segment
+ * Notes:
+ *      Will CRE if seg_ID was never mapped or has been unmapped
+ *****************************/
+static inline Segment *segment_at(Segments_T Segments, uint32_t seg_ID)
+{
+        Slot slot = *slot_at(Segments, seg_ID);
+        assert(slot != 0 && !IS_FREE(slot));
+        return (Segment *)slot;
+}
+
+/********** new_segment ********
+ *
+ * Allocates a segment and its words from the arena
+ *
+ * Parameters: 
+ *      Segments_T Segments: owner of the arena
+ *      uint32_t length: number of words
+ *      bool zero: whether the words must start out as 0
+ * Return: 
+ *      the new Segment
+ *****************************/
+static Segment *new_segment(Segments_T Segments, uint32_t length, bool zero)
+{
+        size_t bytes = SEGMENT_BYTES(length);
+        Segment *segment = zero ? arena_calloc(Segments->arena, bytes)
+                                : arena_alloc(Segments->arena, bytes);
+        segment->length = length;
+        segment->kind = SEG_DENSE;
+        segment->touched = TOUCHED;
+        segment->words = (uint32_t *)(segment + 1);
+        return segment;
+}
+
+/********** release_segment ********
+ *
+ * Returns a segment and its words to the arena
+ *
+ * Parameters: 
+ *      Segments_T Segments: owner of the arena
+ *      Segment *segment: the segment, which must no longer be in the table
+ * Return: None
+ *****************************/
+static void release_segment(Segments_T Segments, Segment *segment)
+{
+        if (segment->kind == SEG_DENSE) {
+                arena_release(Segments->arena, segment, 
+                              SEGMENT_BYTES(segment->length));
+                return;
+        }
+        if (segment->kind == SEG_COLD) {
+                Segments->usage.cold_segments--;
+                Segments->usage.cold_bytes -= (uint64_t)segment->length * 4;
+                Segments->usage.packed_bytes -= PACKED(segment)->bytes;
+                arena_release(Segments->arena, PACKED(segment), 
+                              PACKED_BYTES(PACKED(segment)));
+                arena_release(Segments->arena, segment, sizeof(Segment));
+                return;
+        }
+        if (segment->kind == SEG_SHARED) {
+                Segments->usage.shared_segments--;
+                Segments->usage.shared_bytes -= (uint64_t)segment->length * 4;
+                dedup_release(segment->words);
+                arena_release(Segments->arena, segment, sizeof(Segment));
+                return;
+        }
+        uint32_t **pages = PAGES(segment);
+        for (size_t i = 0; i < PAGE_COUNT(segment->length); i++) {
+                if (pages[i] != zero_page) {
+                        arena_release(Segments->arena, pages[i], 
+                                      PAGE_WORDS * 4);
+                        Segments->usage.sparse_pages--;
+                }
+        }
+        arena_release(Segments->arena, segment, 
+                      SPARSE_BYTES(segment->length));
+}
+
+/********** new_sparse_segment ********
+ *
+ * Allocates a sparse segment whose pages all start out as the shared
+ * zero page
+ *
+ * Parameters: 
+ *      Segments_T Segments: owner of the arena
+ *      uint32_t length: number of words
+ * Return: 
+ *      the new Segment
+ *****************************/
+static Segment *new_sparse_segment(Segments_T Segments, uint32_t length)
+{
+        Segment *segment = arena_alloc(Segments->arena, 
+                                       SPARSE_BYTES(length));
+        segment->length = length;
+        segment->kind = SEG_SPARSE;
+        segment->touched = TOUCHED;
+        segment->words = NULL;
+        uint32_t **pages = PAGES(segment);
+        for (size_t i = 0; i < PAGE_COUNT(length); i++) {
+                pages[i] = (uint32_t *)zero_page;
+        }
+        return segment;
+}
+
+/********** sparse_word ********
+ *
+ * Returns the address of a word of a sparse segment for writing, giving
+ * its page memory of its own on the first write
+ *
+ * Parameters: 
+ *      Segments_T Segments: owner of the arena
+ *      Segment *segment: a sparse segment
+ *      uint32_t offset: index of the word, less than the segment length
+ * Return: 
+ *      pointer to the word
+ *****************************/
+static uint32_t *sparse_word(Segments_T Segments, Segment *segment, 
+                             uint32_t offset)
+{
+        uint32_t **page = &PAGES(segment)[offset >> PAGE_BITS];
+        if (*page == zero_page) {
+                *page = arena_calloc(Segments->arena, PAGE_WORDS * 4);
+                Segments->usage.sparse_pages++;
+        }
+        return &(*page)[offset & (PAGE_WORDS - 1)];
+}
+
+/********** thaw ********
+ *
+ * Decompresses a cold segment back into a dense one, replacing it in the
+ * table, and accounts the time taken as a fault-in
+ *
+ * Parameters: 
+ *      Segments_T Segments: owner of the segment
+ *      uint32_t seg_ID: the segment's ID
+ *      Segment *cold: the cold segment
+ * Return: 
+ *      the dense segment
+ *****************************/
+static Segment *thaw(Segments_T Segments, uint32_t seg_ID, Segment *cold)
+{
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        Segment *segment = new_segment(Segments, cold->length, false);
+        lz_decompress(PACKED(cold)->data, PACKED(cold)->bytes, 
+                      (uint8_t *)segment->words, (size_t)cold->length * 4);
+        release_segment(Segments, cold);
+        *slot_at(Segments, seg_ID) = (Slot)segment;
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        Segments->usage.thaws++;
+        Segments->usage.thaw_ns += (uint64_t)(end.tv_sec - start.tv_sec) * 
+                                   1000000000 + end.tv_nsec - start.tv_nsec;
+        return segment;
+}
+
+/********** freeze ********
+ *
+ * Compresses a dense segment into the cold tier if that saves at least a
+ * quarter of its size; otherwise marks it INCOMPRESSIBLE
+ *
+ * Parameters: 
+ *      Segments_T Segments: owner of the segment
+ *      Segment *segment: a dense segment of at least COLD_MIN_WORDS words
+ * Return: 
+ *      the cold segment, or segment itself if it was not compressed
+ *****************************/
+static Segment *freeze(Segments_T Segments, Segment *segment)
+{
+        size_t raw = (size_t)segment->length * 4;
+        if (Segments->scratch_bytes < raw) {
+                free(Segments->scratch);
+                Segments->scratch_bytes = raw;
+                Segments->scratch = ALLOC(raw);
+                assert(Segments->scratch != NULL);
+        }
+        size_t bytes = lz_compress((const uint8_t *)segment->words, raw, 
+                                   Segments->scratch, raw - raw / 4);
+        if (bytes == 0) {
+                segment->touched = INCOMPRESSIBLE;
+                return segment;
+        }
+
+        Packed *packed = arena_alloc(Segments->arena, sizeof(Packed) + bytes);
+        packed->bytes = (uint32_t)bytes;
+        memcpy(packed->data, Segments->scratch, bytes);
+        Segment *cold = arena_alloc(Segments->arena, sizeof(Segment));
+        cold->length = segment->length;
+        cold->kind = SEG_COLD;
+        cold->touched = IDLE;
+        cold->words = (uint32_t *)packed;
+        release_segment(Segments, segment);
+
+        Segments->usage.cold_segments++;
+        Segments->usage.cold_bytes += raw;
+        Segments->usage.packed_bytes += bytes;
+        Segments->usage.freezes++;
+        return cold;
+}
+
+/********** shared_segment ********
+ *
+ * Allocates the header of a shared segment for words the caller holds a
+ * reference to
+ *
+ * Parameters: 
+ *      Segments_T Segments: owner of the arena
+ *      const uint32_t *words: words from the dedup store
+ *      uint32_t length: number of words
+ * Return: 
+ *      the new Segment, which now owns the reference
+ *****************************/
+static Segment *shared_segment(Segments_T Segments, const uint32_t *words,
+                               uint32_t length)
+{
+        Segment *segment = arena_alloc(Segments->arena, sizeof(Segment));
+        segment->length = length;
+        segment->kind = SEG_SHARED;
+        segment->touched = TOUCHED;
+        segment->words = (uint32_t *)words;
+        Segments->usage.shared_segments++;
+        Segments->usage.shared_bytes += (uint64_t)length * 4;
+        return segment;
+}
+
+/********** unshare ********
+ *
+ * Gives a shared segment words of its own before it is written, replacing
+ * it in the table
+ *
+ * Parameters: 
+ *      Segments_T Segments: owner of the segment
+ *      uint32_t seg_ID: the segment's ID
+ *      Segment *shared: the shared segment
+ * Return: 
+ *      the dense segment
+ *****************************/
+static Segment *unshare(Segments_T Segments, uint32_t seg_ID, 
+                        Segment *shared)
+{
+        Segment *segment = new_segment(Segments, shared->length, false);
+        memcpy(segment->words, shared->words, (size_t)shared->length * 4);
+        release_segment(Segments, shared);
+        *slot_at(Segments, seg_ID) = (Slot)segment;
+        Segments->usage.unshares++;
+        return segment;
+}
+
+/********** charge ********
+ *
+ * Adjusts the accounting for a change in live words and segments, refusing
+ * the change if it would exceed a hard limit and reporting when usage rises
+ * above a soft limit
+ *
+ * Parameters: 
+ *      Segments_T Segments: segments being charged
+ *      int64_t words: change in live words
+ *      int32_t segments: change in live segments
+ * Return: 
+ *      true if the change was applied, false if a hard limit refused it
+ *
+ * Expects:
+ *      Segments must not be NULL
+ * Notes:
+ *      Releases (negative changes) are never refused
+ *****************************/
+static bool charge(Segments_T Segments, int64_t words, int32_t segments)
+{
+        Segments_usage *usage = &Segments->usage;
+        Segments_limits *limits = &Segments->limits;
+        uint64_t new_words = usage->live_words + words;
+        uint32_t new_segments = usage->live_segments + segments;
+
+        if ((words > 0 && limits->hard_words != 0 && 
+             new_words > limits->hard_words) ||
+            (segments > 0 && limits->hard_segments != 0 && 
+             new_segments > limits->hard_segments)) {
+                return false;
+        }
+        usage->live_words = new_words;
+        usage->live_segments = new_segments;
+        if (new_words > usage->peak_words) {
+                usage->peak_words = new_words;
+        }
+        if (new_segments > usage->peak_segments) {
+                usage->peak_segments = new_segments;
+        }
+
+        /* Report crossing a soft limit once; re-arm only after usage falls
+           to three quarters of the limit so a UM hovering at the limit
+           does not report on every map */
+        if (!Segments->over_soft) {
+                bool over = (limits->soft_words != 0 && 
+                             new_words > limits->soft_words) ||
+                            (limits->soft_segments != 0 && 
+                             new_segments > limits->soft_segments);
+                if (over && limits->on_soft_limit != NULL) {
+                        limits->on_soft_limit(limits->cl, *usage);
+                }
+                Segments->over_soft = over;
+        } else {
+                Segments->over_soft = 
+                        (limits->soft_words != 0 && 
+                         new_words > limits->soft_words / 4 * 3) ||
+                        (limits->soft_segments != 0 && 
+                         new_segments > limits->soft_segments / 4 * 3);
+        }
+        return true;
+}
+
 /********** initialize_Segments ********
  *
  * Allocate memory for a Segments_T struct and returns it 
@@ -54,47 +597,234 @@ struct Segments_T {
  *****************************/
 extern Segments_T initialize_Segments()
 {
-        Segments_T new_segments = ALLOC(sizeof(struct Segments_T));
+        Segments_T new_segments = CALLOC(1, sizeof(struct Segments_T));
         assert(new_segments);
-        new_segments->segments = Seq_new(10);
-        new_segments->unmapped_ids = Seq_new(10);
+        new_segments->arena = arena_new();
+        new_segments->next_id = 0;
+        new_segments->free_head = NO_FREE_ID;
         return new_segments;
 }
 
-/********** free_Segments ********
+/********** initialize_Segments_file ********
  *
- * Deallocates heal memory allocated for segments 
- * Reuse an available ID if able
+ * Creates segments whose memory is a file-backed arena, so that they may
+ * exceed RAM, or resumes segments checkpointed to such a file earlier
  *
  * Parameters: 
- * 	uint32_t length: length of the segment for memory allocation 
- *  	Segments_T segments: modify segments to add one with given length
+ *      const char *path: the backing file
+ *      uint64_t bytes: most bytes of segment memory, when creating
+ *      uint32_t *state: NULL to create or truncate the file; otherwise the
+ *                       file is resumed from its checkpoint and state
+ *                       receives the SEGMENT_STATE_WORDS words saved with it
+ * Return: 
+ *      the segments, or NULL if the file cannot be created or mapped, or
+ *      has no checkpoint to resume
+ *
+ * Expects:
+ *      path must not be NULL
+ * Notes:
+ *      Will CRE if path is NULL or allocation fails
+ *      A resumed table starts with no limits; its sparse threshold and
+ *      usage are those of the checkpoint
+ *****************************/
+extern Segments_T initialize_Segments_file(const char *path, uint64_t bytes,
+                                           uint32_t *state)
+{
+        assert(path != NULL);
+        Arena_T arena = arena_new_file(path, bytes, state != NULL);
+        if (arena == NULL) {
+                return NULL;
+        }
+        Directory *directory = *arena_root(arena);
+        if (state != NULL && directory == NULL) {
+                arena_free(&arena);
+                return NULL;
+        }
+
+        Segments_T new_segments = CALLOC(1, sizeof(struct Segments_T));
+        assert(new_segments);
+        new_segments->arena = arena;
+        new_segments->free_head = NO_FREE_ID;
+        if (state == NULL) {
+                return new_segments;
+        }
+
+        memcpy(state, directory->state, sizeof(directory->state));
+        new_segments->free_head = directory->free_head;
+        new_segments->usage = directory->usage;
+        new_segments->sparse_length = directory->sparse_length;
+        new_segments->directory = directory;
+        for (uint32_t seg_ID = 0; seg_ID < directory->next_id; seg_ID++) {
+                new_slot(new_segments);
+                Slot slot = directory->slots[seg_ID];
+                *slot_at(new_segments, seg_ID) = slot;
+
+                /* Point untouched pages at this process's zero_page */
+                Segment *segment = (Segment *)slot;
+                if (slot == 0 || IS_FREE(slot) || 
+                    segment->kind != SEG_SPARSE || 
+                    directory->zero_page == zero_page) {
+                        continue;
+                }
+                uint32_t **pages = PAGES(segment);
+                for (size_t i = 0; i < PAGE_COUNT(segment->length); i++) {
+                        if (pages[i] == directory->zero_page) {
+                                pages[i] = (uint32_t *)zero_page;
+                        }
+                }
+        }
+        directory->zero_page = zero_page;
+        return new_segments;
+}
+
+/********** copy_segment ********
+ *
+ * Copies a live segment into another table's arena, keeping its kind,
+ * except that a dense segment as long as the table's dedup threshold is
+ * shared instead
+ *
+ * Parameters: 
+ *      Segments_T Segments: the table that will own the copy
+ *      const Segment *source: the segment to copy
+ * Return: 
+ *      the copy
+ *****************************/
+static Segment *copy_segment(Segments_T Segments, const Segment *source)
+{
+        if (source->kind == SEG_SHARED) {
+                dedup_retain(source->words);
+                return shared_segment(Segments, source->words, 
+                                      source->length);
+        }
+        if (source->kind == SEG_DENSE && Segments->dedup_length != 0 &&
+            source->length >= Segments->dedup_length) {
+                return shared_segment(Segments, 
+                                      dedup_intern(source->words, 
+                                                   source->length),
+                                      source->length);
+        }
+        if (source->kind == SEG_DENSE) {
+                Segment *segment = new_segment(Segments, source->length, 
+                                               false);
+                memcpy(segment->words, source->words, 
+                       (size_t)source->length * 4);
+                return segment;
+        }
+        if (source->kind == SEG_COLD) {
+                const Packed *packed = PACKED(source);
+                Packed *copy = arena_alloc(Segments->arena, 
+                                           PACKED_BYTES(packed));
+                memcpy(copy, packed, PACKED_BYTES(packed));
+                Segment *segment = arena_alloc(Segments->arena, 
+                                               sizeof(Segment));
+                *segment = *source;
+                segment->words = (uint32_t *)copy;
+                return segment;
+        }
+
+        Segment *segment = new_sparse_segment(Segments, source->length);
+        uint32_t **from = PAGES(source);
+        uint32_t **to = PAGES(segment);
+        for (size_t i = 0; i < PAGE_COUNT(source->length); i++) {
+                if (from[i] != zero_page) {
+                        to[i] = arena_alloc(Segments->arena, PAGE_WORDS * 4);
+                        memcpy(to[i], from[i], PAGE_WORDS * 4);
+                }
+        }
+        return segment;
+}
+
+/********** copy_Segments ********
+ *
+ * Creates an independent copy of a table of segments, with the same IDs,
+ * contents, recycled IDs, usage and settings, in anonymous memory. Shared
+ * segments stay shared, and so are dense segments of at least the dedup
+ * threshold, which makes copying a snapshot the time their contents are
+ * matched with those of other tables.
+ *
+ * Parameters: 
+ *      Segments_T source: the segments to copy
  * Return: 
- * 	segment ID
+ *      the copy
+ *
+ * Expects:
+ *      source must not be NULL
+ * Notes:
+ *      Will CRE if source is NULL or allocation fails
+ *      Only reads source, so several threads may copy one table at once
+ *      as long as none of them changes it
+ *****************************/
+extern Segments_T copy_Segments(Segments_T source)
+{
+        assert(source != NULL);
+        Segments_T copy = initialize_Segments();
+        copy->free_head = source->free_head;
+        copy->limits = source->limits;
+        copy->over_soft = source->over_soft;
+        copy->sparse_length = source->sparse_length;
+        copy->dedup_length = source->dedup_length;
+        copy->track_use = source->track_use;
+        for (uint32_t seg_ID = 0; seg_ID < source->next_id; seg_ID++) {
+                Slot slot = *slot_at(source, seg_ID);
+                new_slot(copy);
+                if (slot != 0 && !IS_FREE(slot)) {
+                        slot = (Slot)copy_segment(copy, (Segment *)slot);
+                }
+                *slot_at(copy, seg_ID) = slot;
+        }
+        Segments_usage shared = copy->usage;
+        copy->usage = source->usage;
+        copy->usage.shared_segments = shared.shared_segments;
+        copy->usage.shared_bytes = shared.shared_bytes;
+        return copy;
+}
+
+/********** free_Segments ********
+ *
+ * Deallocates heap memory allocated for segments. Every segment lives in
+ * the arena, so the live segments are released by unmapping the arena
+ * rather than one at a time; only the radix table is walked, and only
+ * to give back the words of shared segments.
+ *
+ * Parameters: 
+ *  	Segments_T *Segments: pointer to the segments to free
+ * Return: None
  *
  * Expects:
- * 	There is enough heap space to allocate 
+ * 	Segments and *Segments must not be NULL
  *
  * Notes:
- * 	Will CRE if input_um is NULL
+ * 	Will CRE if Segments or *Segments is NULL
  *****************************/
 extern void free_Segments(Segments_T* Segments)
 {
         assert(Segments != NULL && *Segments != NULL);
-        Seq_T all_segments = (*Segments)->segments;
+        Segments_T table = *Segments;
 
-        /* Loop through all segments and free nonnull instruction segments */
-        for (int i = 0; i < Seq_length(all_segments); i++) {
-                Seq_T curr = Seq_get(all_segments, i);
-                if (curr != NULL) {
-                        Seq_free(&curr);
+        /* Shared words are not in the arena, so give them back first */
+        for (uint32_t seg_ID = 0; 
+             table->usage.shared_segments != 0 && seg_ID < table->next_id;
+             seg_ID++) {
+                Slot slot = *slot_at(table, seg_ID);
+                if (slot != 0 && !IS_FREE(slot) && 
+                    ((Segment *)slot)->kind == SEG_SHARED) {
+                        release_segment(table, (Segment *)slot);
                 }
         }
-
-        /* Free any remaining memory */
-        Seq_free(&((*Segments)->segments));
-        Seq_free(&((*Segments)->unmapped_ids));
-        free(*Segments);
+        arena_free(&table->arena);
+        free(table->scratch);
+        for (uint32_t t = 0; t < TOP_SIZE; t++) {
+                Slot **mid = table->top[t];
+                if (mid == NULL) {
+                        continue;
+                }
+                for (uint32_t m = 0; m < MID_SIZE; m++) {
+                        free(mid[m]);
+                }
+                free(mid);
+        }
+        free(table);
+        *Segments = NULL;
 }
 
 /********** map_segment ********
@@ -107,7 +837,8 @@ extern void free_Segments(Segments_T* Segments)
  * 	uint32_t length: length of the segment for memory allocation 
  *  	Segments_T segments: sequence of segments to be added to 
  * Return: 
- * 	uint32_t map_id: a unique identifier for the newly mapped segment 
+ * 	uint32_t map_id: a unique identifier for the newly mapped segment, or
+ * 	SEGMENT_FAULT if a hard limit refused the mapping
  *
  * Expects:
  * 	Segments must not be null
@@ -118,24 +849,28 @@ extern void free_Segments(Segments_T* Segments)
 extern uint32_t map_segment(Segments_T Segments, uint32_t length)
 {
         assert(Segments != NULL);
-        Seq_T new_segment = Seq_new(length);
-        Seq_addhi(new_segment, (void*)(uintptr_t)0);
-
-        /* Initialize each word in the new segment to 0 */
-        for (uint32_t i = 1; i < length; i++) {
-                Seq_addhi(new_segment, (void*)(uintptr_t)0);
+        if (!charge(Segments, length, 1)) {
+                return SEGMENT_FAULT;
         }
-
         uint32_t map_id;
-        /* check if there are IDs available in unmapped_id */
-        if (Seq_length(Segments->unmapped_ids) > 0) {
-                map_id = (uint32_t)(uintptr_t)
-                          Seq_remhi(Segments->unmapped_ids);
-                Seq_put(Segments->segments, map_id, new_segment);
+        /* Pop a recycled ID if there is one, otherwise take a fresh one */
+        if (Segments->free_head != NO_FREE_ID) {
+                map_id = Segments->free_head;
+                Segments->free_head = NEXT_FREE(*slot_at(Segments, map_id));
+        } else {
+                map_id = new_slot(Segments);
+        }
+
+        /* Every word in the new segment starts out as 0. Segment 0 is
+           always dense, since every instruction is fetched from it. */
+        Segment *segment;
+        if (Segments->sparse_length != 0 && 
+            length >= Segments->sparse_length && map_id != 0) {
+                segment = new_sparse_segment(Segments, length);
         } else {
-                map_id = (uint32_t)Seq_length(Segments->segments);
-                Seq_addhi(Segments->segments, new_segment);
+                segment = new_segment(Segments, length, true);
         }
+        *slot_at(Segments, map_id) = (Slot)segment;
         return map_id;
 }
 
@@ -151,25 +886,24 @@ extern uint32_t map_segment(Segments_T Segments, uint32_t length)
  *
  * Expects:
  *      Segments must not be null 
- *      seg_ID must be within range, ie. less than the total number of segments 
+ *      seg_ID must identify a mapped segment
  *
  * Notes:
  *      Will CRE if Segments is null 
- *      Will CRE if seg_ID is out of range i.e. greater than number of segments 
+ *      Will CRE if seg_ID is not a mapped segment
  *****************************/
 extern void unmap_segment(Segments_T Segments, uint32_t seg_ID)
 {
         assert(Segments != NULL);
-        assert(seg_ID < (uint32_t)Seq_length(Segments->segments));
 
         /* Retrieve and free segment of instructions at target ID */
-        Seq_T instructions = Seq_get(Segments->segments, seg_ID);
-        assert(instructions != NULL);
-        Seq_free(&instructions);
-        Seq_put(Segments->segments, seg_ID, NULL);
+        Segment *instructions = segment_at(Segments, seg_ID);
+        charge(Segments, -(int64_t)instructions->length, -1);
+        release_segment(Segments, instructions);
 
-        /* Recycle unmapped ID */
-        Seq_addhi(Segments->unmapped_ids, (void*)(uintptr_t)seg_ID);
+        /* Recycle unmapped ID by pushing it onto the free stack */
+        *slot_at(Segments, seg_ID) = FREE_SLOT(Segments->free_head);
+        Segments->free_head = seg_ID;
 }
 
 /********** get_word ********
@@ -185,24 +919,30 @@ extern void unmap_segment(Segments_T Segments, uint32_t seg_ID)
  *
  * Expects:
  *      - Segments must not be null
- *      - source ID must be within valid index range, ie. less than the number 
- *        of segments 
+ *      - source ID must identify a mapped segment
  *      - offset must be a valid index, ie. less the length of the segment 
  *
  * Notes:
  *      - Will CRE if Segments is null
- *      - Will CRE if source_ID is greater than the number of segments or 
+ *      - Will CRE if source_ID is not mapped or 
  *        if offset greater than segment length
  *****************************/
 extern uint32_t get_word(Segments_T Segments, uint32_t seg_ID, uint32_t offset)
 {
         assert(Segments != NULL);
-        assert(seg_ID < (uint32_t)Seq_length(Segments->segments));
-        assert(offset < (uint32_t)Seq_length(Seq_get(Segments->segments, 
-               seg_ID)));
+        Segment *segment = segment_at(Segments, seg_ID);
+        assert(offset < segment->length);
         
-        return (uintptr_t)Seq_get(Seq_get(Segments->segments, (int)(seg_ID)), 
-                                  (int)offset);
+        if (segment->kind == SEG_DENSE || segment->kind == SEG_SHARED) {
+                if (Segments->track_use && seg_ID != 0) {
+                        segment->touched = TOUCHED;
+                }
+                return segment->words[offset];
+        }
+        if (segment->kind == SEG_COLD) {
+                return thaw(Segments, seg_ID, segment)->words[offset];
+        }
+        return PAGES(segment)[offset >> PAGE_BITS][offset & (PAGE_WORDS - 1)];
 }       
 
 /********** set_word ********
@@ -219,25 +959,33 @@ extern uint32_t get_word(Segments_T Segments, uint32_t seg_ID, uint32_t offset)
  *
  * Expects:
  *      - Segments must not be null
- *      - source ID must be within valid index range, ie. less than the number 
- *        of segments 
+ *      - source ID must identify a mapped segment
  *      - offset must be a valid index, ie. less the length of the segment 
  *
  * Notes:
  *      - Will CRE if Segments is null
- *      - Will CRE if source_ID is greater than the number of segments or 
+ *      - Will CRE if source_ID is not mapped or 
  *        if offset greater than segment length
  *****************************/
 extern void set_word(Segments_T Segments, uint32_t seg_ID, uint32_t offset,
                      uint32_t value)
 {
         assert(Segments != NULL);
-        assert(seg_ID < (uint32_t)Seq_length(Segments->segments));
-        assert(offset < (uint32_t)Seq_length(Seq_get(Segments->segments, 
-               seg_ID)));
+        Segment *segment = segment_at(Segments, seg_ID);
+        assert(offset < segment->length);
 
-        Seq_put(Seq_get(Segments->segments, (int)(seg_ID)), (int)offset, 
-                (void*)(uintptr_t)value);
+        if (segment->kind == SEG_DENSE) {
+                if (Segments->track_use && seg_ID != 0) {
+                        segment->touched = TOUCHED;
+                }
+                segment->words[offset] = value;
+        } else if (segment->kind == SEG_COLD) {
+                thaw(Segments, seg_ID, segment)->words[offset] = value;
+        } else if (segment->kind == SEG_SHARED) {
+                unshare(Segments, seg_ID, segment)->words[offset] = value;
+        } else {
+                *sparse_word(Segments, segment, offset) = value;
+        }
 }
 
 /********** duplicate ********
@@ -248,39 +996,713 @@ extern void set_word(Segments_T Segments, uint32_t seg_ID, uint32_t offset,
  *      Segments_T segments: where the duplication takes place
  *      uint32_t source_ID: positions of the source segment   
  *  	
- * Return: uint32_t size of the duplicated segment
+ * Return: uint32_t size of the duplicated segment, or SEGMENT_FAULT if a
+ *         hard limit refused the copy
  *
  * Expects:
  *      - Segments must not be null
- *      - source ID must be within valid index range, ie. less than the number 
- *        of segments 
+ *      - source ID must identify a mapped segment
  *      - offset must be a valid index, ie. less the length of the segment 
  *
  * Notes:
- *      - Will CRE if source_ID is greater than the number of segments or 
+ *      - Will CRE if source_ID is not mapped or 
  *        if offset greater than segment length
  *****************************/
 extern uint32_t duplicate(Segments_T Segments, uint32_t source_ID)
 {
         assert(Segments != NULL);
-        assert(source_ID < (uint32_t)Seq_length(Segments->segments));
 
         /* If source segment is segment 0, return the length of segment 0 */
         if (source_ID == 0) {
-                return Seq_length(Seq_get(Segments->segments, 0));
+                return segment_at(Segments, 0)->length;
         }
-        Seq_T words = Seq_new(256);
-
         /* Get previous segment 0 */
-        Seq_T source_seg = Seq_get(Segments->segments, source_ID); 
-        for (int i = 0; i < Seq_length(source_seg); i++) {
-                Seq_addhi(words, Seq_get(source_seg, i));
+        Segment *source_seg = segment_at(Segments, source_ID); 
+        if (source_seg->kind == SEG_COLD) {
+                source_seg = thaw(Segments, source_ID, source_seg);
+        }
+        Segment *seg0 = segment_at(Segments, 0);
+        if (!charge(Segments, (int64_t)source_seg->length - seg0->length, 
+                    0)) {
+                return SEGMENT_FAULT;
+        }
+
+        Segment *words = new_segment(Segments, source_seg->length, false);
+        if (source_seg->kind == SEG_DENSE || source_seg->kind == SEG_SHARED) {
+                memcpy(words->words, source_seg->words, 
+                       (size_t)source_seg->length * 4);
+        } else {
+                /* Segment 0 is always dense, so spread the pages out */
+                uint32_t **pages = PAGES(source_seg);
+                for (uint32_t i = 0; i < source_seg->length; 
+                     i += PAGE_WORDS) {
+                        uint32_t n = source_seg->length - i;
+                        memcpy(&words->words[i], pages[i >> PAGE_BITS], 
+                               (size_t)(n < PAGE_WORDS ? n : PAGE_WORDS) * 4);
+                }
         }
         
-        Seq_T seg0 = Seq_get(Segments->segments, 0);
-        Seq_free(&seg0); /* Deallocate previous segment 0 */
+        release_segment(Segments, seg0); /* Deallocate previous segment 0 */
         /* Put new duplicated segment into segment 0 */
-        Seq_put(Segments->segments, 0, (void*)words); 
-        return Seq_length(words);
+        *slot_at(Segments, 0) = (Slot)words; 
+        return words->length;
+
+}
 
-}
\ No newline at end of file
+/********** set_segment_limits ********
+ *
+ * Installs soft and hard quotas on live words and segments. Usage already
+ * above a new hard limit is kept, but no further growth is allowed.
+ *
+ * Parameters: 
+ *      Segments_T Segments: segments to limit
+ *      Segments_limits limits: the quotas, 0 meaning unlimited
+ * Return: None
+ *
+ * Expects:
+ *      Segments must not be null
+ * Notes:
+ *      Will CRE if Segments is null
+ *****************************/
+extern void set_segment_limits(Segments_T Segments, Segments_limits limits)
+{
+        assert(Segments != NULL);
+        Segments->limits = limits;
+        Segments->over_soft = false;
+        charge(Segments, 0, 0); /* Report if already above a soft limit */
+}
+
+/********** segment_usage ********
+ *
+ * Returns the live and peak word and segment counts, and the bytes the
+ * arena has mapped in total and advised for huge pages
+ *
+ * Parameters: 
+ *      Segments_T Segments: segments to report on
+ * Return: 
+ *      a copy of the current usage
+ *
+ * Expects:
+ *      Segments must not be null
+ * Notes:
+ *      Will CRE if Segments is null
+ *****************************/
+extern Segments_usage segment_usage(Segments_T Segments)
+{
+        assert(Segments != NULL);
+        Segments_usage usage = Segments->usage;
+        usage.mapped_bytes = arena_mapped(Segments->arena);
+        usage.huge_bytes = arena_huge(Segments->arena);
+        return usage;
+}
+
+/********** set_deferred_reclaim ********
+ *
+ * Makes unmapping a segment of at least the given length hand its memory
+ * to the reclamation thread, so the unmap never waits on munmap
+ *
+ * Parameters: 
+ *      Segments_T Segments: segments to configure
+ *      uint32_t length: threshold in words, or 0 to release all segments
+ *                       on the calling thread
+ * Return: None
+ *
+ * Expects:
+ *      Segments must not be null
+ * Notes:
+ *      Will CRE if Segments is null
+ *      Only segments large enough to have a mapping of their own can be
+ *      deferred, so smaller thresholds act like that minimum
+ *****************************/
+extern void set_deferred_reclaim(Segments_T Segments, uint32_t length)
+{
+        assert(Segments != NULL);
+        arena_set_deferred(Segments->arena, 
+                           length == 0 ? 0 : SEGMENT_BYTES(length));
+}
+
+/********** set_hugepage_policy ********
+ *
+ * Chooses which segment memory is backed by transparent huge pages. The
+ * default aligns and advises every segment of 2 MiB or more, including a
+ * large segment 0.
+ *
+ * Parameters: 
+ *      Segments_T Segments: segments to configure
+ *      Arena_huge policy: the policy for memory mapped from now on
+ * Return: None
+ *
+ * Expects:
+ *      Segments must not be null
+ * Notes:
+ *      Will CRE if Segments is null
+ *****************************/
+extern void set_hugepage_policy(Segments_T Segments, Arena_huge policy)
+{
+        assert(Segments != NULL);
+        arena_set_huge(Segments->arena, policy);
+}
+
+/********** set_sparse_threshold ********
+ *
+ * Makes segments of at least the given length, other than segment 0, be
+ * mapped sparse: their words are kept in 4 KB pages that read as shared
+ * zeros until first written
+ *
+ * Parameters: 
+ *      Segments_T Segments: segments to configure
+ *      uint32_t length: threshold in words, or 0 to map every segment dense
+ * Return: None
+ *
+ * Expects:
+ *      Segments must not be null
+ * Notes:
+ *      Will CRE if Segments is null
+ *      Applies to segments mapped from now on
+ *****************************/
+extern void set_sparse_threshold(Segments_T Segments, uint32_t length)
+{
+        assert(Segments != NULL);
+        Segments->sparse_length = length;
+}
+
+/********** set_dedup_threshold ********
+ *
+ * Makes dense segments of at least the given length be shared with
+ * identical segments of other tables when this table is copied or passed
+ * to share_segments
+ *
+ * Parameters: 
+ *      Segments_T Segments: segments to configure
+ *      uint32_t length: threshold in words, or 0 to never share
+ * Return: None
+ *
+ * Expects:
+ *      Segments must not be null
+ * Notes:
+ *      Will CRE if Segments is null
+ *****************************/
+extern void set_dedup_threshold(Segments_T Segments, uint32_t length)
+{
+        assert(Segments != NULL);
+        Segments->dedup_length = length;
+}
+
+/********** set_use_tracking ********
+ *
+ * Turns on or off the marking of segments as accessed, which
+ * freeze_cold_segments relies on to find idle segments. Off, reads and
+ * writes cost no store to the segment's header.
+ *
+ * Parameters: 
+ *      Segments_T Segments: segments to configure
+ *      bool on: whether cold sweeps will be run
+ * Return: None
+ *
+ * Expects:
+ *      Segments must not be null
+ * Notes:
+ *      Will CRE if Segments is null
+ *      Turning tracking on marks every dense segment accessed, so none
+ *      is compressed by the first sweep after it
+ *****************************/
+extern void set_use_tracking(Segments_T Segments, bool on)
+{
+        assert(Segments != NULL);
+        if (on && !Segments->track_use) {
+                for (uint32_t seg_ID = 1; seg_ID < Segments->next_id; 
+                     seg_ID++) {
+                        Slot slot = *slot_at(Segments, seg_ID);
+                        if (slot != 0 && !IS_FREE(slot) &&
+                            ((Segment *)slot)->kind == SEG_DENSE) {
+                                ((Segment *)slot)->touched = TOUCHED;
+                        }
+                }
+        }
+        Segments->track_use = on;
+}
+
+/********** share_segments ********
+ *
+ * Replaces every dense segment of at least the dedup threshold with a
+ * shared one, so that copies of the table share its words instead of
+ * matching them again
+ *
+ * Parameters: 
+ *      Segments_T Segments: segments in anonymous memory
+ * Return: 
+ *      number of segments shared
+ *
+ * Expects:
+ *      Segments must not be null or backed by a file, whose checkpoints
+ *      cannot refer to memory outside it
+ * Notes:
+ *      Will CRE if Segments is null
+ *      Must only run at a safe point, like compact_segments
+ *****************************/
+extern uint32_t share_segments(Segments_T Segments)
+{
+        assert(Segments != NULL);
+        uint32_t length = Segments->dedup_length;
+        uint32_t shared = 0;
+        for (uint32_t seg_ID = 0; length != 0 && seg_ID < Segments->next_id;
+             seg_ID++) {
+                Slot *slot = slot_at(Segments, seg_ID);
+                if (*slot == 0 || IS_FREE(*slot)) {
+                        continue;
+                }
+                Segment *segment = (Segment *)*slot;
+                if (segment->kind != SEG_DENSE || segment->length < length) {
+                        continue;
+                }
+                const uint32_t *words = dedup_intern(segment->words, 
+                                                     segment->length);
+                *slot = (Slot)shared_segment(Segments, words, 
+                                             segment->length);
+                release_segment(Segments, segment);
+                shared++;
+        }
+        return shared;
+}
+
+/********** move_segment ********
+ *
+ * Moves a live segment, and the written pages of a sparse segment, next
+ * to the blocks moved before it during a compaction
+ *
+ * Parameters: 
+ *      Segments_T Segments: owner of the arena, which is compacting
+ *      Segment *segment: the segment
+ * Return: 
+ *      the segment's new address
+ *****************************/
+static Segment *move_segment(Segments_T Segments, Segment *segment)
+{
+        if (segment->kind == SEG_DENSE) {
+                segment = arena_move(Segments->arena, segment, 
+                                     SEGMENT_BYTES(segment->length));
+                segment->words = (uint32_t *)(segment + 1);
+                return segment;
+        }
+        if (segment->kind == SEG_SHARED) {
+                return arena_move(Segments->arena, segment, sizeof(Segment));
+        }
+        if (segment->kind == SEG_COLD) {
+                Packed *packed = PACKED(segment);
+                packed = arena_move(Segments->arena, packed, 
+                                    PACKED_BYTES(packed));
+                segment = arena_move(Segments->arena, segment, 
+                                     sizeof(Segment));
+                segment->words = (uint32_t *)packed;
+                return segment;
+        }
+
+        /* Move the pages through the old table, then the table itself */
+        uint32_t **pages = PAGES(segment);
+        for (size_t i = 0; i < PAGE_COUNT(segment->length); i++) {
+                if (pages[i] != zero_page) {
+                        pages[i] = arena_move(Segments->arena, pages[i], 
+                                              PAGE_WORDS * 4);
+                }
+        }
+        return arena_move(Segments->arena, segment, 
+                          SPARSE_BYTES(segment->length));
+}
+
+/********** compact_segments ********
+ *
+ * Relocates every small segment, in ID order, into densely packed slabs
+ * so that segments with neighboring IDs share cache lines and pages.
+ * Segment IDs are unchanged; only the table entries are updated.
+ *
+ * Parameters: 
+ *      Segments_T Segments: segments to compact
+ * Return: 
+ *      number of bytes moved
+ *
+ * Expects:
+ *      Segments must not be null
+ * Notes:
+ *      Will CRE if Segments is null
+ *      Must only run at a safe point, since every pointer to segment
+ *      memory held outside the table becomes invalid
+ *      Discards any checkpoint, whose table it would invalidate
+ *****************************/
+extern size_t compact_segments(Segments_T Segments)
+{
+        assert(Segments != NULL);
+        discard_checkpoint(Segments);
+        arena_compact_begin(Segments->arena);
+
+        for (uint32_t seg_ID = 0; seg_ID < Segments->next_id; seg_ID++) {
+                Slot *slot = slot_at(Segments, seg_ID);
+                if (*slot != 0 && !IS_FREE(*slot)) {
+                        *slot = (Slot)move_segment(Segments, 
+                                                   (Segment *)*slot);
+                }
+        }
+        return arena_compact_end(Segments->arena);
+}
+
+/********** freeze_cold_segments ********
+ *
+ * Sweeps the segments, compressing every dense segment that has not been
+ * read or written since the previous sweep into the cold tier. A cold
+ * segment is decompressed again by its next access.
+ *
+ * Parameters: 
+ *      Segments_T Segments: segments to sweep
+ * Return: 
+ *      number of segments compressed
+ *
+ * Expects:
+ *      Segments must not be null
+ * Notes:
+ *      Will CRE if Segments is null
+ *      Segment 0, sparse and shared segments and segments under
+ *      COLD_MIN_WORDS are never compressed, nor is a segment found
+ *      incompressible until it is accessed again
+ *      Must only run at a safe point, like compact_segments, and also
+ *      discards any checkpoint
+ *****************************/
+extern uint32_t freeze_cold_segments(Segments_T Segments)
+{
+        assert(Segments != NULL);
+        discard_checkpoint(Segments);
+        uint32_t frozen = 0;
+
+        for (uint32_t seg_ID = 1; seg_ID < Segments->next_id; seg_ID++) {
+                Slot *slot = slot_at(Segments, seg_ID);
+                if (*slot == 0 || IS_FREE(*slot)) {
+                        continue;
+                }
+                Segment *segment = (Segment *)*slot;
+                if (segment->kind != SEG_DENSE) {
+                        continue;
+                }
+                if (segment->touched == IDLE && 
+                    segment->length >= COLD_MIN_WORDS) {
+                        *slot = (Slot)freeze(Segments, segment);
+                        frozen += ((Segment *)*slot)->kind == SEG_COLD;
+                } else if (segment->touched == TOUCHED) {
+                        segment->touched = IDLE;
+                }
+        }
+        return frozen;
+}
+
+/********** discard_checkpoint ********
+ *
+ * Drops the checkpoint of file-backed segments, so that a file whose
+ * segments have changed since is never resumed
+ *
+ * Parameters: 
+ *      Segments_T Segments: segments about to change
+ * Return: None
+ *
+ * Expects:
+ *      Segments must not be null
+ * Notes:
+ *      Will CRE if Segments is null
+ *      Does nothing if there is no checkpoint
+ *****************************/
+extern void discard_checkpoint(Segments_T Segments)
+{
+        assert(Segments != NULL);
+        Directory *directory = Segments->directory;
+        if (directory == NULL) {
+                return;
+        }
+        *arena_root(Segments->arena) = NULL;
+        Segments->directory = NULL;
+        arena_release(Segments->arena, directory, 
+                      DIRECTORY_BYTES(directory->next_id));
+}
+
+/********** checkpoint_segments ********
+ *
+ * Records the table of file-backed segments, together with the owner's
+ * state, in the backing file and writes the file to disk, so that
+ * initialize_Segments_file can resume from it in a later process
+ *
+ * Parameters: 
+ *      Segments_T Segments: file-backed segments at a safe point
+ *      const uint32_t *state: SEGMENT_STATE_WORDS words to save
+ * Return: 
+ *      true if the checkpoint reached the disk
+ *
+ * Expects:
+ *      Segments and state must not be null; Segments must be file-backed
+ * Notes:
+ *      Will CRE if Segments or state is null, or Segments is not backed
+ *      by a file
+ *      The checkpoint holds until discard_checkpoint; segments must not
+ *      change while it does
+ *****************************/
+extern bool checkpoint_segments(Segments_T Segments, const uint32_t *state)
+{
+        assert(Segments != NULL && state != NULL);
+        void **root = arena_root(Segments->arena);
+        discard_checkpoint(Segments);
+
+        Directory *directory = arena_alloc(Segments->arena, 
+                                           DIRECTORY_BYTES(Segments->next_id));
+        directory->next_id = Segments->next_id;
+        directory->free_head = Segments->free_head;
+        directory->sparse_length = Segments->sparse_length;
+        memcpy(directory->state, state, sizeof(directory->state));
+        directory->usage = Segments->usage;
+        directory->zero_page = zero_page;
+        for (uint32_t seg_ID = 0; seg_ID < Segments->next_id; seg_ID++) {
+                directory->slots[seg_ID] = *slot_at(Segments, seg_ID);
+        }
+
+        /* Publish the directory only once everything it names is on disk */
+        bool synced = arena_sync(Segments->arena);
+        *root = directory;
+        Segments->directory = directory;
+        return arena_sync(Segments->arena) && synced;
+}
+
+/********** write_all ********
+ *
+ * Writes bytes to a descriptor, retrying short and interrupted writes
+ *
+ * Return:
+ *      false if a write failed
+ *****************************/
+static bool write_all(int fd, const void *bytes, size_t length)
+{
+        const uint8_t *next = bytes;
+        while (length > 0) {
+                ssize_t written = write(fd, next, length);
+                if (written < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (written <= 0) {
+                        return false;
+                }
+                next += written;
+                length -= (size_t)written;
+        }
+        return true;
+}
+
+/********** sink_put ********
+ *
+ * Appends bytes to a checkpoint file, writing long runs directly
+ *****************************/
+static void sink_put(Sink *sink, const void *bytes, size_t length)
+{
+        if (sink->failed) {
+                return;
+        }
+        if (sink->used + length > SINK_BYTES || length > SINK_BYTES / 2) {
+                sink->failed = !write_all(sink->fd, sink->buffer, sink->used);
+                sink->used = 0;
+        }
+        if (length > SINK_BYTES / 2) {
+                sink->failed = sink->failed ||
+                               !write_all(sink->fd, bytes, length);
+                return;
+        }
+        memcpy(sink->buffer + sink->used, bytes, length);
+        sink->used += length;
+}
+
+/********** sink_word ********
+ *
+ * Appends one word to a checkpoint file
+ *****************************/
+static void sink_word(Sink *sink, uint32_t word)
+{
+        sink_put(sink, &word, sizeof(word));
+}
+
+/********** save_segment ********
+ *
+ * Appends the words of a live segment to a checkpoint file. A cold
+ * segment is decompressed into memory mapped for the purpose, since the
+ * allocator may not be usable in a forked child.
+ *****************************/
+static void save_segment(Sink *sink, const Segment *segment)
+{
+        size_t bytes = (size_t)segment->length * 4;
+        if (segment->kind == SEG_DENSE || segment->kind == SEG_SHARED) {
+                sink_put(sink, segment->words, bytes);
+        } else if (segment->kind == SEG_COLD) {
+                void *words = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (words == MAP_FAILED) {
+                        sink->failed = true;
+                        return;
+                }
+                lz_decompress(PACKED(segment)->data, PACKED(segment)->bytes,
+                              words, bytes);
+                sink_put(sink, words, bytes);
+                munmap(words, bytes);
+        } else {
+                uint32_t **pages = PAGES(segment);
+                for (uint32_t i = 0; i < segment->length; i += PAGE_WORDS) {
+                        uint32_t n = segment->length - i;
+                        sink_put(sink, pages[i >> PAGE_BITS], 
+                                 (size_t)(n < PAGE_WORDS ? n : PAGE_WORDS) * 
+                                 4);
+                }
+        }
+}
+
+/********** write_segments ********
+ *
+ * Writes a table of segments, together with the owner's state, to a
+ * checkpoint file that read_segments can load
+ *
+ * Parameters: 
+ *      Segments_T Segments: segments at a safe point
+ *      const uint32_t *state: SEGMENT_STATE_WORDS words to save
+ *      int fd: the file, open for writing
+ * Return: 
+ *      true if every write succeeded
+ *
+ * Expects:
+ *      Segments and state must not be null
+ * Notes:
+ *      Will CRE if Segments or state is null
+ *      Makes only system calls and reads memory, so it may run in a child
+ *      forked from a process with other threads
+ *      Neither flushes the file to disk nor closes it
+ *****************************/
+extern bool write_segments(Segments_T Segments, const uint32_t *state,
+                           int fd)
+{
+        assert(Segments != NULL && state != NULL);
+        Sink sink;
+        sink.fd = fd;
+        sink.used = 0;
+        sink.failed = false;
+
+        sink_word(&sink, SAVE_MAGIC);
+        sink_put(&sink, state, SEGMENT_STATE_WORDS * sizeof(uint32_t));
+        sink_word(&sink, Segments->next_id);
+        sink_word(&sink, Segments->free_head);
+        sink_word(&sink, Segments->sparse_length);
+        for (uint32_t seg_ID = 0; seg_ID < Segments->next_id && 
+                                  !sink.failed; seg_ID++) {
+                Slot slot = *slot_at(Segments, seg_ID);
+                if (IS_FREE(slot)) {
+                        sink_word(&sink, SAVE_FREE);
+                        sink_word(&sink, NEXT_FREE(slot));
+                        continue;
+                }
+                const Segment *segment = (const Segment *)slot;
+                sink_word(&sink, SAVE_LIVE);
+                sink_word(&sink, segment->length);
+                save_segment(&sink, segment);
+        }
+        sink_word(&sink, SAVE_END);
+        return !sink.failed && write_all(fd, sink.buffer, sink.used);
+}
+
+/********** load_segment ********
+ *
+ * Reads the words of a segment from a checkpoint file, keeping pages of
+ * a sparse segment that hold only zeros as the shared zero page
+ *
+ * Return:
+ *      the segment, or NULL if the file ended early
+ *****************************/
+static Segment *load_segment(Segments_T Segments, uint32_t seg_ID,
+                             uint32_t length, FILE *fp)
+{
+        if (Segments->sparse_length == 0 || 
+            length < Segments->sparse_length || seg_ID == 0) {
+                Segment *segment = new_segment(Segments, length, false);
+                if (fread(segment->words, 4, length, fp) != length) {
+                        release_segment(Segments, segment);
+                        return NULL;
+                }
+                return segment;
+        }
+
+        Segment *segment = new_sparse_segment(Segments, length);
+        uint32_t page[PAGE_WORDS];
+        for (uint32_t i = 0; i < length; i += PAGE_WORDS) {
+                uint32_t n = length - i;
+                n = n < PAGE_WORDS ? n : PAGE_WORDS;
+                if (fread(page, 4, n, fp) != n) {
+                        release_segment(Segments, segment);
+                        return NULL;
+                }
+                if (memcmp(page, zero_page, (size_t)n * 4) != 0) {
+                        memcpy(sparse_word(Segments, segment, i), page, 
+                               (size_t)n * 4);
+                }
+        }
+        return segment;
+}
+
+/********** read_segments ********
+ *
+ * Loads a table of segments from a checkpoint file written by
+ * write_segments, in anonymous memory
+ *
+ * Parameters: 
+ *      FILE *fp: the file, at its start
+ *      uint32_t *state: receives the SEGMENT_STATE_WORDS words saved with
+ *                       the table
+ * Return: 
+ *      the segments, or NULL if the file is not a complete checkpoint
+ *
+ * Expects:
+ *      fp and state must not be null
+ * Notes:
+ *      Will CRE if fp or state is null or allocation fails
+ *      The table starts with no limits; its sparse threshold is the
+ *      saved one and its peak usage is its live usage
+ *****************************/
+extern Segments_T read_segments(FILE *fp, uint32_t *state)
+{
+        assert(fp != NULL && state != NULL);
+        uint32_t header[3];
+        uint32_t magic;
+        if (fread(&magic, 4, 1, fp) != 1 || magic != SAVE_MAGIC ||
+            fread(state, 4, SEGMENT_STATE_WORDS, fp) != 
+            SEGMENT_STATE_WORDS || fread(header, 4, 3, fp) != 3) {
+                return NULL;
+        }
+
+        if (header[1] != NO_FREE_ID && header[1] >= header[0]) {
+                return NULL;
+        }
+        Segments_T Segments = initialize_Segments();
+        Segments->free_head = header[1];
+        Segments->sparse_length = header[2];
+        bool complete = true;
+        for (uint32_t seg_ID = 0; seg_ID < header[0] && complete; 
+             seg_ID++) {
+                uint32_t tag[2];
+                new_slot(Segments);
+                if (fread(tag, 4, 2, fp) != 2 || tag[0] > SAVE_FREE ||
+                    (tag[0] == SAVE_FREE && tag[1] != NO_FREE_ID && 
+                     tag[1] >= header[0])) {
+                        complete = false;
+                        break;
+                }
+                if (tag[0] == SAVE_FREE) {
+                        *slot_at(Segments, seg_ID) = FREE_SLOT(tag[1]);
+                        continue;
+                }
+                Segment *segment = load_segment(Segments, seg_ID, tag[1], 
+                                                fp);
+                complete = segment != NULL;
+                if (complete) {
+                        *slot_at(Segments, seg_ID) = (Slot)segment;
+                        charge(Segments, tag[1], 1);
+                }
+        }
+        if (!complete || fread(&magic, 4, 1, fp) != 1 || magic != SAVE_END) {
+                free_Segments(&Segments);
+                return NULL;
+        }
+        return Segments;
+}
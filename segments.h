@@ -17,12 +17,60 @@
  *     segments used by the UM. 
  *
  **************************************************************/
+#ifndef SEGMENTS_INCLUDED
+#define SEGMENTS_INCLUDED
+
 #include <stdint.h>
-#include "seq.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "arena.h"
 
 typedef struct Segments_T *Segments_T;
 
+/* Returned by map_segment and duplicate when a hard limit refuses the call */
+#define SEGMENT_FAULT UINT32_MAX
+
+/* Words of owner state saved with a checkpoint of file-backed segments */
+#define SEGMENT_STATE_WORDS 16
+
+/* Live and high-water usage of a Segments_T, counted in words and segments */
+typedef struct Segments_usage {
+        uint64_t        live_words;
+        uint64_t        peak_words;
+        uint32_t        live_segments;
+        uint32_t        peak_segments;
+        size_t          mapped_bytes;  /* arena memory, including free space */
+        size_t          huge_bytes;    /* arena memory advised for THP */
+        uint64_t        sparse_pages;  /* written pages of sparse segments */
+        uint32_t        cold_segments; /* segments held compressed */
+        uint64_t        cold_bytes;    /* their uncompressed size */
+        uint64_t        packed_bytes;  /* their compressed size */
+        uint64_t        freezes;       /* segments compressed so far */
+        uint64_t        thaws;         /* segments decompressed on access */
+        uint64_t        thaw_ns;       /* time spent decompressing them */
+        uint32_t        shared_segments; /* segments using shared words */
+        uint64_t        shared_bytes;  /* their size, held outside the
+                                          arena once per process */
+        uint64_t        unshares;      /* shared segments copied on write */
+} Segments_usage;
+
+/* Quotas on a Segments_T; a limit of 0 means unlimited */
+typedef struct Segments_limits {
+        uint64_t        soft_words;
+        uint64_t        hard_words;
+        uint32_t        soft_segments;
+        uint32_t        hard_segments;
+        /* Called when usage rises above a soft limit; called again only
+           after usage has fallen back to 3/4 of that limit */
+        void          (*on_soft_limit)(void *cl, Segments_usage usage);
+        void           *cl;
+} Segments_limits;
+
 extern Segments_T initialize_Segments();
+extern Segments_T initialize_Segments_file(const char *path, uint64_t bytes,
+                                           uint32_t *state);
+extern Segments_T copy_Segments(Segments_T source);
 extern void free_Segments(Segments_T* Segments);
 extern uint32_t map_segment(Segments_T Segments, uint32_t length);
 extern void unmap_segment(Segments_T Segments, uint32_t seg_ID);
@@ -30,3 +78,20 @@ extern uint32_t get_word(Segments_T Segments, uint32_t seg_ID, uint32_t offset);
 extern void set_word(Segments_T Segments, uint32_t seg_ID, 
                      uint32_t offset, uint32_t value);
 extern uint32_t duplicate(Segments_T Segments, uint32_t source_ID);
+extern void set_segment_limits(Segments_T Segments, Segments_limits limits);
+extern Segments_usage segment_usage(Segments_T Segments);
+extern void set_deferred_reclaim(Segments_T Segments, uint32_t length);
+extern void set_hugepage_policy(Segments_T Segments, Arena_huge policy);
+extern void set_sparse_threshold(Segments_T Segments, uint32_t length);
+extern void set_dedup_threshold(Segments_T Segments, uint32_t length);
+extern void set_use_tracking(Segments_T Segments, bool on);
+extern uint32_t share_segments(Segments_T Segments);
+extern size_t compact_segments(Segments_T Segments);
+extern uint32_t freeze_cold_segments(Segments_T Segments);
+extern bool checkpoint_segments(Segments_T Segments, const uint32_t *state);
+extern void discard_checkpoint(Segments_T Segments);
+extern bool write_segments(Segments_T Segments, const uint32_t *state,
+                           int fd);
+extern Segments_T read_segments(FILE *fp, uint32_t *state);
+
+#endif
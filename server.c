@@ -0,0 +1,629 @@
+/**************************************************************
+ *
+ *                     server.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     server.c contains the implementation of the UM execution daemon.
+ *     One thread runs an epoll loop that accepts connections and reads
+ *     each client's image name without blocking, so slow or idle clients
+ *     never hold up the others. A connection whose name has arrived gets
+ *     a ready UM for the image, which is handed to the scheduler of one
+ *     of a few worker threads in turn. Each worker interleaves all of its
+ *     UMs, and a UM waiting for its client's input is parked rather than
+ *     holding a thread, so idle connections cost no threads at all.
+ *
+ *     Each image is loaded once, from a program or a heap image snapshot,
+ *     into a prototype UM that never runs. Ready UMs are clones of the
+ *     prototype, so serving a connection costs neither process startup
+ *     nor reading the program; a worker tops its image's pool back up
+ *     after every connection it finishes. With vm.dedup_words set, long
+ *     segments of every clone are shared copy-on-write: a program's
+ *     prototype shares its own segments once, and clones of a snapshot
+ *     match theirs against the shared store as they are copied.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <mem.h>
+#include "scheduler.h"
+#include "server.h"
+
+#define DEFAULT_WORKERS 4
+#define DEFAULT_POOL    2
+#define NAME_BYTES      64      /* longest image name, with its newline */
+#define MAX_EVENTS      64
+#define BACKLOG         128
+
+/* A registered image and its ready UMs, guarded by lock */
+typedef struct Image {
+        char            name[NAME_BYTES];
+        UM_T            prototype;      /* loaded once, never run */
+        pthread_mutex_t lock;
+        UM_T           *ready;          /* pool entries */
+        unsigned        count;          /* entries in ready */
+        struct Image   *next;
+} Image;
+
+/* A connection whose image name is still being read */
+typedef struct Pending {
+        int             fd;
+        size_t          length;         /* bytes of name read so far */
+        char            name[NAME_BYTES];
+        struct Pending *prev;
+        struct Pending *next;
+} Pending;
+
+/* A connection being served by a UM, listed so stopping can cut it short */
+typedef struct Connection {
+        int             fd;
+        FILE           *output;         /* on a duplicate of fd */
+        Image          *image;
+        Server_T        server;
+        struct Connection *prev;
+        struct Connection *next;
+} Connection;
+
+/* A thread running a scheduler */
+typedef struct Worker {
+        pthread_t       thread;
+        Sched_T         sched;
+} Worker;
+
+/********** struct Server_T ********
+ *
+ * Server_config config: settings, with defaults filled in
+ * int listener: listening socket
+ * int wakeup: eventfd written by server_stop
+ * int epoll: the event loop's epoll instance
+ * Image *images: registered images
+ * Pending *pending: connections still sending their image name
+ * Worker *workers: the worker threads
+ * unsigned next_worker: worker to get the next connection
+ * pthread_mutex_t lock: guards connections
+ * Connection *connections: connections being served
+ *
+ *****************************/
+struct Server_T {
+        Server_config   config;
+        int             listener;
+        int             wakeup;
+        int             epoll;
+        Image          *images;
+        Pending        *pending;
+        Worker         *workers;
+        unsigned        next_worker;
+        pthread_mutex_t lock;
+        Connection     *connections;
+};
+
+/********** server_new ********
+ *
+ * Creates a server listening on a Unix domain socket, replacing any stale
+ * socket file at that path
+ *
+ * Parameters:
+ *      const Server_config *config: the settings
+ * Return:
+ *      the server, or NULL if the socket cannot be created
+ *
+ * Expects:
+ *      config and config->socket_path must not be NULL
+ * Notes:
+ *      Will CRE if config or its socket_path is NULL or allocation fails
+ *****************************/
+extern Server_T server_new(const Server_config *config)
+{
+        assert(config != NULL && config->socket_path != NULL);
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (strlen(config->socket_path) >= sizeof(address.sun_path)) {
+                return NULL;
+        }
+        strcpy(address.sun_path, config->socket_path);
+
+        int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK |
+                              SOCK_CLOEXEC, 0);
+        if (listener < 0) {
+                return NULL;
+        }
+        unlink(config->socket_path);
+        if (bind(listener, (struct sockaddr *)&address,
+                 sizeof(address)) != 0 || listen(listener, BACKLOG) != 0) {
+                close(listener);
+                return NULL;
+        }
+
+        Server_T server = CALLOC(1, sizeof(struct Server_T));
+        assert(server != NULL);
+        server->config = *config;
+        server->config.vm.heap_file = NULL;
+        if (server->config.workers == 0) {
+                server->config.workers = DEFAULT_WORKERS;
+        }
+        if (server->config.pool == 0) {
+                server->config.pool = DEFAULT_POOL;
+        }
+        server->listener = listener;
+        server->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        server->epoll = epoll_create1(EPOLL_CLOEXEC);
+        assert(server->wakeup >= 0 && server->epoll >= 0);
+        pthread_mutex_init(&server->lock, NULL);
+        return server;
+}
+
+/********** refill ********
+ *
+ * Tops an image's pool of ready UMs up to the configured size. Clones are
+ * made outside the lock, since the prototype is only read.
+ *
+ * Parameters:
+ *      Server_T server: owner of the image
+ *      Image *image: the image
+ * Return: None
+ *****************************/
+static void refill(Server_T server, Image *image)
+{
+        for (;;) {
+                pthread_mutex_lock(&image->lock);
+                bool full = image->count >= server->config.pool;
+                pthread_mutex_unlock(&image->lock);
+                if (full) {
+                        return;
+                }
+
+                UM_T um = um_clone(image->prototype);
+                pthread_mutex_lock(&image->lock);
+                if (image->count < server->config.pool) {
+                        image->ready[image->count++] = um;
+                        um = NULL;
+                }
+                pthread_mutex_unlock(&image->lock);
+                if (um != NULL) {
+                        um_free(&um);   /* another worker filled it first */
+                        return;
+                }
+        }
+}
+
+/********** server_add_image ********
+ *
+ * Registers an image under a name, loading it into a prototype UM and
+ * filling its pool
+ *
+ * Parameters:
+ *      Server_T server: the server, not yet running
+ *      const char *name: name clients ask for; no newline, and shorter
+ *                        than NAME_BYTES - 1 bytes
+ *      const char *path: a .um program, or a heap image
+ *      bool snapshot: whether path is a heap image saved by um_checkpoint,
+ *                     which UMs then continue from
+ * Return:
+ *      false if the name is unusable or taken, or a snapshot cannot be
+ *      resumed
+ *
+ * Expects:
+ *      server, name and path must not be NULL
+ * Notes:
+ *      Will CRE if server, name or path is NULL
+ *      Exits with EXIT_FAILURE, like um_new, if a program cannot be found
+ *      Only one snapshot can be loaded per process, since a heap image
+ *      must be mapped at the address it was created at
+ *****************************/
+extern bool server_add_image(Server_T server, const char *name,
+                             const char *path, bool snapshot)
+{
+        assert(server != NULL && name != NULL && path != NULL);
+        if (*name == '\0' || strlen(name) >= NAME_BYTES - 1 ||
+            strchr(name, '\n') != NULL) {
+                return false;
+        }
+        for (Image *image = server->images; image != NULL;
+             image = image->next) {
+                if (strcmp(image->name, name) == 0) {
+                        return false;
+                }
+        }
+
+        UM_T prototype = snapshot ? um_resume(path, &server->config.vm)
+                                  : um_new((char *)path, &server->config.vm);
+        if (prototype == NULL) {
+                return false;
+        }
+        if (!snapshot) {
+                um_share(prototype);
+        }
+        Image *image = CALLOC(1, sizeof(Image));
+        assert(image != NULL);
+        strcpy(image->name, name);
+        image->prototype = prototype;
+        pthread_mutex_init(&image->lock, NULL);
+        image->ready = CALLOC(server->config.pool, sizeof(UM_T));
+        assert(image->ready != NULL);
+        image->next = server->images;
+        server->images = image;
+        refill(server, image);
+        return true;
+}
+
+/********** take_um ********
+ *
+ * Takes a ready UM for an image, cloning one if the pool is empty
+ *
+ * Parameters:
+ *      Image *image: the image
+ * Return:
+ *      a UM that has not run yet
+ *****************************/
+static UM_T take_um(Image *image)
+{
+        pthread_mutex_lock(&image->lock);
+        UM_T um = image->count > 0 ? image->ready[--image->count] : NULL;
+        pthread_mutex_unlock(&image->lock);
+        return um != NULL ? um : um_clone(image->prototype);
+}
+
+/********** finish ********
+ *
+ * Done callback of a served UM: reports a fault, closes the connection,
+ * frees the UM and tops up its image's pool
+ *****************************/
+static void finish(void *cl, UM_T um, UM_status status,
+                   const Sched_usage *usage)
+{
+        Connection *connection = cl;
+        Server_T server = connection->server;
+        (void)usage;
+        if (status == UM_FAULT) {
+                fprintf(stderr, "um: %s: fault: %s\n",
+                        connection->image->name, um_fault_reason(um));
+        }
+
+        pthread_mutex_lock(&server->lock);
+        if (connection->prev != NULL) {
+                connection->prev->next = connection->next;
+        } else {
+                server->connections = connection->next;
+        }
+        if (connection->next != NULL) {
+                connection->next->prev = connection->prev;
+        }
+        pthread_mutex_unlock(&server->lock);
+        fclose(connection->output);
+        close(connection->fd);
+        um_free(&um);
+        refill(server, connection->image);
+        free(connection);
+}
+
+/********** serve ********
+ *
+ * Gives a connection a UM reading the socket and writing to it, and hands
+ * the UM to the next worker's scheduler
+ *
+ * Parameters:
+ *      Server_T server: the server
+ *      int fd: the connection, its image name already read
+ *      Image *image: the image it asked for
+ * Return: None
+ *****************************/
+static void serve(Server_T server, int fd, Image *image)
+{
+        /* Output blocks; input is only read once epoll reports it */
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        int out_fd = dup(fd);
+        FILE *output = out_fd < 0 ? NULL : fdopen(out_fd, "w");
+        if (output == NULL) {
+                if (out_fd >= 0) {
+                        close(out_fd);
+                }
+                close(fd);
+                return;
+        }
+
+        Connection *connection = CALLOC(1, sizeof(Connection));
+        assert(connection != NULL);
+        connection->fd = fd;
+        connection->output = output;
+        connection->image = image;
+        connection->server = server;
+        pthread_mutex_lock(&server->lock);
+        connection->next = server->connections;
+        if (server->connections != NULL) {
+                server->connections->prev = connection;
+        }
+        server->connections = connection;
+        pthread_mutex_unlock(&server->lock);
+
+        UM_T um = take_um(image);
+        um_set_io(um, stdin, output);
+        um_set_deadline(um, server->config.vm.deadline);
+        Worker *worker = &server->workers[server->next_worker];
+        server->next_worker = (server->next_worker + 1) % 
+                              server->config.workers;
+        sched_add(worker->sched, um, fd, 0, finish, connection);
+}
+
+/********** work ********
+ *
+ * Body of a worker thread: runs its scheduler until the server stops
+ *****************************/
+static void *work(void *cl)
+{
+        Worker *worker = cl;
+        sched_serve(worker->sched);
+        return NULL;
+}
+
+/********** forget ********
+ *
+ * Stops watching a connection that was sending its image name and frees
+ * its Pending, leaving the socket open
+ *
+ * Parameters:
+ *      Server_T server: the server
+ *      Pending *pending: the connection
+ * Return:
+ *      the connection's socket
+ *****************************/
+static int forget(Server_T server, Pending *pending)
+{
+        int fd = pending->fd;
+        epoll_ctl(server->epoll, EPOLL_CTL_DEL, fd, NULL);
+        if (pending->prev != NULL) {
+                pending->prev->next = pending->next;
+        } else {
+                server->pending = pending->next;
+        }
+        if (pending->next != NULL) {
+                pending->next->prev = pending->prev;
+        }
+        free(pending);
+        return fd;
+}
+
+/********** drop ********
+ *
+ * Closes a connection that is still sending its image name
+ *
+ * Parameters:
+ *      Server_T server: the server
+ *      Pending *pending: the connection
+ * Return: None
+ *****************************/
+static void drop(Server_T server, Pending *pending)
+{
+        close(forget(server, pending));
+}
+
+/********** accept_all ********
+ *
+ * Accepts every waiting connection and starts reading its image name
+ *
+ * Parameters:
+ *      Server_T server: the server
+ * Return: None
+ *****************************/
+static void accept_all(Server_T server)
+{
+        for (;;) {
+                int fd = accept(server->listener, NULL, NULL);
+                if (fd < 0) {
+                        return;
+                }
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+                Pending *pending = CALLOC(1, sizeof(Pending));
+                assert(pending != NULL);
+                pending->fd = fd;
+                struct epoll_event event;
+                event.events = EPOLLIN;
+                event.data.ptr = pending;
+                if (epoll_ctl(server->epoll, EPOLL_CTL_ADD, fd,
+                              &event) != 0) {
+                        close(fd);
+                        free(pending);
+                        continue;
+                }
+                pending->next = server->pending;
+                if (server->pending != NULL) {
+                        server->pending->prev = pending;
+                }
+                server->pending = pending;
+        }
+}
+
+/********** read_name ********
+ *
+ * Reads what has arrived of a connection's image name, one byte at a time
+ * so that nothing after the newline is consumed, and starts serving the
+ * connection once the name is complete
+ *
+ * Parameters:
+ *      Server_T server: the server
+ *      Pending *pending: the connection
+ * Return: None
+ *****************************/
+static void read_name(Server_T server, Pending *pending)
+{
+        char byte;
+        ssize_t got;
+        while ((got = read(pending->fd, &byte, 1)) == 1 && byte != '\n') {
+                if (pending->length == NAME_BYTES - 1) {
+                        drop(server, pending);
+                        return;
+                }
+                pending->name[pending->length++] = byte;
+        }
+        if (got < 0 && (errno == EAGAIN || errno == EINTR)) {
+                return;
+        }
+        if (got <= 0) {
+                drop(server, pending);
+                return;
+        }
+
+        Image *image = server->images;
+        while (image != NULL && strcmp(image->name, pending->name) != 0) {
+                image = image->next;
+        }
+        if (image == NULL) {
+                static const char unknown[] = "um: unknown image\n";
+                ssize_t ignored = write(pending->fd, unknown,
+                                        sizeof(unknown) - 1);
+                (void)ignored;
+                drop(server, pending);
+                return;
+        }
+
+        serve(server, forget(server, pending), image);
+}
+
+/********** server_run ********
+ *
+ * Serves connections until server_stop is called, then stops the workers'
+ * schedulers, which close the connections still being served
+ *
+ * Parameters:
+ *      Server_T server: the server
+ * Return: None
+ *
+ * Expects:
+ *      server must not be NULL and must not have run before
+ * Notes:
+ *      Will CRE if server is NULL or a thread cannot be started
+ *      Ignores SIGPIPE, so that a client that disconnects early only
+ *      ends its own UM's output
+ *      Connections still sending their image name when the server stops
+ *      are closed
+ *****************************/
+extern void server_run(Server_T server)
+{
+        assert(server != NULL && server->workers == NULL);
+        signal(SIGPIPE, SIG_IGN);
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        int failed = epoll_ctl(server->epoll, EPOLL_CTL_ADD,
+                               server->listener, &event);
+        event.data.ptr = server;
+        failed |= epoll_ctl(server->epoll, EPOLL_CTL_ADD, server->wakeup,
+                            &event);
+        assert(failed == 0);
+
+        server->workers = CALLOC(server->config.workers, sizeof(Worker));
+        assert(server->workers != NULL);
+        for (unsigned i = 0; i < server->config.workers; i++) {
+                server->workers[i].sched = sched_new(0);
+                failed = pthread_create(&server->workers[i].thread, NULL,
+                                        work, &server->workers[i]);
+                assert(failed == 0);
+        }
+
+        bool stopping = false;
+        while (!stopping) {
+                struct epoll_event events[MAX_EVENTS];
+                int n = epoll_wait(server->epoll, events, MAX_EVENTS, -1);
+                for (int i = 0; i < n; i++) {
+                        void *source = events[i].data.ptr;
+                        if (source == NULL) {
+                                accept_all(server);
+                        } else if (source == server) {
+                                stopping = true;
+                        } else {
+                                read_name(server, source);
+                        }
+                }
+        }
+
+        while (server->pending != NULL) {
+                drop(server, server->pending);
+        }
+        for (unsigned i = 0; i < server->config.workers; i++) {
+                sched_stop(server->workers[i].sched);
+        }
+        /* Unblocks a worker writing to a client that has stopped reading */
+        pthread_mutex_lock(&server->lock);
+        for (Connection *connection = server->connections;
+             connection != NULL; connection = connection->next) {
+                shutdown(connection->fd, SHUT_RDWR);
+        }
+        pthread_mutex_unlock(&server->lock);
+        for (unsigned i = 0; i < server->config.workers; i++) {
+                pthread_join(server->workers[i].thread, NULL);
+                sched_free(&server->workers[i].sched);
+        }
+}
+
+/********** server_stop ********
+ *
+ * Makes server_run return; safe to call from a signal handler or another
+ * thread
+ *
+ * Parameters:
+ *      Server_T server: the server
+ * Return: None
+ *****************************/
+extern void server_stop(Server_T server)
+{
+        if (server != NULL) {
+                uint64_t one = 1;
+                ssize_t ignored = write(server->wakeup, &one, sizeof(one));
+                (void)ignored;
+        }
+}
+
+/********** server_free ********
+ *
+ * Closes the server's socket, removes its socket file, frees every image
+ * and its ready UMs, and sets the caller's handle to NULL
+ *
+ * Parameters:
+ *      Server_T *server: pointer to the server to free
+ * Return: None
+ *
+ * Expects:
+ *      server and *server must not be NULL, and the server must not be
+ *      running
+ * Notes:
+ *      Will CRE if server or *server is NULL
+ *****************************/
+extern void server_free(Server_T *server)
+{
+        assert(server != NULL && *server != NULL);
+        Server_T s = *server;
+        close(s->listener);
+        unlink(s->config.socket_path);
+        close(s->wakeup);
+        close(s->epoll);
+        while (s->images != NULL) {
+                Image *image = s->images;
+                s->images = image->next;
+                while (image->count > 0) {
+                        um_free(&image->ready[--image->count]);
+                }
+                um_free(&image->prototype);
+                pthread_mutex_destroy(&image->lock);
+                free(image->ready);
+                free(image);
+        }
+        free(s->workers);
+        pthread_mutex_destroy(&s->lock);
+        free(s);
+        *server = NULL;
+}
@@ -0,0 +1,43 @@
+/**************************************************************
+ *
+ *                     server.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     server.h contains the interface of the UM execution daemon. It
+ *     listens on a Unix domain socket and serves each connection with a
+ *     UM running one of its registered images. The client first sends the
+ *     image name and a newline; every later byte is the UM's input, and
+ *     the UM's output is sent back until it stops and the connection is
+ *     closed. UMs are taken from a pool kept ready for each image.
+ *
+ **************************************************************/
+#ifndef SERVER_INCLUDED
+#define SERVER_INCLUDED
+
+#include <stdbool.h>
+#include "um_status.h"
+
+typedef struct Server_T *Server_T;
+
+/* Settings of a server; a zero-initialized Server_config gives defaults */
+typedef struct Server_config {
+        const char     *socket_path;  /* where to listen */
+        unsigned        workers;      /* threads running UMs, 0 for 4 */
+        unsigned        pool;         /* ready UMs kept per image, 0 for 2 */
+        UM_config       vm;           /* settings for every UM; its
+                                         heap_file is ignored */
+} Server_config;
+
+extern Server_T server_new(const Server_config *config);
+extern bool server_add_image(Server_T server, const char *name,
+                             const char *path, bool snapshot);
+extern void server_run(Server_T server);
+extern void server_stop(Server_T server);
+extern void server_free(Server_T *server);
+
+#endif
@@ -0,0 +1,448 @@
+/**************************************************************
+ *
+ *                     trace.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     trace.c contains the implementation of the execution trace
+ *     recorder. A stream encodes records straight into a chunk it owns
+ *     alone, so trace_put takes no lock and makes no call in the common
+ *     case: one check for room, a header byte and at most two varints.
+ *     Only when the chunk is full does the stream take the tracer's lock,
+ *     queue the chunk for the writer thread and take a spare one.
+ *
+ *     Chunks are recycled through a spare list, and at most two per open
+ *     stream plus SPARE_CHUNKS are allocated, so a stream that outruns
+ *     the disk waits for the writer thread rather than growing without
+ *     bound. The writer thread sends each chunk with its stream number
+ *     and byte count in one write.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <mem.h>
+#include "trace.h"
+
+#define CHUNK_BYTES     (1u << 20)
+#define SPARE_CHUNKS    2
+#define MAX_RECORD      11      /* a header byte and two 32-bit varints */
+
+/* Position of the register each opcode writes: b for map segment, c for
+   input, the orthography register, and a for the rest */
+static const uint8_t reg_shift[16] = {
+        6, 6, 6, 6, 6, 6, 6, 6, 3, 6, 6, 0, 6, 25, 6, 6
+};
+
+/* A buffer of records; header is written immediately before bytes */
+typedef struct Chunk {
+        struct Chunk   *next;
+        uint32_t        header[2];      /* stream number and byte count */
+        uint8_t         bytes[CHUNK_BYTES];
+} Chunk;
+
+/********** struct Tracer_T ********
+ *
+ * int fd: descriptor of the trace file, owned by the caller
+ * pthread_mutex_t lock: protects every other field but fd and thread
+ * pthread_cond_t queued: signaled when a chunk is queued or closing is
+ *                        set
+ * pthread_cond_t written: signaled when a chunk has been written
+ * Chunk *head, *tail: chunks waiting for the writer thread, oldest first
+ * Chunk *spare: chunks free for any stream
+ * unsigned chunks: chunks allocated
+ * unsigned streams: streams open
+ * uint32_t next_stream: number of the next stream opened
+ * uint64_t submitted, done: chunks ever queued and ever written
+ * bool closing: tracer_free wants the thread to finish
+ * bool failed: a write failed; later chunks are discarded
+ * pthread_t thread: the writer thread
+ *
+ *****************************/
+struct Tracer_T {
+        int             fd;
+        pthread_mutex_t lock;
+        pthread_cond_t  queued;
+        pthread_cond_t  written;
+        Chunk          *head, *tail;
+        Chunk          *spare;
+        unsigned        chunks;
+        unsigned        streams;
+        uint32_t        next_stream;
+        uint64_t        submitted, done;
+        bool            closing;
+        bool            failed;
+        pthread_t       thread;
+};
+
+/********** struct Trace_T ********
+ *
+ * uint8_t *pos, *end: next free byte and end of the chunk, both NULL
+ *                     while the stream holds no chunk
+ * uint32_t next_pc: pc that needs no delta in the next record
+ * uint32_t last[8]: value last written to each register in this chunk
+ * Chunk *chunk: the chunk being filled, or NULL
+ * uint32_t stream: the stream's number
+ * Tracer_T tracer: the tracer that writes the stream
+ *
+ *****************************/
+struct Trace_T {
+        uint8_t        *pos, *end;
+        uint32_t        next_pc;
+        uint32_t        last[8];
+        Chunk          *chunk;
+        uint32_t        stream;
+        Tracer_T        tracer;
+};
+
+/********** write_all ********
+ *
+ * Writes a run of bytes, retrying short writes
+ *
+ * Return:
+ *      false if the descriptor failed
+ *****************************/
+static bool write_all(int fd, const uint8_t *bytes, size_t length)
+{
+        while (length > 0) {
+                ssize_t done = write(fd, bytes, length);
+                if (done < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (done <= 0) {
+                        return false;
+                }
+                bytes += done;
+                length -= (size_t)done;
+        }
+        return true;
+}
+
+/********** drain ********
+ *
+ * Body of the writer thread: writes queued chunks in order and returns
+ * them to the spare list, until tracer_free sets closing and the queue
+ * is empty
+ *****************************/
+static void *drain(void *cl)
+{
+        Tracer_T tracer = cl;
+        pthread_mutex_lock(&tracer->lock);
+        for (;;) {
+                while (tracer->head == NULL && !tracer->closing) {
+                        pthread_cond_wait(&tracer->queued, &tracer->lock);
+                }
+                Chunk *chunk = tracer->head;
+                if (chunk == NULL) {
+                        break;
+                }
+                tracer->head = chunk->next;
+                bool failed = tracer->failed;
+                pthread_mutex_unlock(&tracer->lock);
+
+                bool ok = failed ||
+                          write_all(tracer->fd, (uint8_t *)chunk->header,
+                                    sizeof(chunk->header) + chunk->header[1]);
+
+                pthread_mutex_lock(&tracer->lock);
+                tracer->failed = tracer->failed || !ok;
+                chunk->next = tracer->spare;
+                tracer->spare = chunk;
+                tracer->done++;
+                pthread_cond_broadcast(&tracer->written);
+        }
+        pthread_mutex_unlock(&tracer->lock);
+        return NULL;
+}
+
+/********** tracer_new ********
+ *
+ * Writes the header of a trace file and starts the thread that writes
+ * its chunks
+ *
+ * Parameters:
+ *      int fd: descriptor of the trace file, which stays the caller's
+ * Return:
+ *      the tracer, or NULL if the header could not be written
+ *
+ * Expects:
+ *      fd must be open for writing
+ * Notes:
+ *      Will CRE if allocation or thread creation fails
+ *****************************/
+extern Tracer_T tracer_new(int fd)
+{
+        if (!write_all(fd, (const uint8_t *)TRACE_MAGIC,
+                       strlen(TRACE_MAGIC))) {
+                return NULL;
+        }
+        Tracer_T tracer = CALLOC(1, sizeof(struct Tracer_T));
+        assert(tracer != NULL);
+        tracer->fd = fd;
+        pthread_mutex_init(&tracer->lock, NULL);
+        pthread_cond_init(&tracer->queued, NULL);
+        pthread_cond_init(&tracer->written, NULL);
+        int err = pthread_create(&tracer->thread, NULL, drain, tracer);
+        assert(err == 0);
+        (void)err;
+        return tracer;
+}
+
+/********** trace_open ********
+ *
+ * Opens a stream of a tracer, for one thread to append records to
+ *
+ * Parameters:
+ *      Tracer_T tracer: the tracer that writes the stream
+ * Return:
+ *      the stream, numbered after those opened before it
+ *
+ * Expects:
+ *      tracer must not be NULL
+ * Notes:
+ *      Will CRE if tracer is NULL or allocation fails
+ *****************************/
+extern Trace_T trace_open(Tracer_T tracer)
+{
+        assert(tracer != NULL);
+        Trace_T trace = CALLOC(1, sizeof(struct Trace_T));
+        assert(trace != NULL);
+        trace->tracer = tracer;
+        pthread_mutex_lock(&tracer->lock);
+        trace->stream = tracer->next_stream++;
+        tracer->streams++;
+        pthread_mutex_unlock(&tracer->lock);
+        return trace;
+}
+
+/********** submit ********
+ *
+ * Queues a stream's chunk for the writer thread, or returns it to the
+ * spare list if it is empty, leaving the stream without a chunk. The
+ * caller holds the tracer's lock.
+ *****************************/
+static void submit(Trace_T trace)
+{
+        Tracer_T tracer = trace->tracer;
+        Chunk *chunk = trace->chunk;
+        if (chunk == NULL) {
+                return;
+        }
+        chunk->header[0] = trace->stream;
+        chunk->header[1] = (uint32_t)(trace->pos - chunk->bytes);
+        if (chunk->header[1] == 0) {
+                chunk->next = tracer->spare;
+                tracer->spare = chunk;
+        } else {
+                chunk->next = NULL;
+                if (tracer->head == NULL) {
+                        tracer->head = chunk;
+                } else {
+                        tracer->tail->next = chunk;
+                }
+                tracer->tail = chunk;
+                tracer->submitted++;
+                pthread_cond_signal(&tracer->queued);
+        }
+        trace->chunk = NULL;
+        trace->pos = trace->end = NULL;
+}
+
+/********** refill ********
+ *
+ * Queues a stream's chunk and gives it a spare one, waiting for the
+ * writer thread if every chunk the tracer may allocate is in use
+ *****************************/
+static void refill(Trace_T trace)
+{
+        Tracer_T tracer = trace->tracer;
+        pthread_mutex_lock(&tracer->lock);
+        submit(trace);
+        while (tracer->spare == NULL &&
+               tracer->chunks >= 2 * tracer->streams + SPARE_CHUNKS) {
+                pthread_cond_wait(&tracer->written, &tracer->lock);
+        }
+        Chunk *chunk = tracer->spare;
+        if (chunk != NULL) {
+                tracer->spare = chunk->next;
+        } else {
+                tracer->chunks++;
+        }
+        pthread_mutex_unlock(&tracer->lock);
+
+        if (chunk == NULL) {
+                chunk = ALLOC(sizeof(Chunk));
+                assert(chunk != NULL);
+        }
+        trace->chunk = chunk;
+        trace->pos = chunk->bytes;
+        trace->end = chunk->bytes + CHUNK_BYTES;
+        trace->next_pc = 0;
+        memset(trace->last, 0, sizeof(trace->last));
+}
+
+/********** put_varint ********
+ *
+ * Encodes the zigzag form of a difference as a varint
+ *
+ * Return:
+ *      the byte after the varint
+ *****************************/
+static inline uint8_t *put_varint(uint8_t *pos, uint32_t difference)
+{
+        uint32_t value = difference << 1 ^ -(difference >> 31);
+        if (value < 0x80) {
+                *pos = (uint8_t)value;
+                return pos + 1;
+        }
+        while (value >= 0x80) {
+                *pos++ = (uint8_t)(value | 0x80);
+                value >>= 7;
+        }
+        *pos++ = (uint8_t)value;
+        return pos;
+}
+
+/********** trace_put ********
+ *
+ * Appends the record of an instruction that has just executed
+ *
+ * Parameters:
+ *      Trace_T trace: the stream of the thread running the UM
+ *      uint32_t pc: where the instruction was
+ *      uint32_t word: the instruction
+ *      const uint32_t *registers: the UM's registers after it executed
+ * Return: None
+ *
+ * Expects:
+ *      trace and registers must not be NULL
+ * Notes:
+ *      Fields are extracted with the layout execute_instruction uses
+ *****************************/
+extern void trace_put(Trace_T trace, uint32_t pc, uint32_t word,
+                      const uint32_t *registers)
+{
+        if (__builtin_expect(trace->end - trace->pos < MAX_RECORD, 0)) {
+                refill(trace);
+        }
+        uint8_t *pos = trace->pos;
+        unsigned opcode = word >> 28;
+        bool writes = (TRACE_WRITES >> opcode & 1) != 0;
+        unsigned reg = writes ? word >> reg_shift[opcode] & 7 : 0;
+
+        uint8_t *header = pos++;
+        *header = (uint8_t)(opcode | reg << 4);
+        if (__builtin_expect(pc != trace->next_pc, 0)) {
+                *header |= 0x80;
+                pos = put_varint(pos, pc - trace->next_pc);
+        }
+        trace->next_pc = pc + 1;
+        if (writes) {
+                uint32_t value = registers[reg];
+                pos = put_varint(pos, value - trace->last[reg]);
+                trace->last[reg] = value;
+        }
+        trace->pos = pos;
+}
+
+/********** trace_flush ********
+ *
+ * Hands a stream's records to the writer thread and waits until they are
+ * in the file
+ *
+ * Parameters:
+ *      Trace_T trace: the stream to flush
+ * Return:
+ *      false if a write to the trace file has failed
+ *
+ * Expects:
+ *      trace must not be NULL
+ * Notes:
+ *      Will CRE if trace is NULL
+ *****************************/
+extern bool trace_flush(Trace_T trace)
+{
+        assert(trace != NULL);
+        Tracer_T tracer = trace->tracer;
+        pthread_mutex_lock(&tracer->lock);
+        submit(trace);
+        uint64_t ticket = tracer->submitted;
+        while (tracer->done < ticket) {
+                pthread_cond_wait(&tracer->written, &tracer->lock);
+        }
+        bool ok = !tracer->failed;
+        pthread_mutex_unlock(&tracer->lock);
+        return ok;
+}
+
+/********** trace_close ********
+ *
+ * Queues a stream's last records and frees it
+ *
+ * Parameters:
+ *      Trace_T *trace: pointer to the stream; set to NULL
+ * Return: None
+ *
+ * Expects:
+ *      trace and *trace must not be NULL
+ * Notes:
+ *      Will CRE if trace or *trace is NULL
+ *****************************/
+extern void trace_close(Trace_T *trace)
+{
+        assert(trace != NULL && *trace != NULL);
+        Tracer_T tracer = (*trace)->tracer;
+        pthread_mutex_lock(&tracer->lock);
+        submit(*trace);
+        tracer->streams--;
+        pthread_mutex_unlock(&tracer->lock);
+        free(*trace);
+        *trace = NULL;
+}
+
+/********** tracer_free ********
+ *
+ * Waits for every queued chunk to be written, stops the writer thread and
+ * frees the tracer, leaving its descriptor open
+ *
+ * Parameters:
+ *      Tracer_T *tracer: pointer to the tracer; set to NULL
+ * Return:
+ *      false if a write to the trace file failed
+ *
+ * Expects:
+ *      tracer and *tracer must not be NULL, and all its streams closed
+ * Notes:
+ *      Will CRE if tracer or *tracer is NULL, or a stream is still open
+ *****************************/
+extern bool tracer_free(Tracer_T *tracer)
+{
+        assert(tracer != NULL && *tracer != NULL);
+        Tracer_T t = *tracer;
+        pthread_mutex_lock(&t->lock);
+        assert(t->streams == 0);
+        t->closing = true;
+        pthread_cond_signal(&t->queued);
+        pthread_mutex_unlock(&t->lock);
+        pthread_join(t->thread, NULL);
+
+        bool ok = !t->failed;
+        while (t->spare != NULL) {
+                Chunk *chunk = t->spare;
+                t->spare = chunk->next;
+                free(chunk);
+        }
+        pthread_cond_destroy(&t->written);
+        pthread_cond_destroy(&t->queued);
+        pthread_mutex_destroy(&t->lock);
+        free(t);
+        *tracer = NULL;
+        return ok;
+}
@@ -0,0 +1,54 @@
+/**************************************************************
+ *
+ *                     trace.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     trace.h contains the interface of the execution trace recorder. A
+ *     tracer owns a trace file and a thread that writes it; each UM
+ *     thread appends to a trace stream of its own, one record per
+ *     instruction holding its pc, its opcode and the value it wrote to a
+ *     register, and full buffers are handed to the tracer's thread whole.
+ *
+ *     The file starts with TRACE_MAGIC, followed by chunks of one stream
+ *     each: native 32-bit stream number and byte count, then the records.
+ *     A record is a byte holding the opcode in its low four bits, the
+ *     register written in the next three, and in the top bit whether the
+ *     pc is not the one after the previous record's. If that bit is set, a
+ *     varint of the zigzag-encoded difference from that pc follows. If
+ *     the opcode writes a register, a varint of the zigzag-encoded
+ *     difference from the last value written to that register follows.
+ *     Varints hold seven bits per byte, low bits first, with the high bit
+ *     set on all but the last byte. Each chunk starts afresh with pc 0
+ *     expected and every register last written 0, so chunks decode on
+ *     their own, and the chunks of a stream appear in the order written.
+ *
+ **************************************************************/
+#ifndef TRACE_INCLUDED
+#define TRACE_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_MAGIC     "UMTRACE1"
+
+/* Opcodes whose record carries the value written: conditional move,
+   segmented load, the arithmetic, map segment, input and orthography */
+#define TRACE_WRITES    0x297bu
+
+typedef struct Tracer_T *Tracer_T;
+typedef struct Trace_T *Trace_T;
+
+extern Tracer_T tracer_new(int fd);
+extern Trace_T trace_open(Tracer_T tracer);
+extern void trace_put(Trace_T trace, uint32_t pc, uint32_t word,
+                      const uint32_t *registers);
+extern bool trace_flush(Trace_T trace);
+extern void trace_close(Trace_T *trace);
+extern bool tracer_free(Tracer_T *tracer);
+
+#endif
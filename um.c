@@ -1,14 +1,634 @@
 #include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
 #include "um_status.h"
+#include "server.h"
+#include "bench.h"
+
+/* The running UM, for the handler that stops it on SIGINT or SIGTERM */
+static UM_T running;
+
+/* The running server, for the handler that stops it */
+static Server_T serving;
+
+/* Load program jumps between checks of whether a checkpoint is due */
+#define SAVE_BLOCKS (1u << 16)
+
+/* An image to register with --serve, given as NAME=PATH */
+typedef struct Image_arg {
+        char           *arg;
+        bool            snapshot;
+} Image_arg;
+
+/* Words to watch, given as SEG:OFFSET or SEG:OFFSET+LENGTH */
+typedef struct Watch_arg {
+        uint32_t        segment;
+        uint32_t        offset;
+        uint32_t        length;
+} Watch_arg;
+
+/********** usage ********
+ *
+ * Prints the command-line synopsis and exits with EXIT_FAILURE
+ ************************/
+static void usage(const char *prog)
+{
+        fprintf(stderr, "usage: %s [options] program.um\n"
+                "       %s [options] --resume heap-image\n"
+                "       %s [options] --restore checkpoint\n"
+                "       %s [options] --serve SOCKET --image NAME=PATH...\n"
+                "       %s [options] --bench K program.um...\n"
+                "  --stats              print resource usage at exit\n"
+                "  --soft-words N       warn when more than N words are live\n"
+                "  --hard-words N       fault when more than N words would "
+                "be live\n"
+                "  --soft-segments N    warn when more than N segments are "
+                "live\n"
+                "  --hard-segments N    fault when more than N segments would "
+                "be live\n"
+                "  --budget N           stop after about N instructions\n"
+                "  --deadline SECONDS   stop after SECONDS of wall-clock "
+                "time\n"
+                "  --reclaim-words N    free unmapped segments of N or more "
+                "words\n"
+                "                       on a background thread\n"
+                "  --hugepages POLICY   back large segments (large, the "
+                "default),\n"
+                "                       all arena memory (all), or nothing "
+                "(off)\n"
+                "                       with transparent huge pages\n"
+                "  --sparse-words N     commit segments of N or more words "
+                "a page\n"
+                "                       at a time, on first write\n"
+                "  --compact-every N    pack small segments together every "
+                "N\n"
+                "                       instructions\n"
+                "  --cold-after N       compress segments unused for about "
+                "N\n"
+                "                       instructions\n"
+                "  --dedup-words N      share segments of N or more words "
+                "that are\n"
+                "                       identical across served UMs until "
+                "written\n"
+                "  --async-output N     write output from a thread through "
+                "an N-byte\n"
+                "                       ring\n"
+                "  --prefetch-input N   read input ahead on a thread into "
+                "an N-byte\n"
+                "                       ring\n"
+                "  --heap-file PATH     keep segment memory in PATH, a heap "
+                "image\n"
+                "                       saved on a budget, deadline, SIGINT "
+                "or\n"
+                "                       SIGTERM stop and removed at halt "
+                "or fault\n"
+                "  --heap-bytes N       let the heap image grow to N bytes "
+                "(256 GiB)\n"
+                "  --resume             continue the UM saved in a heap "
+                "image\n"
+                "  --checkpoint PATH    save the UM to PATH from a forked "
+                "child while\n"
+                "                       it runs, and on a budget, deadline, "
+                "SIGINT or\n"
+                "                       SIGTERM stop; removed at halt\n"
+                "  --checkpoint-every SECONDS\n"
+                "                       time between saves while running "
+                "(0: none)\n"
+                "  --restore            continue the UM saved in a "
+                "checkpoint file\n"
+                "  --record LOG         log every input byte with the "
+                "instruction count\n"
+                "                       at which it was read\n"
+                "  --replay LOG         take input from a log written by "
+                "--record\n"
+                "  --trace FILE         record every instruction executed "
+                "to FILE, for\n"
+                "                       umtrace to decode\n"
+                "  --profile FILE       infer guest calls and returns "
+                "from load program\n"
+                "                       jumps, and write the instructions "
+                "of each call\n"
+                "                       chain to FILE as folded stacks; "
+                "with --stats,\n"
+                "                       list the hottest functions\n"
+                "  --break PC           report the registers each time "
+                "the instruction\n"
+                "                       at offset PC of segment 0 is "
+                "reached\n"
+                "  --watch SEG:OFF[+N]  report each store to the N words "
+                "(1) at offset\n"
+                "                       OFF of segment SEG\n"
+                "  --serve SOCKET       run UMs for clients of a Unix "
+                "socket, which\n"
+                "                       send an image name and a newline, "
+                "then input\n"
+                "  --image NAME=PATH    serve program PATH as NAME\n"
+                "  --snapshot NAME=PATH serve UMs continuing heap image PATH "
+                "as NAME\n"
+                "  --workers N          threads running served UMs "
+                "(4)\n"
+                "  --pool N             UMs kept ready per image (2)\n"
+                "  --bench K            run 1 to K copies of each program "
+                "(K = 0: one\n"
+                "                       per core) as threads and as "
+                "processes, and\n"
+                "                       report how throughput scales\n",
+                prog, prog, prog, prog, prog);
+        exit(EXIT_FAILURE);
+}
+
+/********** parse_seconds ********
+ *
+ * Parses a non-negative number of seconds, exiting on bad input
+ ************************/
+static double parse_seconds(const char *prog, const char *arg)
+{
+        char *end;
+        double seconds = strtod(arg, &end);
+        if (*arg == '\0' || *end != '\0' || !(seconds >= 0)) {
+                usage(prog);
+        }
+        return seconds;
+}
+
+/********** parse_huge ********
+ *
+ * Parses a huge page policy name, exiting on bad input
+ ************************/
+static Arena_huge parse_huge(const char *prog, const char *arg)
+{
+        if (strcmp(arg, "large") == 0) {
+                return ARENA_HUGE_LARGE;
+        } else if (strcmp(arg, "off") == 0) {
+                return ARENA_HUGE_OFF;
+        } else if (strcmp(arg, "all") == 0) {
+                return ARENA_HUGE_ALL;
+        }
+        usage(prog);
+        return ARENA_HUGE_LARGE;
+}
+
+/********** stop_running ********
+ *
+ * SIGINT and SIGTERM handler for runs with a heap image or a checkpoint
+ * file: stops the UM at its next block boundary so that it can be saved
+ ************************/
+static void stop_running(int sig)
+{
+        (void)sig;
+        um_interrupt(running);
+}
+
+/********** stop_serving ********
+ *
+ * SIGINT and SIGTERM handler for --serve
+ ************************/
+static void stop_serving(int sig)
+{
+        (void)sig;
+        server_stop(serving);
+}
+
+/********** serve ********
+ *
+ * Runs the daemon for --serve until SIGINT or SIGTERM, then exits
+ ************************/
+static void serve(const char *prog, Server_config *config, 
+                  Image_arg *images, int count)
+{
+        serving = server_new(config);
+        if (serving == NULL) {
+                fprintf(stderr, "%s: Cannot listen on %s\n", prog, 
+                        config->socket_path);
+                exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < count; i++) {
+                char *path = strchr(images[i].arg, '=');
+                if (path != NULL) {
+                        *path++ = '\0';
+                }
+                if (path == NULL || !server_add_image(serving, 
+                                images[i].arg, path, images[i].snapshot)) {
+                        fprintf(stderr, "%s: Cannot serve image %s\n", 
+                                prog, images[i].arg);
+                        server_free(&serving);
+                        exit(EXIT_FAILURE);
+                }
+        }
+        signal(SIGINT, stop_serving);
+        signal(SIGTERM, stop_serving);
+        server_run(serving);
+        server_free(&serving);
+        exit(EXIT_SUCCESS);
+}
+
+/********** now_seconds ********
+ *
+ * Reads the monotonic clock in seconds
+ ************************/
+static double now_seconds(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/********** report_stops ********
+ *
+ * Runs the UM like um_run, reporting each breakpoint and watched store
+ * it stops at to standard error and going on
+ ************************/
+static UM_status report_stops(const char *prog, UM_T um)
+{
+        UM_status status;
+        while ((status = um_run(um)) == UM_BREAKPOINT) {
+                UM_stop stop = um_stopped(um);
+                if (stop.watch) {
+                        fprintf(stderr, "%s: watch %u:%u at pc %u: "
+                                "0x%08x -> 0x%08x\n", prog, stop.segment,
+                                stop.offset, stop.pc, stop.old_value,
+                                stop.value);
+                        continue;
+                }
+                fprintf(stderr, "%s: break at pc %u:", prog, stop.pc);
+                for (int r = 0; r < 8; r++) {
+                        fprintf(stderr, " r%d=0x%08x", r,
+                                stop.registers[r]);
+                }
+                fputc('\n', stderr);
+        }
+        return status;
+}
+
+/********** run_saving ********
+ *
+ * Runs the UM, starting a background save to a checkpoint file whenever
+ * every seconds have passed since the last one started, and waits for
+ * the last save once the UM stops
+ ************************/
+static UM_status run_saving(const char *prog, UM_T um, const char *path,
+                            double every)
+{
+        double next = now_seconds() + every;
+        UM_status status;
+        um_set_quantum(um, every > 0 ? SAVE_BLOCKS : 0);
+        while ((status = report_stops(prog, um)) == UM_YIELDED) {
+                if (um_checkpoint_poll(um, false) == UM_SAVE_FAILED) {
+                        fprintf(stderr, "%s: could not save %s\n", prog, 
+                                path);
+                }
+                double now = now_seconds();
+                if (now >= next && um_checkpoint_fork(um, path)) {
+                        next = now + every;
+                }
+                um_set_quantum(um, SAVE_BLOCKS);
+        }
+        if (um_checkpoint_poll(um, true) == UM_SAVE_FAILED) {
+                fprintf(stderr, "%s: could not save %s\n", prog, path);
+        }
+        return status;
+}
+
+/********** parse_count ********
+ *
+ * Parses a non-negative decimal option argument, exiting on bad input
+ ************************/
+static unsigned long long parse_count(const char *prog, const char *arg)
+{
+        char *end;
+        unsigned long long n = strtoull(arg, &end, 10);
+        if (*arg == '\0' || *end != '\0' || *arg == '-') {
+                usage(prog);
+        }
+        return n;
+}
+
+/********** parse_word ********
+ *
+ * Parses a 32-bit number in decimal, hex (0x) or octal (0) at the start
+ * of arg, exiting on bad input
+ ************************/
+static uint32_t parse_word(const char *prog, const char *arg, char **end)
+{
+        unsigned long long n = strtoull(arg, end, 0);
+        if (*arg == '\0' || *end == arg || *arg == '-' || n > UINT32_MAX) {
+                usage(prog);
+        }
+        return n;
+}
+
+/********** parse_watch ********
+ *
+ * Parses a --watch argument, SEG:OFFSET or SEG:OFFSET+LENGTH, exiting on
+ * bad input
+ ************************/
+static Watch_arg parse_watch(const char *prog, const char *arg)
+{
+        Watch_arg watch;
+        char *end;
+        watch.segment = parse_word(prog, arg, &end);
+        if (*end != ':') {
+                usage(prog);
+        }
+        watch.offset = parse_word(prog, end + 1, &end);
+        watch.length = 1;
+        if (*end == '+') {
+                watch.length = parse_word(prog, end + 1, &end);
+        }
+        if (*end != '\0') {
+                usage(prog);
+        }
+        return watch;
+}
 
 int main(int argc, char *argv[])
 {
+        static const struct option options[] = {
+                { "stats",         no_argument,       NULL, 's' },
+                { "soft-words",    required_argument, NULL, 'w' },
+                { "hard-words",    required_argument, NULL, 'W' },
+                { "soft-segments", required_argument, NULL, 'g' },
+                { "hard-segments", required_argument, NULL, 'G' },
+                { "budget",        required_argument, NULL, 'b' },
+                { "deadline",      required_argument, NULL, 'd' },
+                { "reclaim-words", required_argument, NULL, 'r' },
+                { "hugepages",     required_argument, NULL, 'H' },
+                { "sparse-words",  required_argument, NULL, 'S' },
+                { "compact-every", required_argument, NULL, 'c' },
+                { "cold-after",    required_argument, NULL, 'C' },
+                { "dedup-words",   required_argument, NULL, 'D' },
+                { "async-output",  required_argument, NULL, 'o' },
+                { "prefetch-input", required_argument, NULL, 'I' },
+                { "heap-file",     required_argument, NULL, 'f' },
+                { "heap-bytes",    required_argument, NULL, 'B' },
+                { "resume",        no_argument,       NULL, 'R' },
+                { "checkpoint",    required_argument, NULL, 'P' },
+                { "checkpoint-every", required_argument, NULL, 'E' },
+                { "restore",       no_argument,       NULL, 'T' },
+                { "record",        required_argument, NULL, 'y' },
+                { "replay",        required_argument, NULL, 'Y' },
+                { "trace",         required_argument, NULL, 'x' },
+                { "profile",       required_argument, NULL, 'F' },
+                { "break",         required_argument, NULL, 'z' },
+                { "watch",         required_argument, NULL, 'Z' },
+                { "serve",         required_argument, NULL, 'L' },
+                { "image",         required_argument, NULL, 'i' },
+                { "snapshot",      required_argument, NULL, 'n' },
+                { "workers",       required_argument, NULL, 'k' },
+                { "pool",          required_argument, NULL, 'p' },
+                { "bench",         required_argument, NULL, 'K' },
+                { NULL, 0, NULL, 0 }
+        };
+        UM_config config;
+        memset(&config, 0, sizeof(config));
+        int print_stats = 0;
+        int resume = 0;
+        int restore = 0;
+        const char *checkpoint = NULL;
+        double checkpoint_every = 0;
+        const char *record = NULL;
+        const char *replay = NULL;
+        const char *trace = NULL;
+        const char *profile = NULL;
+        long bench = -1;
+        size_t async_output = 0;
+        size_t prefetch = 0;
+        Server_config server;
+        memset(&server, 0, sizeof(server));
+        Image_arg *images = calloc(argc, sizeof(Image_arg));
+        int image_count = 0;
+        uint32_t *breaks = calloc(argc, sizeof(uint32_t));
+        int break_count = 0;
+        Watch_arg *watches = calloc(argc, sizeof(Watch_arg));
+        int watch_count = 0;
+
+        int opt;
+        while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+                switch (opt) {
+                case 's': print_stats = 1; break;
+                case 'w': config.limits.soft_words =
+                          parse_count(argv[0], optarg); break;
+                case 'W': config.limits.hard_words =
+                          parse_count(argv[0], optarg); break;
+                case 'g': config.limits.soft_segments =
+                          parse_count(argv[0], optarg); break;
+                case 'G': config.limits.hard_segments =
+                          parse_count(argv[0], optarg); break;
+                case 'b': config.budget = parse_count(argv[0], optarg); break;
+                case 'd': config.deadline = parse_seconds(argv[0], optarg);
+                          break;
+                case 'r': config.reclaim_words =
+                          parse_count(argv[0], optarg); break;
+                case 'H': config.hugepages = parse_huge(argv[0], optarg);
+                          break;
+                case 'S': config.sparse_words =
+                          parse_count(argv[0], optarg); break;
+                case 'c': config.compact_every =
+                          parse_count(argv[0], optarg); break;
+                case 'C': config.cold_after =
+                          parse_count(argv[0], optarg); break;
+                case 'D': config.dedup_words =
+                          parse_count(argv[0], optarg); break;
+                case 'o': async_output = parse_count(argv[0], optarg);
+                          break;
+                case 'I': prefetch = parse_count(argv[0], optarg); break;
+                case 'f': config.heap_file = optarg; break;
+                case 'B': config.heap_bytes =
+                          parse_count(argv[0], optarg); break;
+                case 'R': resume = 1; break;
+                case 'P': checkpoint = optarg; break;
+                case 'E': checkpoint_every = parse_seconds(argv[0], optarg);
+                          break;
+                case 'T': restore = 1; break;
+                case 'y': record = optarg; break;
+                case 'Y': replay = optarg; break;
+                case 'x': trace = optarg; break;
+                case 'F': profile = optarg; break;
+                case 'z': {
+                        char *end;
+                        breaks[break_count++] = parse_word(argv[0], optarg,
+                                                           &end);
+                        if (*end != '\0') {
+                                usage(argv[0]);
+                        }
+                        break;
+                }
+                case 'Z': watches[watch_count++] =
+                          parse_watch(argv[0], optarg); break;
+                case 'L': server.socket_path = optarg; break;
+                case 'i': images[image_count++].arg = optarg; break;
+                case 'n': images[image_count].snapshot = true;
+                          images[image_count++].arg = optarg; break;
+                case 'k': server.workers = parse_count(argv[0], optarg);
+                          break;
+                case 'p': server.pool = parse_count(argv[0], optarg); break;
+                case 'K': bench = parse_count(argv[0], optarg); break;
+                default:  usage(argv[0]);
+                }
+        }
+        if (server.socket_path != NULL) {
+                if (optind != argc || image_count == 0) {
+                        usage(argv[0]);
+                }
+                server.vm = config;
+                serve(argv[0], &server, images, image_count);
+        }
+        free(images);
+        if (bench >= 0) {
+                if (optind == argc || config.heap_file != NULL || resume) {
+                        usage(argv[0]);
+                }
+                bench_run(argv + optind, argc - optind, bench, &config,
+                          stdout);
+                exit(EXIT_SUCCESS);
+        }
+
         /* EXIT_FAILURE if given incorrect input format */
-        if (argc != 2) {
+        if (optind != argc - 1 || (resume && restore) ||
+            (config.heap_file != NULL && (checkpoint != NULL || restore))) {
+                usage(argv[0]);
+        }
+
+        /* Open um, append all instructions to segment 0, run to completion */
+        UM_T um;
+        if (resume) {
+                config.heap_file = argv[optind];
+                um = um_resume(config.heap_file, &config);
+                if (um == NULL) {
+                        fprintf(stderr, "%s: Cannot resume this heap "
+                                "image\n", config.heap_file);
+                        exit(EXIT_FAILURE);
+                }
+        } else if (restore) {
+                um = um_restore(argv[optind], &config);
+                if (um == NULL) {
+                        fprintf(stderr, "%s: Cannot restore this "
+                                "checkpoint\n", argv[optind]);
+                        exit(EXIT_FAILURE);
+                }
+        } else {
+                um = um_new(argv[optind], &config);
+        }
+        um_set_async_output(um, async_output);
+        um_set_prefetch(um, prefetch);
+        FILE *record_log = record != NULL ? fopen(record, "wb") : NULL;
+        FILE *replay_log = replay != NULL ? fopen(replay, "rb") : NULL;
+        if ((record != NULL && record_log == NULL) ||
+            (replay != NULL && (replay_log == NULL || 
+                                !um_set_replay(um, replay_log)))) {
+                fprintf(stderr, "%s: Cannot open input log %s\n", argv[0],
+                        record_log == NULL && record != NULL ? record 
+                                                             : replay);
                 exit(EXIT_FAILURE);
         }
-        /* Open um, append all instructions to segment 0, close um */
-        run_um(argv[1]);
-        
+        if (record_log != NULL) {
+                um_set_record(um, record_log);
+        }
+        int trace_fd = -1;
+        Tracer_T tracer = NULL;
+        if (trace != NULL) {
+                trace_fd = open(trace, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+                tracer = trace_fd >= 0 ? tracer_new(trace_fd) : NULL;
+                if (tracer == NULL) {
+                        fprintf(stderr, "%s: Cannot open trace %s\n",
+                                argv[0], trace);
+                        exit(EXIT_FAILURE);
+                }
+                um_set_trace(um, tracer);
+        }
+        FILE *profile_out = NULL;
+        Profile_T profiler = NULL;
+        if (profile != NULL) {
+                profile_out = fopen(profile, "w");
+                if (profile_out == NULL) {
+                        fprintf(stderr, "%s: Cannot open profile %s\n",
+                                argv[0], profile);
+                        exit(EXIT_FAILURE);
+                }
+                profiler = profile_new();
+                um_set_profile(um, profiler);
+        }
+        for (int i = 0; i < break_count; i++) {
+                um_break(um, breaks[i]);
+        }
+        for (int i = 0; i < watch_count; i++) {
+                um_watch(um, watches[i].segment, watches[i].offset,
+                         watches[i].length);
+        }
+        free(breaks);
+        free(watches);
+        if (config.heap_file != NULL || checkpoint != NULL) {
+                running = um;
+                signal(SIGINT, stop_running);
+                signal(SIGTERM, stop_running);
+        }
+        UM_status status = checkpoint != NULL 
+                ? run_saving(argv[0], um, checkpoint, checkpoint_every)
+                : report_stops(argv[0], um);
+        fflush(stdout);
+        if (status == UM_FAULT) {
+                fprintf(stderr, "%s: fault: %s\n", argv[0], 
+                        um_fault_reason(um));
+        } else if (status == UM_BUDGET_EXHAUSTED) {
+                fprintf(stderr, "%s: budget exhausted after %llu "
+                        "instructions\n", argv[0], 
+                        (unsigned long long)um_stats(um).instructions);
+        }
+        if (print_stats) {
+                um_print_stats(um, stderr);
+        }
+        if (record_log != NULL && (!um_set_record(um, NULL) || 
+                                   fclose(record_log) != 0)) {
+                fprintf(stderr, "%s: could not write %s\n", argv[0], 
+                        record);
+        }
+        if (tracer != NULL) {
+                um_set_trace(um, NULL);
+                if (!tracer_free(&tracer) || close(trace_fd) != 0) {
+                        fprintf(stderr, "%s: could not write %s\n",
+                                argv[0], trace);
+                }
+        }
+        if (profiler != NULL) {
+                um_set_profile(um, NULL);
+                if (print_stats) {
+                        profile_print(profiler, stderr);
+                }
+                if (!profile_write(profiler, profile_out) ||
+                    fclose(profile_out) != 0) {
+                        fprintf(stderr, "%s: could not write %s\n",
+                                argv[0], profile);
+                }
+                profile_free(&profiler);
+        }
+        if (config.heap_file != NULL && status == UM_BUDGET_EXHAUSTED) {
+                if (um_checkpoint(um)) {
+                        fprintf(stderr, "%s: saved to %s; continue with "
+                                "--resume\n", argv[0], config.heap_file);
+                } else {
+                        fprintf(stderr, "%s: could not save %s\n", argv[0],
+                                config.heap_file);
+                }
+        } else if (config.heap_file != NULL) {
+                /* The image's saved state was dropped when the UM ran on,
+                   so after a halt or fault it holds nothing to resume */
+                unlink(config.heap_file);
+        }
+        if (checkpoint != NULL && status == UM_BUDGET_EXHAUSTED) {
+                if (um_checkpoint_fork(um, checkpoint) && 
+                    um_checkpoint_poll(um, true) == UM_SAVE_DONE) {
+                        fprintf(stderr, "%s: saved to %s; continue with "
+                                "--restore\n", argv[0], checkpoint);
+                } else {
+                        fprintf(stderr, "%s: could not save %s\n", argv[0],
+                                checkpoint);
+                }
+        } else if (checkpoint != NULL && status == UM_HALTED) {
+                unlink(checkpoint);
+        }
+
+        /* The process is about to exit, so skip tearing down the UM */
+        um_fast_exit(um, status == UM_HALTED ? 0 : EXIT_FAILURE);
         return 0;
-}
\ No newline at end of file
+}
@@ -19,12 +19,95 @@
  **************************************************************/
 #include "um_status.h"
 
+/* A breakpoint: its trap replaced original in segment 0 if patched; it
+   is not while segment 0 is too short to hold pc */
+typedef struct Break {
+        uint32_t        pc;
+        uint32_t        original;
+        bool            patched;
+} Break;
+
+/* Words offset to offset + length - 1 of a segment, whose stores stop
+   the UM */
+typedef struct Watch {
+        uint32_t        segment;
+        uint32_t        offset;
+        uint32_t        length;
+} Watch;
+
+/* A breakpoint is the invalid opcode 14, which otherwise executes as a
+   no-op, patched over the instruction at its pc */
+#define TRAP_OPCODE     14
+#define TRAP_WORD       ((uint32_t)TRAP_OPCODE << 28)
+
 /************* UM_T struct ********
  * 
  * uint32_t registers[]: array of uint32_t, corresponding to 8 registers 
  * uint32_t pc: program counter, keeps track of the instruction being executed
  * uinted 32_t num_of_word: the number of words added to instruction segment
  * Segments_T Segments: struct representing mapped segments and unmapped IDs
+ * UM_status status: UM_RUNNING until halt or a fault stops the UM
+ * const char *fault: reason for the fault when status is UM_FAULT
+ * uint64_t instructions: instructions executed before block_start
+ * uint64_t blocks: number of load program jumps taken
+ * uint32_t block_start: pc at which the current basic block began
+ * uint64_t budget_end: value of instructions at which to stop
+ * uint64_t next_event: earliest of budget_end, next_compact and next_sweep,
+ *                      so that a block boundary needs one comparison to
+ *                      find out whether anything is due
+ * uint64_t compact_every: instructions between compactions, 0 for none
+ * uint64_t next_compact: value of instructions at which to compact
+ * uint64_t compactions, compacted_bytes: totals for the stats
+ * uint64_t cold_after: instructions a segment must go unused before it is
+ *                      compressed, 0 for never
+ * uint64_t next_sweep: value of instructions at which to compress segments
+ *                      unused since the previous sweep
+ * sig_atomic_t deadline_hit: set by um_interrupt
+ * timer_t deadline: one-shot timer armed by um_set_deadline
+ * int deadline_slot: slot of deadline_fired the timer signals, or -1 if
+ *                    no timer is armed
+ * int deadline_token: the slot's value once the timer has fired
+ * bool heap_file: whether the segments are backed by a heap image file
+ * FILE *input, *output: streams for the input and output instructions
+ * int input_fd: descriptor the input instruction reads instead of input,
+ *               or -1
+ * bool fed: whether input comes only from um_feed_input
+ * uint8_t *in_buf: bytes read from input_fd or fed, not yet consumed
+ * size_t in_pos, in_len, in_cap: consumed, total and allocated bytes of
+ *                                in_buf
+ * bool in_eof: whether input_fd has reached end of file, or the host has
+ *              ended fed input
+ * uint32_t ready_bytes: input instructions after the next that are known
+ *                       to complete without waiting, from the bytes the
+ *                       input descriptor last had ready
+ * uint64_t block_end: value of blocks at which to yield
+ * Writer_T writer: ring drained to the output stream's descriptor by a
+ *                  thread, used instead of the stream itself, or NULL
+ * Prefetch_T prefetch: ring filled from the input stream's descriptor by
+ *                      a thread, read instead of the stream, or NULL
+ * Replay_T record: log of every value input returns, or NULL
+ * Replay_T replay: log that input returns values from instead of reading
+ *                  input, or NULL
+ * Trace_T trace: stream every executed instruction is recorded to, or
+ *                NULL
+ * Break *breaks: breakpoints, with the words their traps replaced
+ * uint32_t break_count, break_cap: breakpoints set and allocated
+ * Watch *watches: watched ranges of segment words
+ * uint32_t watch_count, watch_cap: ranges watched and allocated
+ * bool debugging: whether any breakpoint or watchpoint is set or the UM
+ *                 is profiled, so that segmented loads and stores take
+ *                 the checked path
+ * bool stepping: stopped at a breakpoint, whose own instruction um_run
+ *                executes before going on
+ * UM_stop stop: what the UM last stopped at with UM_BREAKPOINT
+ * Profile_T profile: call-graph profile fed every load program, or NULL
+ * pid_t saver: child writing a checkpoint file, or 0
+ * char *save_temp: file the child writes, renamed over the checkpoint
+ *                  once complete
+ * 
+ * Budgets are charged a whole basic block at a time when load program ends
+ * the block, so the only per-instruction check stays the status test in
+ * um_run's loop.
  * 
  *********************************/
 struct UM_T {
@@ -32,13 +115,406 @@ struct UM_T {
         uint32_t        pc;              /* program counter */
         uint32_t        num_of_word;     /* number of words (instructions) */
         Segments_T      Segments;        /* memory segments */
+        UM_status       status;          /* why execution stopped */
+        const char     *fault;           /* fault reason, NULL if none */
+        uint64_t        instructions;    /* charged at block boundaries */
+        uint64_t        blocks;          /* load program jumps taken */
+        uint32_t        block_start;     /* pc where the block began */
+        uint64_t        budget_end;      /* stop once instructions reach */
+        uint64_t        next_event;      /* earliest of the thresholds */
+        uint64_t        compact_every;   /* compaction interval, 0 if off */
+        uint64_t        next_compact;    /* compact once instructions reach */
+        uint64_t        compactions;     /* compactions run */
+        uint64_t        compacted_bytes; /* bytes moved by compactions */
+        uint64_t        cold_after;      /* sweep interval, 0 if off */
+        uint64_t        next_sweep;      /* sweep once instructions reach */
+        volatile sig_atomic_t deadline_hit; /* set by um_interrupt */
+        timer_t         deadline;        /* deadline timer */
+        int             deadline_slot;   /* its slot, or -1 if unarmed */
+        int             deadline_token;  /* slot's value once it fires */
+        bool            heap_file;       /* segments live in a heap image */
+        FILE           *input;           /* read by the input instruction */
+        FILE           *output;          /* written by the output one */
+        int             input_fd;        /* raw input, or -1 for input */
+        bool            fed;             /* input is pushed by the host */
+        uint8_t        *in_buf;          /* buffer for input_fd or feeds */
+        size_t          in_pos;          /* next unread byte of in_buf */
+        size_t          in_len;          /* bytes in in_buf */
+        size_t          in_cap;          /* bytes allocated for in_buf */
+        bool            in_eof;          /* no input will follow in_buf */
+        uint32_t        ready_bytes;     /* inputs sure not to wait */
+        uint64_t        block_end;       /* yield once blocks reach */
+        Writer_T        writer;          /* async output, or NULL */
+        Prefetch_T      prefetch;        /* read-ahead input, or NULL */
+        Replay_T        record;          /* input log written, or NULL */
+        Replay_T        replay;          /* input log read, or NULL */
+        Trace_T         trace;           /* execution trace, or NULL */
+        Break          *breaks;          /* breakpoints */
+        uint32_t        break_count;     /* breakpoints set */
+        uint32_t        break_cap;       /* breakpoints allocated */
+        Watch          *watches;         /* watched words */
+        uint32_t        watch_count;     /* ranges watched */
+        uint32_t        watch_cap;       /* ranges allocated */
+        bool            debugging;       /* any breakpoint or watch */
+        bool            stepping;        /* resume over a breakpoint */
+        UM_stop         stop;            /* last breakpoint or watch hit */
+        Profile_T       profile;         /* call-graph profile, or NULL */
+        pid_t           saver;           /* checkpoint writer, or 0 */
+        char           *save_temp;       /* its temporary file */
 };
 
-bool halted = false; /* Keeps track of whether the input um called halt */
+/* Bytes read from an input descriptor at a time, and the least
+   allocated for fed input */
+#define INPUT_BYTES 4096
+
+#define NEVER UINT64_MAX
+
+/* Most segment memory of a heap image when UM_config.heap_bytes is 0 */
+#define DEFAULT_HEAP_BYTES ((uint64_t)256 << 30)
+
+/* Positions of the UM's registers and counters in a checkpoint's state */
+enum { STATE_PC = 8, STATE_WORDS, STATE_INSTRUCTIONS, STATE_BLOCKS = 12 };
+
+/* Realtime signal used by deadline timers, leaving SIGALRM to the host */
+#define DEADLINE_SIGNAL SIGRTMIN
+
+/*
+ * A deadline timer's signal carries a token naming a slot of the tables
+ * below, never the UM, so that a signal still queued when its UM is freed
+ * cannot write into freed memory. The token is the slot in its low
+ * DEADLINE_SLOT_BITS bits and the slot's generation above them, renewed
+ * each time the slot is taken. The handler copies the token into
+ * deadline_fired only while deadline_armed holds it, and the UM's
+ * deadline has passed once deadline_fired holds its own token, so a late
+ * signal of an earlier timer in the slot is ignored. The signal may be
+ * handled on any thread, so the tables are lock-free atomics rather than
+ * volatile sig_atomic_t.
+ */
+#define DEADLINE_SLOT_BITS 16
+#define DEADLINE_SLOTS (1u << DEADLINE_SLOT_BITS)
+#define DEADLINE_GENERATIONS 32767
+
+static atomic_int deadline_armed[DEADLINE_SLOTS];
+static atomic_int deadline_fired[DEADLINE_SLOTS];
+static uint16_t deadline_generation[DEADLINE_SLOTS];
+static bool deadline_taken[DEADLINE_SLOTS];
+static uint32_t deadline_cursor;
+static pthread_mutex_t deadline_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/********** um_fault ********
+ *
+ * Stops the UM with a VM fault, leaving memory intact for the host
+ *
+ * Parameters:
+ *      UM_T um: the UM that faulted
+ *      const char *reason: static description of the fault
+ *
+ * Return: None
+ *
+ * Expects
+ *      um and reason must not be NULL
+ * Notes:
+ *      Will CRE if um or reason is NULL
+ ************************/
+static void um_fault(UM_T um, const char *reason)
+{
+        assert(um != NULL && reason != NULL);
+        um->status = UM_FAULT;
+        um->fault = reason;
+}
+
+/********** end_block ********
+ *
+ * Charges the instructions of the basic block that ends at the current pc
+ * and starts a new block there
+ *
+ * Parameters:
+ *      UM_T um: the UM whose block ended
+ *
+ * Return: None
+ *
+ * Expects
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ ************************/
+static inline void end_block(UM_T um)
+{
+        assert(um != NULL);
+        um->instructions += um->pc - um->block_start;
+        um->block_start = um->pc;
+}
+
+/********** update_next_event ********
+ *
+ * Recomputes the instruction count at which a block boundary must stop to
+ * handle a budget, compaction or cold sweep
+ *
+ * Parameters:
+ *      UM_T um: the UM to update
+ *
+ * Return: None
+ ************************/
+static inline void update_next_event(UM_T um)
+{
+        uint64_t next = um->budget_end < um->next_compact ? um->budget_end 
+                                                         : um->next_compact;
+        um->next_event = next < um->next_sweep ? next : um->next_sweep;
+}
+
+/********** deadline_handler ********
+ *
+ * Signal handler for deadline timers; marks the timer's slot fired if the
+ * timer is still armed
+ ************************/
+static void deadline_handler(int sig, siginfo_t *info, void *context)
+{
+        (void)sig;
+        (void)context;
+        int token = info->si_value.sival_int;
+        uint32_t slot = (uint32_t)token & (DEADLINE_SLOTS - 1);
+        if (atomic_load(&deadline_armed[slot]) == token) {
+                atomic_store(&deadline_fired[slot], token);
+        }
+}
+
+/********** take_deadline_slot ********
+ *
+ * Gives the UM a free slot of deadline_fired under a new generation
+ *
+ * Notes:
+ *      Will CRE if every slot is taken
+ ************************/
+static void take_deadline_slot(UM_T um)
+{
+        pthread_mutex_lock(&deadline_lock);
+        uint32_t slot = deadline_cursor;
+        uint32_t tried = 0;
+        while (deadline_taken[slot]) {
+                slot = (slot + 1) & (DEADLINE_SLOTS - 1);
+                tried++;
+                assert(tried < DEADLINE_SLOTS);
+        }
+        deadline_taken[slot] = true;
+        deadline_cursor = (slot + 1) & (DEADLINE_SLOTS - 1);
+        deadline_generation[slot] = deadline_generation[slot] % 
+                                    DEADLINE_GENERATIONS + 1;
+        pthread_mutex_unlock(&deadline_lock);
+
+        um->deadline_slot = (int)slot;
+        um->deadline_token = (int)(slot | (uint32_t)deadline_generation[slot]
+                                          << DEADLINE_SLOT_BITS);
+        atomic_store(&deadline_armed[slot], um->deadline_token);
+}
+
+/********** disarm_deadline ********
+ *
+ * Deletes the UM's deadline timer, if any, and gives back its slot; a
+ * signal of the timer that arrives later is ignored
+ ************************/
+static void disarm_deadline(UM_T um)
+{
+        if (um->deadline_slot < 0) {
+                return;
+        }
+        uint32_t slot = (uint32_t)um->deadline_slot;
+        atomic_store(&deadline_armed[slot], 0);
+        timer_delete(um->deadline);
+        pthread_mutex_lock(&deadline_lock);
+        deadline_taken[slot] = false;
+        pthread_mutex_unlock(&deadline_lock);
+        um->deadline_slot = -1;
+        um->deadline_token = 0;
+}
+
+/********** deadline_passed ********
+ *
+ * Returns whether the UM was interrupted or its deadline timer has fired
+ ************************/
+static inline bool deadline_passed(UM_T um)
+{
+        return um->deadline_hit || (um->deadline_slot >= 0 && 
+               atomic_load_explicit(&deadline_fired[um->deadline_slot],
+                                    memory_order_relaxed) == 
+               um->deadline_token);
+}
+
+/********** maintain ********
+ *
+ * Runs a compaction and a cold sweep if either has come due; only called
+ * at safe points, where no segment pointers are held
+ *
+ * Parameters:
+ *      UM_T um: the UM at a safe point
+ *      uint64_t now: instructions executed so far
+ *
+ * Return: None
+ ************************/
+static inline void maintain(UM_T um, uint64_t now)
+{
+        if (now >= um->next_compact) {
+                um_compact(um);
+        }
+        if (now >= um->next_sweep) {
+                um_sweep_cold(um);
+        }
+}
+
+/********** block_event ********
+ *
+ * Handles whatever is due at a block boundary: a compaction or cold sweep,
+ * which is safe here because no segment pointers are held between
+ * instructions, and the budget and deadline checks
+ *
+ * Parameters:
+ *      UM_T um: the UM at a block boundary
+ *
+ * Return: None
+ ************************/
+static void block_event(UM_T um)
+{
+        maintain(um, um->instructions);
+        if (um->instructions >= um->budget_end || deadline_passed(um)) {
+                um->status = UM_BUDGET_EXHAUSTED;
+        } else if (um->blocks >= um->block_end) {
+                um->status = UM_YIELDED;
+        }
+}
+
+/********** read_buffered ********
+ *
+ * Takes the next byte of buffered input. When the buffer is empty, input
+ * from a descriptor is refilled with one large read; fed input has to
+ * wait for the host.
+ *
+ * Parameters:
+ *      UM_T um: the UM executing input
+ *      uint32_t *rc: register to receive the byte, or all ones at EOF
+ *
+ * Return: 
+ *      false if no input is available yet
+ ************************/
+static bool read_buffered(UM_T um, uint32_t *rc)
+{
+        while (um->in_pos == um->in_len && !um->in_eof) {
+                if (um->fed) {
+                        return false;
+                }
+                ssize_t got = read(um->input_fd, um->in_buf, INPUT_BYTES);
+                if (got > 0) {
+                        um->in_pos = 0;
+                        um->in_len = (size_t)got;
+                } else if (got == 0 || (errno != EINTR && errno != EAGAIN &&
+                                        errno != EWOULDBLOCK)) {
+                        um->in_eof = true;
+                } else if (errno != EINTR) {
+                        return false;
+                }
+        }
+        *rc = um->in_pos < um->in_len ? um->in_buf[um->in_pos++] 
+                                       : ~(uint32_t)0;
+        return true;
+}
+
+/********** input_ready ********
+ *
+ * Tells whether the next input instruction can complete without waiting,
+ * so that output need not be flushed before it. Counting the bytes the
+ * descriptor has ready spares a system call on as many inputs after it.
+ *
+ * Parameters:
+ *      UM_T um: the UM executing input
+ *      FILE *fp: the UM's input stream
+ *
+ * Return: 
+ *      true if input is buffered, or the stream's descriptor has bytes
+ *      ready; stream input buffered by stdio alone is not seen, and end
+ *      of file counts as not ready, so that output is flushed before a
+ *      program that reads past the end stops
+ ************************/
+static bool input_ready(UM_T um, FILE *fp)
+{
+        if (um->replay != NULL) {
+                return true;
+        }
+        if (um->fed || (um->input_fd >= 0 && um->in_pos < um->in_len)) {
+                return um->in_pos < um->in_len || um->in_eof;
+        }
+        if (um->prefetch != NULL && um->input_fd < 0) {
+                return prefetch_ready(um->prefetch);
+        }
+        int fd = um->input_fd >= 0 ? um->input_fd : fileno(fp);
+        int available = 0;
+        if (ioctl(fd, FIONREAD, &available) == 0) {
+                um->ready_bytes = available > 0 ? available - 1 : 0;
+                return available > 0;
+        }
+        struct pollfd ready = { fd, POLLIN, 0 };
+        return poll(&ready, 1, 0) == 1;
+}
+
+/********** um_read_input ********
+ *
+ * Reads a byte of input into rc. Waiting for input is also a safe point,
+ * so a compaction or cold sweep that has come due runs first. Output,
+ * stdio's or asynchronous, is flushed only if the UM might wait, so that
+ * a prompt is seen before the UM waits for the answer without a write
+ * per input byte when input is plentiful.
+ *
+ * If buffered input has run out and no more can be read without waiting,
+ * the input instruction is undone and the UM stops with UM_NEEDS_INPUT,
+ * so that the next um_run retries it.
+ *
+ * Values are taken from the replay log instead, if there is one, and the
+ * UM faults if the log has no value recorded at this instruction count.
+ * Otherwise each value read is appended to the record log, if any.
+ *
+ * Parameters:
+ *      UM_T um: the UM executing input
+ *      FILE *fp: the UM's input stream
+ *      uint32_t *rc: register to receive the byte
+ *
+ * Return: None
+ ************************/
+static void um_read_input(UM_T um, FILE *fp, uint32_t *rc)
+{
+        assert(um != NULL && fp != NULL && rc != NULL);
+        uint64_t now = um->instructions + (um->pc - um->block_start);
+        maintain(um, now);
+        bool pending = __fpending(um->output) > 0 ||
+                       (um->writer != NULL && writer_pending(um->writer));
+        if (um->ready_bytes > 0) {
+                um->ready_bytes--;
+        } else if (pending && !input_ready(um, fp)) {
+                fflush(um->output);
+                if (um->writer != NULL && writer_pending(um->writer)) {
+                        writer_flush(um->writer);
+                }
+        }
+        if (um->replay != NULL) {
+                if (!replay_get(um->replay, now, rc)) {
+                        um_fault(um, "input departs from the replay log");
+                }
+                return;
+        }
+        if (um->prefetch != NULL && um->input_fd < 0 && !um->fed) {
+                *rc = (uint32_t)prefetch_get(um->prefetch);
+        } else if (um->input_fd < 0 && !um->fed) {
+                um_input(fp, rc);
+        } else if (!read_buffered(um, rc)) {
+                um->pc--;
+                um->status = UM_NEEDS_INPUT;
+                return;
+        }
+        if (um->record != NULL) {
+                replay_put(um->record, now, *rc);
+        }
+}
 
 /********** um_map_seg ********
  *
- * Maps a segment of memory with a unique segment ID
+ * Maps a segment of memory with a unique segment ID, faulting the UM if a
+ * hard memory limit refuses the mapping
  *
  * Parameters:
  *      UM_T um: pointer to register in wh
@@ -57,7 +533,12 @@ static void um_map_seg(UM_T um, uint32_t* rb, uint32_t* rc)
 {
         assert(um != NULL && rb != NULL && rc != NULL);
         uint32_t length = *rc;
-        *rb = map_segment(um->Segments, length); /* storing new map id to rb */
+        uint32_t map_id = map_segment(um->Segments, length);
+        if (map_id == SEGMENT_FAULT) {
+                um_fault(um, "hard memory limit exceeded by map segment");
+                return;
+        }
+        *rb = map_id; /* storing new map id to rb */
 }
 
 /********** um_unmap_seg ********
@@ -129,6 +610,135 @@ static void um_set_word(UM_T um, uint32_t seg_ID, uint32_t offset,
         set_word(um->Segments, seg_ID, offset, value);
 }
 
+/********** find_break ********
+ *
+ * Returns the breakpoint at pc, or NULL if there is none
+ ************************/
+static Break *find_break(UM_T um, uint32_t pc)
+{
+        for (uint32_t i = 0; i < um->break_count; i++) {
+                if (um->breaks[i].pc == pc) {
+                        return &um->breaks[i];
+                }
+        }
+        return NULL;
+}
+
+/********** original_word ********
+ *
+ * Returns the word of segment 0 at offset as the program wrote it, with
+ * any breakpoint's trap taken out
+ ************************/
+static uint32_t original_word(UM_T um, uint32_t offset)
+{
+        Break *brk = find_break(um, offset);
+        if (brk != NULL && brk->patched) {
+                return brk->original;
+        }
+        return um_get_word(um, 0, offset);
+}
+
+/********** patch_breaks ********
+ *
+ * Puts every breakpoint's trap into segment 0, saving the word it
+ * replaces, or takes them all out again, so that segment 0 can be saved
+ * or copied as the program wrote it
+ ************************/
+static void patch_breaks(UM_T um, bool patch)
+{
+        for (uint32_t i = 0; i < um->break_count; i++) {
+                Break *brk = &um->breaks[i];
+                if (patch && brk->pc < um->num_of_word) {
+                        brk->original = um_get_word(um, 0, brk->pc);
+                        um_set_word(um, 0, brk->pc, TRAP_WORD);
+                        brk->patched = true;
+                } else if (!patch && brk->patched) {
+                        um_set_word(um, 0, brk->pc, brk->original);
+                        brk->patched = false;
+                } else {
+                        brk->patched = false;
+                }
+        }
+}
+
+/********** check_debugging ********
+ *
+ * Sends segmented loads and stores down the checked path while anything
+ * needs to see them
+ ************************/
+static void check_debugging(UM_T um)
+{
+        um->debugging = um->break_count != 0 || um->watch_count != 0 ||
+                        um->profile != NULL;
+}
+
+/********** stop_at ********
+ *
+ * Stops the UM with UM_BREAKPOINT, recording what it stopped at
+ ************************/
+static void stop_at(UM_T um, uint32_t pc, bool watch, uint32_t seg_ID,
+                    uint32_t offset, uint32_t old_value, uint32_t value)
+{
+        um->status = UM_BREAKPOINT;
+        um->stop.pc = pc;
+        um->stop.watch = watch;
+        um->stop.segment = seg_ID;
+        um->stop.offset = offset;
+        um->stop.old_value = old_value;
+        um->stop.value = value;
+        memcpy(um->stop.registers, um->registers, sizeof(um->registers));
+}
+
+/********** um_trap ********
+ *
+ * Executes opcode 14: at a breakpoint, undoes the fetch and stops the UM
+ * before the instruction the trap replaced; anywhere else, does nothing,
+ * as opcode 14 always has
+ ************************/
+static void um_trap(UM_T um)
+{
+        uint32_t pc = um->pc - 1;
+        Break *brk = find_break(um, pc);
+        if (brk == NULL || !brk->patched) {
+                return;
+        }
+        um->pc = pc;
+        um->stepping = true;
+        stop_at(um, pc, false, 0, 0, 0, 0);
+}
+
+/********** debug_store ********
+ *
+ * Segmented store while debugging: the profile notes the value, a store
+ * over a breakpoint's trap replaces the word saved under it instead, and
+ * a store to a watched word stops the UM once it is done
+ ************************/
+static void debug_store(UM_T um, uint32_t seg_ID, uint32_t offset,
+                        uint32_t value)
+{
+        if (um->profile != NULL) {
+                profile_store(um->profile, value);
+        }
+        uint32_t old_value = um_get_word(um, seg_ID, offset);
+        Break *brk = seg_ID == 0 && old_value >> 28 == TRAP_OPCODE
+                     ? find_break(um, offset) : NULL;
+        if (brk != NULL && brk->patched) {
+                old_value = brk->original;
+                brk->original = value;
+        } else {
+                um_set_word(um, seg_ID, offset, value);
+        }
+        for (uint32_t i = 0; i < um->watch_count; i++) {
+                Watch *watch = &um->watches[i];
+                if (watch->segment == seg_ID &&
+                    offset - watch->offset < watch->length) {
+                        stop_at(um, um->pc - 1, true, seg_ID, offset,
+                                old_value, value);
+                        return;
+                }
+        }
+}
+
 /********** um_seg_load ********
  *
  * Updates the value of a word at segments[seg_ID][offset]
@@ -150,7 +760,11 @@ static void um_set_word(UM_T um, uint32_t seg_ID, uint32_t offset,
 static void um_seg_load(UM_T um, uint32_t* ra, uint32_t* rb, uint32_t* rc)
 {
         assert(um != NULL);
-        *ra = um_get_word(um, *rb, *rc);
+        uint32_t word = um_get_word(um, *rb, *rc);
+        if (um->debugging && *rb == 0 && word >> 28 == TRAP_OPCODE) {
+                word = original_word(um, *rc);
+        }
+        *ra = word;
 }
 
 /********** um_seg_store ********
@@ -174,12 +788,19 @@ static void um_seg_load(UM_T um, uint32_t* ra, uint32_t* rb, uint32_t* rc)
 static void um_seg_store(UM_T um, uint32_t* ra, uint32_t* rb, uint32_t* rc)
 {
         assert(um != NULL);
-        um_set_word(um, *ra, *rb, *rc);
+        if (um->debugging) {
+                debug_store(um, *ra, *rb, *rc);
+        } else {
+                um_set_word(um, *ra, *rb, *rc);
+        }
 }
 
 /********** um_load_prog ********
  *
- * Duplicates the segment whose ID is rb and replaces segment 0 with it 
+ * Duplicates the segment whose ID is rb and replaces segment 0 with it,
+ * faulting the UM if a hard memory limit refuses the copy. As the only
+ * jump, load program also ends the basic block, so this is where the
+ * instruction budget and deadline are enforced.
  * 
  * Parameters:
  *      UM_T um: the UM whose segment will be modified (unmapped)
@@ -196,13 +817,37 @@ static void um_seg_store(UM_T um, uint32_t* ra, uint32_t* rb, uint32_t* rc)
 static void um_load_prog(UM_T um, uint32_t* rb, uint32_t* rc)
 {
         assert(um != NULL);
-        um->num_of_word = duplicate(um->Segments, *rb);
+        uint32_t length = duplicate(um->Segments, *rb);
+        if (length == SEGMENT_FAULT) {
+                um_fault(um, "hard memory limit exceeded by load program");
+                return;
+        }
+        um->num_of_word = length;
+        if (*rb != 0 && um->break_count != 0) {
+                patch_breaks(um, true);
+        }
+
+        /* The jump ends a basic block: charge it and check the budget */
+        end_block(um);
+        um->blocks++;
+        if (um->profile != NULL) {
+                uint32_t site = um->pc - 1;
+                uint32_t previous = *rb == 0 && site > 0
+                                    ? original_word(um, site - 1) : ~0u;
+                profile_jump(um->profile, site, *rc, previous, *rb != 0,
+                             um->registers, um->instructions);
+        }
         um->pc = *rc;
+        um->block_start = um->pc;
+        if (um->instructions >= um->next_event || 
+            um->blocks >= um->block_end || deadline_passed(um)) {
+                block_event(um);
+        }
 }
 
 /********** um_halt ********
  *
- * Stops program computation and frees all memory 
+ * Stops program computation; memory is released later by um_free
  * 
  * Parameters:
  *      UM_T um: the UM whose execution will be halted 
@@ -217,7 +862,7 @@ static void um_load_prog(UM_T um, uint32_t* rb, uint32_t* rc)
 static void um_halt(UM_T um)
 {
         assert(um != NULL);
-        free_Segments(&(um->Segments));
+        um->status = UM_HALTED;
 }
 
 /********** cases ********
@@ -255,15 +900,20 @@ static void cases(int opcode, uint32_t* ra, uint32_t* rb, uint32_t* rc,
         } else if (opcode == 6) {
                 um_nand(ra, rb, rc);
         } else if (opcode == 7) {
-                halted = true;
+                um_halt(um);
         } else if (opcode == 8) {
                 um_map_seg(um, rb, rc);
         } else if (opcode == 9) {
                 um_unmap_seg(um, rc);
         } else if (opcode == 10) {
-                um_output(rc);
+                if (um->writer != NULL) {
+                        assert(*rc <= 255);
+                        writer_put(um->writer, (uint8_t)*rc);
+                } else {
+                        um_output(um->output, rc);
+                }
         } else if (opcode == 11) {
-                um_input(fp, rc);
+                um_read_input(um, fp, rc);
         } else if (opcode == 12) {
                 um_load_prog(um, rb, rc);
         }
@@ -295,7 +945,9 @@ static void execute_instruction(UM_T um, uint32_t word)
                 uint32_t* ra = &(um->registers[(int)Bitpack_getu(word, 3, 6)]);
                 uint32_t* rb = &(um->registers[(int)Bitpack_getu(word, 3, 3)]);
                 uint32_t* rc = &(um->registers[(int)Bitpack_getu(word, 3, 0)]);
-                cases(opcode, ra, rb, rc, stdin, um);
+                cases(opcode, ra, rb, rc, um->input, um);
+        } else if (opcode == TRAP_OPCODE && um->break_count != 0) {
+                um_trap(um);
         }
 }
 
@@ -332,7 +984,11 @@ static uint32_t read_file_to_seg0(char* file_name, UM_T um)
         assert(fp != NULL);
 
         /* Allocate memory for segments */
-        map_segment(um->Segments, num_of_instruction);
+        if (map_segment(um->Segments, num_of_instruction) == SEGMENT_FAULT) {
+                fclose(fp);
+                um_fault(um, "hard memory limit exceeded by segment 0");
+                return 0;
+        }
 
         uint32_t word;
         int curr_byte;
@@ -354,29 +1010,36 @@ static uint32_t read_file_to_seg0(char* file_name, UM_T um)
         return num_of_instruction;
 }
 
-/********** run_um ********
+/********** soft_limit_warning ********
  *
- * Initializes a UM and allocates memory for components
- * of the UM including registers and segments, executes all instructions, and
- * frees all memory.
+ * Default soft-limit callback, which warns on stderr
  * 
  * Parameters:
- *      char* fp: input .um file containing all instructions to be executed
+ *      void *cl: unused closure
+ *      Segments_usage usage: usage at the moment the soft limit was crossed
  * 
  * Return: None
+ ************************/
+static void soft_limit_warning(void *cl, Segments_usage usage)
+{
+        (void)cl;
+        fprintf(stderr, "um: soft memory limit exceeded (%llu words in "
+                "%lu segments)\n", (unsigned long long)usage.live_words,
+                (unsigned long)usage.live_segments);
+}
+
+/********** new_um ********
  *
- * Expects:
- *      fp must not be NULL
- * Notes:
- *      Will CRE if fp is NULL
- *      Heap memory allocated for UM_T um in this function will be freed by 
- *              the caller using an external function 
+ * Allocates a UM with zero registers and counters around its segments
+ * 
+ * Parameters:
+ *      Segments_T Segments: the UM's segments
+ * 
+ * Return: 
+ *      the new UM, not yet configured
  ************************/
-void run_um(char* fp)
+static UM_T new_um(Segments_T Segments)
 {
-        assert(fp != NULL);
-        /* Allocate memory for a UM and initialize all components including 
-           registers, program counter, and segments */
         UM_T um = malloc(sizeof(struct UM_T));
         assert(um != NULL);
         /* Zero-initialize all registers */
@@ -384,18 +1047,1599 @@ void run_um(char* fp)
                 um->registers[i] = 0;
         }
         um->pc = 0;
-        um->Segments = initialize_Segments();
+        um->num_of_word = 0;
+        um->status = UM_RUNNING;
+        um->fault = NULL;
+        um->instructions = 0;
+        um->blocks = 0;
+        um->block_start = 0;
+        um->budget_end = NEVER;
+        um->compact_every = 0;
+        um->next_compact = NEVER;
+        um->next_event = NEVER;
+        um->compactions = 0;
+        um->compacted_bytes = 0;
+        um->cold_after = 0;
+        um->next_sweep = NEVER;
+        um->deadline_hit = 0;
+        um->deadline_slot = -1;
+        um->deadline_token = 0;
+        um->heap_file = false;
+        um->input = stdin;
+        um->output = stdout;
+        um->input_fd = -1;
+        um->writer = NULL;
+        um->prefetch = NULL;
+        um->fed = false;
+        um->in_buf = NULL;
+        um->in_pos = 0;
+        um->in_len = 0;
+        um->in_cap = 0;
+        um->in_eof = false;
+        um->ready_bytes = 0;
+        um->block_end = NEVER;
+        um->record = NULL;
+        um->replay = NULL;
+        um->trace = NULL;
+        um->breaks = NULL;
+        um->break_count = 0;
+        um->break_cap = 0;
+        um->watches = NULL;
+        um->watch_count = 0;
+        um->watch_cap = 0;
+        um->debugging = false;
+        um->stepping = false;
+        memset(&um->stop, 0, sizeof(um->stop));
+        um->profile = NULL;
+        um->saver = 0;
+        um->save_temp = NULL;
+        um->Segments = Segments;
+        return um;
+}
 
-        /* Fill segment 0 by loading all given instructions */
-        um->num_of_word = read_file_to_seg0(fp, um);
-        
-        /* Execute all instructions by calling corresponding functions */
-        while (um->pc < um->num_of_word && !halted) {
-                uint32_t instruction = um_get_word(um, 0, (um->pc)++);
-                execute_instruction(um, instruction);
+/********** save_state ********
+ *
+ * Packs the registers, program counter and counters of a UM into the
+ * state words saved with its segments
+ ************************/
+static void save_state(UM_T um, uint32_t *state)
+{
+        memset(state, 0, SEGMENT_STATE_WORDS * sizeof(uint32_t));
+        for (int i = 0; i < 8; i++) {
+                state[i] = um->registers[i];
+        }
+        state[STATE_PC] = um->pc;
+        state[STATE_WORDS] = um->num_of_word;
+        state[STATE_INSTRUCTIONS] = (uint32_t)um->instructions;
+        state[STATE_INSTRUCTIONS + 1] = (uint32_t)(um->instructions >> 32);
+        state[STATE_BLOCKS] = (uint32_t)um->blocks;
+        state[STATE_BLOCKS + 1] = (uint32_t)(um->blocks >> 32);
+}
+
+/********** load_state ********
+ *
+ * Unpacks state words saved by save_state into a new UM
+ ************************/
+static void load_state(UM_T um, const uint32_t *state)
+{
+        for (int i = 0; i < 8; i++) {
+                um->registers[i] = state[i];
+        }
+        um->pc = state[STATE_PC];
+        um->block_start = um->pc;
+        um->num_of_word = state[STATE_WORDS];
+        um->instructions = (uint64_t)state[STATE_INSTRUCTIONS + 1] << 32 | 
+                           state[STATE_INSTRUCTIONS];
+        um->blocks = (uint64_t)state[STATE_BLOCKS + 1] << 32 | 
+                     state[STATE_BLOCKS];
+}
+
+/********** configure ********
+ *
+ * Applies a UM_config to a new UM
+ * 
+ * Parameters:
+ *      UM_T um: the UM to configure
+ *      const UM_config *config: settings for the UM, or NULL for defaults
+ * 
+ * Return: None
+ ************************/
+static void configure(UM_T um, const UM_config *config)
+{
+        if (config == NULL) {
+                return;
+        }
+        Segments_limits limits = config->limits;
+        if (limits.on_soft_limit == NULL) {
+                limits.on_soft_limit = soft_limit_warning;
+        }
+        set_segment_limits(um->Segments, limits);
+        set_deferred_reclaim(um->Segments, config->reclaim_words);
+        set_hugepage_policy(um->Segments, config->hugepages);
+        set_sparse_threshold(um->Segments, config->sparse_words);
+        set_dedup_threshold(um->Segments, config->dedup_words);
+        um_set_budget(um, config->budget);
+        um_set_compaction(um, config->compact_every);
+        um_set_cold_after(um, config->cold_after);
+        um_set_deadline(um, config->deadline);
+}
+
+/********** um_new ********
+ *
+ * Initializes a UM and allocates memory for components of the UM including
+ * registers and segments, then loads the given program into segment 0
+ * 
+ * Parameters:
+ *      char* file_name: input .um file containing all instructions
+ *      const UM_config *config: settings for the UM, or NULL for defaults
+ * 
+ * Return: 
+ *      the new UM, ready for um_run; its status is UM_FAULT if the program
+ *      did not fit within the configured hard limits
+ *
+ * Expects:
+ *      file_name must not be NULL
+ * Notes:
+ *      Will CRE if file_name is NULL or allocation fails
+ *      Exits with EXIT_FAILURE if the file cannot be found, or if the
+ *      configured heap image cannot be created
+ *      Heap memory allocated for the UM is freed by um_free
+ ************************/
+extern UM_T um_new(char *file_name, const UM_config *config)
+{
+        assert(file_name != NULL);
+        Segments_T Segments;
+        if (config != NULL && config->heap_file != NULL) {
+                Segments = initialize_Segments_file(config->heap_file, 
+                        config->heap_bytes != 0 ? config->heap_bytes 
+                                                : DEFAULT_HEAP_BYTES, NULL);
+                if (Segments == NULL) {
+                        fprintf(stderr, "%s: Cannot create heap image\n", 
+                                config->heap_file);
+                        exit(EXIT_FAILURE);
+                }
+        } else {
+                Segments = initialize_Segments();
         }
+        UM_T um = new_um(Segments);
+        um->heap_file = config != NULL && config->heap_file != NULL;
+
+        /* Configure before segment 0 is loaded so that it is covered too */
+        configure(um, config);
+
+        /* Fill segment 0 by loading all given instructions */
+        um->num_of_word = read_file_to_seg0(file_name, um);
+        return um;
+}
 
-        /* Halt program and free all memory */
-        um_halt(um);
-        free(um);
-}
\ No newline at end of file
+/********** um_resume ********
+ *
+ * Recreates a UM from the checkpoint in a heap image, with the registers,
+ * program counter, counters and segments it had when um_checkpoint ran
+ * 
+ * Parameters:
+ *      const char *heap_file: the heap image
+ *      const UM_config *config: settings for the UM, or NULL for defaults;
+ *                               its heap_file and heap_bytes are ignored
+ * 
+ * Return: 
+ *      the UM, ready for um_run, or NULL if the image cannot be mapped at
+ *      its original address or holds no checkpoint
+ *
+ * Expects:
+ *      heap_file must not be NULL
+ * Notes:
+ *      Will CRE if heap_file is NULL or allocation fails
+ ************************/
+extern UM_T um_resume(const char *heap_file, const UM_config *config)
+{
+        assert(heap_file != NULL);
+        uint32_t state[SEGMENT_STATE_WORDS];
+        Segments_T Segments = initialize_Segments_file(heap_file, 0, state);
+        if (Segments == NULL) {
+                return NULL;
+        }
+        UM_T um = new_um(Segments);
+        um->heap_file = true;
+        load_state(um, state);
+        configure(um, config);
+        return um;
+}
+
+/********** um_restore ********
+ *
+ * Recreates a UM from a checkpoint file written by um_checkpoint_fork,
+ * with the registers, program counter, counters and segments it had
+ * when the checkpoint was taken
+ * 
+ * Parameters:
+ *      const char *path: the checkpoint file
+ *      const UM_config *config: settings for the UM, or NULL for defaults;
+ *                               its heap_file is ignored
+ * 
+ * Return: 
+ *      the UM, in anonymous memory and ready for um_run, or NULL if the
+ *      file cannot be read or is not a complete checkpoint
+ *
+ * Expects:
+ *      path must not be NULL
+ * Notes:
+ *      Will CRE if path is NULL or allocation fails
+ ************************/
+extern UM_T um_restore(const char *path, const UM_config *config)
+{
+        assert(path != NULL);
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL) {
+                return NULL;
+        }
+        uint32_t state[SEGMENT_STATE_WORDS];
+        Segments_T Segments = read_segments(fp, state);
+        fclose(fp);
+        if (Segments == NULL) {
+                return NULL;
+        }
+        UM_T um = new_um(Segments);
+        load_state(um, state);
+        if (config != NULL) {
+                UM_config anonymous = *config;
+                anonymous.heap_file = NULL;
+                configure(um, &anonymous);
+        }
+        return um;
+}
+
+/********** um_clone ********
+ *
+ * Creates an independent UM in the same state as another: same registers,
+ * program counter, counters, settings and segment contents
+ * 
+ * Parameters:
+ *      UM_T um: the UM to copy, which is not running
+ * 
+ * Return: 
+ *      the copy, which uses stdin and stdout and has no deadline
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL or allocation fails
+ *      Only reads um, so several threads may clone one UM at once; this
+ *      is how a pool of ready UMs is filled from a loaded program
+ *      The copy has no breakpoints or watchpoints; the traps of um's
+ *      breakpoints are taken out of its segment 0, not out of um's
+ *      The copy's segments are anonymous memory even if um has a heap
+ *      image; with config->dedup_words set, its long segments are shared
+ *      with identical segments of other UMs instead of copied
+ ************************/
+extern UM_T um_clone(UM_T um)
+{
+        assert(um != NULL);
+        UM_T copy = malloc(sizeof(struct UM_T));
+        assert(copy != NULL);
+        *copy = *um;
+        copy->Segments = copy_Segments(um->Segments);
+        for (uint32_t i = 0; i < um->break_count; i++) {
+                if (um->breaks[i].patched) {
+                        um_set_word(copy, 0, um->breaks[i].pc, 
+                                    um->breaks[i].original);
+                }
+        }
+        copy->deadline_hit = 0;
+        copy->deadline_slot = -1;
+        copy->deadline_token = 0;
+        copy->heap_file = false;
+        copy->input = stdin;
+        copy->output = stdout;
+        copy->input_fd = -1;
+        copy->writer = NULL;
+        copy->prefetch = NULL;
+        copy->fed = false;
+        copy->in_buf = NULL;
+        copy->in_pos = 0;
+        copy->in_len = 0;
+        copy->in_cap = 0;
+        copy->in_eof = false;
+        copy->ready_bytes = 0;
+        copy->record = NULL;
+        copy->replay = NULL;
+        copy->trace = NULL;
+        copy->breaks = NULL;
+        copy->break_count = 0;
+        copy->break_cap = 0;
+        copy->watches = NULL;
+        copy->watch_count = 0;
+        copy->watch_cap = 0;
+        copy->debugging = false;
+        copy->stepping = false;
+        copy->profile = NULL;
+        copy->saver = 0;
+        copy->save_temp = NULL;
+        return copy;
+}
+
+/********** um_share ********
+ *
+ * Shares the UM's long segments with identical segments of other UMs in
+ * the process, so that its clones share them too without comparing
+ * their contents again; segments get words of their own on their first
+ * write
+ * 
+ * Parameters:
+ *      UM_T um: a UM that is not running, without a heap image
+ * 
+ * Return: 
+ *      number of segments shared, 0 if config->dedup_words was 0
+ *
+ * Expects:
+ *      um must not be NULL or have a heap image
+ * Notes:
+ *      Will CRE if um is NULL or has a heap image, whose checkpoints must
+ *      only refer to memory inside it
+ ************************/
+extern uint32_t um_share(UM_T um)
+{
+        assert(um != NULL && !um->heap_file);
+        patch_breaks(um, false);
+        uint32_t shared = share_segments(um->Segments);
+        patch_breaks(um, true);
+        return shared;
+}
+
+/********** um_set_io ********
+ *
+ * Connects the UM's input and output instructions to the given streams
+ * 
+ * Parameters:
+ *      UM_T um: the UM to connect
+ *      FILE *input: stream read by the input instruction
+ *      FILE *output: stream written by the output instruction
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um, input and output must not be NULL
+ * Notes:
+ *      Will CRE if um, input or output is NULL
+ *      The streams stay owned by the caller
+ *      Asynchronous output to the previous stream is flushed and turned
+ *      off, as is prefetching from the previous input stream
+ ************************/
+extern void um_set_io(UM_T um, FILE *input, FILE *output)
+{
+        assert(um != NULL && input != NULL && output != NULL);
+        um_set_async_output(um, 0);
+        um_set_prefetch(um, 0);
+        um->input = input;
+        um->output = output;
+}
+
+/********** um_set_async_output ********
+ *
+ * Makes the output instruction append to a ring of the given size, which
+ * a writer thread drains to the output stream's descriptor with large
+ * writes, so that a slow reader does not stall the UM until the ring
+ * fills. Output is flushed before an input instruction that might wait,
+ * so prompts still appear before the UM waits for the answer, and when
+ * the UM halts or faults.
+ * 
+ * Parameters:
+ *      UM_T um: the UM
+ *      size_t bytes: ring size, or 0 to flush and go back to writing the
+ *                    stream directly
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL, and its output stream must have a descriptor
+ * Notes:
+ *      Will CRE if um is NULL or the writer cannot be started
+ *      Only the thread running the UM may write to the stream while
+ *      asynchronous output is on
+ ************************/
+extern void um_set_async_output(UM_T um, size_t bytes)
+{
+        assert(um != NULL);
+        if (um->writer != NULL) {
+                writer_free(&um->writer);
+        }
+        if (bytes > 0) {
+                fflush(um->output);
+                um->writer = writer_new(fileno(um->output), bytes);
+        }
+}
+
+/********** um_set_prefetch ********
+ *
+ * Makes the input instruction take bytes from a ring of the given size,
+ * which a reader thread keeps filled from the input stream's descriptor
+ * with large reads. Input that has already arrived is then read from
+ * memory without a system call; end of input still reads as all ones.
+ * 
+ * Parameters:
+ *      UM_T um: the UM
+ *      size_t bytes: ring size, or 0 to go back to reading the stream
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL, its input stream must have a descriptor, and
+ *      nothing may have been read from the stream yet
+ * Notes:
+ *      Will CRE if um is NULL or the reader cannot be started
+ *      Turning prefetching off loses the input it read ahead
+ *      Input fed with um_feed_input or set with um_set_input_fd takes
+ *      precedence
+ ************************/
+extern void um_set_prefetch(UM_T um, size_t bytes)
+{
+        assert(um != NULL);
+        if (um->prefetch != NULL) {
+                prefetch_free(&um->prefetch);
+        }
+        if (bytes > 0) {
+                um->prefetch = prefetch_new(fileno(um->input), bytes);
+        }
+}
+
+/********** um_set_input_fd ********
+ *
+ * Makes the input instruction read a file descriptor directly, through a
+ * buffer of its own, instead of the input stream. If the descriptor is
+ * non-blocking and empty, um_run returns UM_NEEDS_INPUT rather than
+ * waiting, and the host calls um_run again once the descriptor is
+ * readable.
+ * 
+ * Parameters:
+ *      UM_T um: the UM to connect
+ *      int fd: descriptor to read, or -1 to go back to the input stream
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL or allocation fails
+ *      Bytes buffered from a previous descriptor are discarded; the
+ *      descriptor stays owned by the caller
+ ************************/
+extern void um_set_input_fd(UM_T um, int fd)
+{
+        assert(um != NULL);
+        if (fd >= 0 && um->in_cap < INPUT_BYTES) {
+                um->in_buf = realloc(um->in_buf, INPUT_BYTES);
+                assert(um->in_buf != NULL);
+                um->in_cap = INPUT_BYTES;
+        }
+        um->input_fd = fd;
+        um->fed = false;
+        um->in_pos = 0;
+        um->in_len = 0;
+        um->in_eof = false;
+        um->ready_bytes = 0;
+}
+
+/********** start_feeding ********
+ *
+ * Switches a UM to input pushed by the host, dropping any other source
+ *****************************/
+static void start_feeding(UM_T um)
+{
+        if (!um->fed) {
+                um->fed = true;
+                um->input_fd = -1;
+                um->in_pos = 0;
+                um->in_len = 0;
+                um->in_eof = false;
+                um->ready_bytes = 0;
+        }
+}
+
+/********** um_feed_input ********
+ *
+ * Queues bytes for the UM's input instruction. The first call makes fed
+ * input the UM's only input: once the queued bytes are used up, um_run
+ * returns UM_NEEDS_INPUT with the UM intact, and the host resumes it by
+ * feeding more and calling um_run again. No thread ever waits on a read.
+ * 
+ * Parameters:
+ *      UM_T um: the UM to feed
+ *      const void *bytes: the input
+ *      size_t length: number of bytes
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL, bytes must not be NULL unless length is 0,
+ *      and um_end_input must not have been called
+ * Notes:
+ *      Will CRE if um is NULL, bytes is NULL with a nonzero length, input
+ *      has been ended, or allocation fails
+ ************************/
+extern void um_feed_input(UM_T um, const void *bytes, size_t length)
+{
+        assert(um != NULL && (bytes != NULL || length == 0));
+        start_feeding(um);
+        assert(!um->in_eof);
+        if (um->in_pos > 0) {
+                memmove(um->in_buf, um->in_buf + um->in_pos,
+                        um->in_len - um->in_pos);
+                um->in_len -= um->in_pos;
+                um->in_pos = 0;
+        }
+        if (length > um->in_cap - um->in_len) {
+                size_t cap = um->in_cap < INPUT_BYTES ? INPUT_BYTES 
+                                                       : um->in_cap;
+                while (cap - um->in_len < length) {
+                        cap *= 2;
+                }
+                um->in_buf = realloc(um->in_buf, cap);
+                assert(um->in_buf != NULL);
+                um->in_cap = cap;
+        }
+        if (length > 0) {
+                memcpy(um->in_buf + um->in_len, bytes, length);
+        }
+        um->in_len += length;
+}
+
+/********** um_end_input ********
+ *
+ * Marks the end of fed input: once the queued bytes are used up, the
+ * input instruction reads all ones, as it does at end of file
+ * 
+ * Parameters:
+ *      UM_T um: the UM
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ ************************/
+extern void um_end_input(UM_T um)
+{
+        assert(um != NULL);
+        start_feeding(um);
+        um->in_eof = true;
+}
+
+/********** um_set_record ********
+ *
+ * Logs every value the UM's input instruction returns, with the number
+ * of instructions executed when it did, so that the session can be rerun
+ * exactly with um_set_replay
+ * 
+ * Parameters:
+ *      UM_T um: the UM to record
+ *      FILE *log: stream to write the log to, or NULL to stop recording
+ * 
+ * Return: 
+ *      false if writing the log recorded until now failed
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ *      The stream stays owned by the caller and must stay open until
+ *      recording stops or the UM is freed; it is flushed whenever um_run
+ *      returns
+ *      Instruction counts are those of um_stats, so a log may start part
+ *      way through a run, e.g. after um_resume
+ ************************/
+extern bool um_set_record(UM_T um, FILE *log)
+{
+        assert(um != NULL);
+        bool ok = um->record == NULL || replay_free(&um->record);
+        if (log != NULL) {
+                um->record = replay_record(log);
+        }
+        return ok;
+}
+
+/********** um_set_replay ********
+ *
+ * Makes the UM's input instruction return the values of a log written by
+ * um_set_record instead of reading input. The UM faults if it executes
+ * an input instruction at an instruction count where the log has no
+ * value, so a run that departs from the recorded one is caught.
+ * 
+ * Parameters:
+ *      UM_T um: the UM to replay into, in the state the recording started
+ *               from
+ *      FILE *log: stream to read the log from, at its start, or NULL to
+ *                 stop replaying
+ * 
+ * Return: 
+ *      false if log does not hold a log
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ *      The stream stays owned by the caller and must stay open until
+ *      replaying stops or the UM is freed
+ ************************/
+extern bool um_set_replay(UM_T um, FILE *log)
+{
+        assert(um != NULL);
+        if (um->replay != NULL) {
+                replay_free(&um->replay);
+        }
+        if (log != NULL) {
+                um->replay = replay_open(log);
+                return um->replay != NULL;
+        }
+        return true;
+}
+
+/********** um_set_trace ********
+ *
+ * Records every instruction the UM executes to a stream of its own in a
+ * trace file
+ * 
+ * Parameters:
+ *      UM_T um: the UM to trace
+ *      Tracer_T tracer: tracer of the trace file, or NULL to stop tracing
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ *      The tracer stays owned by the caller, and must be freed only after
+ *      tracing stops or the UM is freed
+ *      Only the thread running the UM may append to its stream, so a
+ *      tracer serves several UMs on several threads without contention
+ ************************/
+extern void um_set_trace(UM_T um, Tracer_T tracer)
+{
+        assert(um != NULL);
+        if (um->trace != NULL) {
+                trace_close(&um->trace);
+        }
+        if (tracer != NULL) {
+                um->trace = trace_open(tracer);
+        }
+}
+
+/********** um_break ********
+ *
+ * Sets a breakpoint: um_run returns UM_BREAKPOINT each time the UM is
+ * about to execute the instruction at pc of segment 0
+ * 
+ * Parameters:
+ *      UM_T um: the UM to stop
+ *      uint32_t pc: offset in segment 0 of the instruction
+ * 
+ * Return: 
+ *      true if segment 0 holds pc now; a breakpoint past its end takes
+ *      effect once a load program makes segment 0 long enough
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ *      The instruction is replaced by a trap, so execution without
+ *      breakpoints costs nothing; the program still loads its own code
+ *      as it wrote it, and its stores over a breakpoint keep the trap
+ ************************/
+extern bool um_break(UM_T um, uint32_t pc)
+{
+        assert(um != NULL);
+        if (find_break(um, pc) == NULL) {
+                if (um->break_count == um->break_cap) {
+                        um->break_cap = um->break_cap == 0
+                                        ? 8 : 2 * um->break_cap;
+                        um->breaks = realloc(um->breaks, um->break_cap *
+                                             sizeof(Break));
+                        assert(um->breaks != NULL);
+                }
+                Break *brk = &um->breaks[um->break_count++];
+                brk->pc = pc;
+                brk->patched = false;
+                if (pc < um->num_of_word) {
+                        brk->original = um_get_word(um, 0, pc);
+                        um_set_word(um, 0, pc, TRAP_WORD);
+                        brk->patched = true;
+                }
+                um->debugging = true;
+        }
+        return pc < um->num_of_word;
+}
+
+/********** um_unbreak ********
+ *
+ * Clears the breakpoint at pc, putting its instruction back
+ * 
+ * Parameters:
+ *      UM_T um: the UM to change
+ *      uint32_t pc: offset in segment 0 the breakpoint was set at
+ * 
+ * Return: 
+ *      false if no breakpoint was set at pc
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ ************************/
+extern bool um_unbreak(UM_T um, uint32_t pc)
+{
+        assert(um != NULL);
+        Break *brk = find_break(um, pc);
+        if (brk == NULL) {
+                return false;
+        }
+        if (brk->patched) {
+                um_set_word(um, 0, pc, brk->original);
+        }
+        *brk = um->breaks[--um->break_count];
+        check_debugging(um);
+        return true;
+}
+
+/********** um_watch ********
+ *
+ * Sets a watchpoint: um_run returns UM_BREAKPOINT after each segmented
+ * store to words offset to offset + length - 1 of a segment
+ * 
+ * Parameters:
+ *      UM_T um: the UM to stop
+ *      uint32_t segment: identifier of the segment to watch
+ *      uint32_t offset: first word to watch
+ *      uint32_t length: number of words to watch
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ *      Every store stops the UM, even one that leaves the word unchanged;
+ *      the watch follows the identifier, whatever segment it maps
+ *      While any breakpoint or watchpoint is set, segmented loads and
+ *      stores take a slower checked path
+ ************************/
+extern void um_watch(UM_T um, uint32_t segment, uint32_t offset,
+                     uint32_t length)
+{
+        assert(um != NULL);
+        if (um->watch_count == um->watch_cap) {
+                um->watch_cap = um->watch_cap == 0 ? 8 : 2 * um->watch_cap;
+                um->watches = realloc(um->watches,
+                                      um->watch_cap * sizeof(Watch));
+                assert(um->watches != NULL);
+        }
+        um->watches[um->watch_count++] = (Watch){ segment, offset, length };
+        um->debugging = true;
+}
+
+/********** um_unwatch ********
+ *
+ * Clears the watchpoint set at a segment's offset
+ * 
+ * Parameters:
+ *      UM_T um: the UM to change
+ *      uint32_t segment: identifier of the watched segment
+ *      uint32_t offset: first word the watchpoint covered
+ * 
+ * Return: 
+ *      false if no watchpoint was set there
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ ************************/
+extern bool um_unwatch(UM_T um, uint32_t segment, uint32_t offset)
+{
+        assert(um != NULL);
+        for (uint32_t i = 0; i < um->watch_count; i++) {
+                if (um->watches[i].segment == segment &&
+                    um->watches[i].offset == offset) {
+                        um->watches[i] = um->watches[--um->watch_count];
+                        check_debugging(um);
+                        return true;
+                }
+        }
+        return false;
+}
+
+/********** um_stopped ********
+ *
+ * Returns where the UM stopped when um_run last returned UM_BREAKPOINT
+ * 
+ * Parameters:
+ *      UM_T um: the UM to query
+ * 
+ * Return: 
+ *      the breakpoint or watched store, with the registers at the time
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ ************************/
+extern UM_stop um_stopped(UM_T um)
+{
+        assert(um != NULL);
+        return um->stop;
+}
+
+/********** um_set_profile ********
+ *
+ * Feeds every load program and segmented store of the UM to a call-graph
+ * profile, which charges the instructions executed from now on to the
+ * guest functions they ran in
+ * 
+ * Parameters:
+ *      UM_T um: the UM to profile
+ *      Profile_T profile: the profile, or NULL to stop profiling
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ *      The profile stays owned by the caller; um_run brings its counts up
+ *      to date each time it returns
+ *      While profiling, segmented stores take the checked path
+ ************************/
+extern void um_set_profile(UM_T um, Profile_T profile)
+{
+        assert(um != NULL);
+        uint64_t now = um->instructions + (um->pc - um->block_start);
+        if (um->profile != NULL) {
+                profile_charge(um->profile, now);
+        }
+        um->profile = profile;
+        if (profile != NULL) {
+                profile_charge(profile, now);
+        }
+        check_debugging(um);
+}
+
+/********** um_input_fd ********
+ *
+ * Returns the descriptor the input instruction reads
+ * 
+ * Parameters:
+ *      UM_T um: the UM to query
+ * 
+ * Return: 
+ *      the descriptor set by um_set_input_fd, or -1
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ ************************/
+extern int um_input_fd(UM_T um)
+{
+        assert(um != NULL);
+        return um->input_fd;
+}
+
+/********** um_set_quantum ********
+ *
+ * Makes um_run return UM_YIELDED once the UM has taken the given number
+ * of further load program jumps, so that a scheduler can share a thread
+ * between UMs. Counting from the current block, the quantum covers the
+ * next run only as far as um_run resumes it; call again for each slice.
+ * 
+ * Parameters:
+ *      UM_T um: the UM to limit
+ *      uint64_t blocks: jumps from now, or 0 for no quantum
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ *      A budget or deadline that ends at the same block takes precedence
+ ************************/
+extern void um_set_quantum(UM_T um, uint64_t blocks)
+{
+        assert(um != NULL);
+        if (blocks == 0 || blocks > NEVER - um->blocks) {
+                um->block_end = NEVER;
+        } else {
+                um->block_end = um->blocks + blocks;
+        }
+}
+
+/********** um_checkpoint ********
+ *
+ * Saves the registers, program counter and counters of a stopped UM in
+ * its heap image, together with the segment table, and writes the image
+ * to disk. um_resume can then continue the UM in another process, even if
+ * this one is killed.
+ * 
+ * Parameters:
+ *      UM_T um: a UM created with a heap image and stopped by its budget
+ *               or deadline
+ * 
+ * Return: 
+ *      true if the checkpoint reached the disk
+ *
+ * Expects:
+ *      um must not be NULL, must have a heap image, and must have status
+ *      UM_BUDGET_EXHAUSTED
+ * Notes:
+ *      Will CRE if um is NULL, has no heap image, or cannot be resumed
+ *      um_run discards the checkpoint before it changes any segment
+ ************************/
+extern bool um_checkpoint(UM_T um)
+{
+        assert(um != NULL && um->heap_file);
+        assert(um->status == UM_BUDGET_EXHAUSTED);
+        uint32_t state[SEGMENT_STATE_WORDS];
+        save_state(um, state);
+        patch_breaks(um, false);
+        bool ok = checkpoint_segments(um->Segments, state);
+        patch_breaks(um, true);
+        return ok;
+}
+
+/********** save_child ********
+ *
+ * Body of the child forked by um_checkpoint_fork: writes the frozen copy
+ * of the UM to the temporary file, flushes it to disk and renames it over
+ * the checkpoint, then syncs the directory so the rename persists. Only
+ * system calls are made, since other threads of the parent, which may
+ * hold allocator or stdio locks, do not exist in the child.
+ ************************/
+static void save_child(UM_T um, const char *path, int directory)
+{
+        uint32_t state[SEGMENT_STATE_WORDS];
+        save_state(um, state);
+        int fd = open(um->save_temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool saved = fd >= 0 && write_segments(um->Segments, state, fd) &&
+                     fsync(fd) == 0;
+        if (fd >= 0) {
+                saved = close(fd) == 0 && saved;
+        }
+        if (!saved || rename(um->save_temp, path) != 0) {
+                unlink(um->save_temp);
+                _exit(EXIT_FAILURE);
+        }
+        if (directory >= 0) {
+                fsync(directory);
+        }
+        _exit(EXIT_SUCCESS);
+}
+
+/********** um_checkpoint_fork ********
+ *
+ * Starts saving the UM to a checkpoint file without stopping it: a child
+ * process writes the copy-on-write image of the UM as it is now while
+ * the caller goes on running it. The file is replaced only once the new
+ * checkpoint is completely on disk, so a failed or interrupted save
+ * leaves the previous one intact. um_restore loads the file.
+ * 
+ * Parameters:
+ *      UM_T um: a UM between runs, without a heap image
+ *      const char *path: the checkpoint file
+ * 
+ * Return: 
+ *      false if a save is still in progress or the child cannot be
+ *      started
+ *
+ * Expects:
+ *      um and path must not be NULL; um must not have a heap image, whose
+ *      shared mapping the child would see change
+ * Notes:
+ *      Will CRE if um or path is NULL, or um has a heap image
+ *      The save is written to path with ".tmp" appended, then renamed
+ *      Collect the result with um_checkpoint_poll
+ ************************/
+extern bool um_checkpoint_fork(UM_T um, const char *path)
+{
+        assert(um != NULL && path != NULL && !um->heap_file);
+        if (um->saver != 0) {
+                return false;
+        }
+        size_t length = strlen(path);
+        um->save_temp = malloc(length + 5);
+        assert(um->save_temp != NULL);
+        memcpy(um->save_temp, path, length);
+        memcpy(um->save_temp + length, ".tmp", 5);
+
+        /* Open the directory now, since the child may not allocate */
+        const char *slash = strrchr(path, '/');
+        char *name = slash == NULL ? NULL : strndup(path, slash - path + 1);
+        int directory = open(name != NULL ? name : ".", O_RDONLY);
+        free(name);
+
+        fflush(NULL);
+        patch_breaks(um, false);
+        pid_t child = fork();
+        if (child == 0) {
+                save_child(um, path, directory);
+        }
+        patch_breaks(um, true);
+        if (directory >= 0) {
+                close(directory);
+        }
+        if (child < 0) {
+                free(um->save_temp);
+                um->save_temp = NULL;
+                return false;
+        }
+        um->saver = child;
+        return true;
+}
+
+/********** um_checkpoint_poll ********
+ *
+ * Reports on the save started by um_checkpoint_fork
+ * 
+ * Parameters:
+ *      UM_T um: the UM being saved
+ *      bool wait: whether to wait for a save in progress to finish
+ * 
+ * Return: 
+ *      UM_SAVE_NONE if no save was in progress, UM_SAVE_WRITING if it is
+ *      still running, or UM_SAVE_DONE or UM_SAVE_FAILED once it has
+ *      finished; each finished save is reported once
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ ************************/
+extern UM_save um_checkpoint_poll(UM_T um, bool wait)
+{
+        assert(um != NULL);
+        if (um->saver == 0) {
+                return UM_SAVE_NONE;
+        }
+        int status;
+        pid_t done;
+        do {
+                done = waitpid(um->saver, &status, wait ? 0 : WNOHANG);
+        } while (done < 0 && errno == EINTR);
+        if (done == 0) {
+                return UM_SAVE_WRITING;
+        }
+        bool saved = done == um->saver && WIFEXITED(status) &&
+                     WEXITSTATUS(status) == EXIT_SUCCESS;
+        if (!saved) {
+                unlink(um->save_temp); /* the child may have been killed */
+        }
+        um->saver = 0;
+        free(um->save_temp);
+        um->save_temp = NULL;
+        return saved ? UM_SAVE_DONE : UM_SAVE_FAILED;
+}
+
+/********** um_interrupt ********
+ *
+ * Asks a running UM to stop with UM_BUDGET_EXHAUSTED at its next block
+ * boundary, as if its deadline had passed; safe to call from a signal
+ * handler
+ * 
+ * Parameters:
+ *      UM_T um: the UM to stop
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Stays in effect until the deadline is next set
+ ************************/
+extern void um_interrupt(UM_T um)
+{
+        if (um != NULL) {
+                um->deadline_hit = 1;
+        }
+}
+
+/********** run_traced ********
+ *
+ * Runs the UM like um_run's loop, recording each instruction to its trace
+ * once it has executed. An input instruction undone for lack of input,
+ * or a breakpoint's trap, is recorded when the instruction is retried.
+ ************************/
+static void run_traced(UM_T um)
+{
+        while (um->pc < um->num_of_word && um->status == UM_RUNNING) {
+                uint32_t pc = um->pc++;
+                uint32_t instruction = um_get_word(um, 0, pc);
+                execute_instruction(um, instruction);
+                if (um->status != UM_NEEDS_INPUT && !um->stepping) {
+                        trace_put(um->trace, pc, instruction,
+                                  um->registers);
+                }
+        }
+}
+
+/********** step_over ********
+ *
+ * Executes the instruction under the breakpoint the UM stopped at, so
+ * that resuming does not stop at the same trap again
+ ************************/
+static void step_over(UM_T um)
+{
+        um->stepping = false;
+        uint32_t pc = um->pc++;
+        uint32_t instruction = original_word(um, pc);
+        execute_instruction(um, instruction);
+        if (um->status == UM_NEEDS_INPUT) {
+                um->stepping = true;
+        } else if (um->trace != NULL) {
+                trace_put(um->trace, pc, instruction, um->registers);
+        }
+}
+
+/********** um_run ********
+ *
+ * Executes instructions until the UM halts, faults, or exhausts its budget
+ * 
+ * Parameters:
+ *      UM_T um: the UM to run
+ * 
+ * Return: 
+ *      UM_HALTED, UM_FAULT, UM_BUDGET_EXHAUSTED, UM_YIELDED,
+ *      UM_NEEDS_INPUT, or UM_BREAKPOINT
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ *      After UM_BREAKPOINT at a breakpoint, um_run first executes the
+ *      instruction there, so each call makes progress
+ *      After UM_BUDGET_EXHAUSTED the host may raise the budget or deadline
+ *      and call um_run again to continue from the same pc; without a new
+ *      allowance the UM runs one more basic block and stops again
+ *      A halted or faulted UM stays stopped
+ ************************/
+extern UM_status um_run(UM_T um)
+{
+        assert(um != NULL);
+        if (um->status == UM_BUDGET_EXHAUSTED || um->status == UM_YIELDED ||
+            um->status == UM_NEEDS_INPUT || um->status == UM_BREAKPOINT) {
+                um->status = UM_RUNNING;
+        }
+        if (um->stepping && um->status == UM_RUNNING) {
+                step_over(um);
+        }
+        if (um->heap_file) {
+                discard_checkpoint(um->Segments);
+        }
+
+        /* Execute all instructions by calling corresponding functions */
+        if (um->trace != NULL) {
+                run_traced(um);
+        } else {
+                while (um->pc < um->num_of_word &&
+                       um->status == UM_RUNNING) {
+                        uint32_t instruction = um_get_word(um, 0,
+                                                           (um->pc)++);
+                        execute_instruction(um, instruction);
+                }
+        }
+
+        /* Running off the end of segment 0 stops the UM like halt */
+        if (um->status == UM_RUNNING) {
+                um_halt(um);
+        }
+        end_block(um);
+        if (um->profile != NULL) {
+                profile_charge(um->profile, um->instructions);
+        }
+        if (um->writer != NULL && (um->status == UM_HALTED ||
+                                   um->status == UM_FAULT)) {
+                writer_flush(um->writer);
+        }
+        if (um->record != NULL) {
+                replay_flush(um->record);
+        }
+        return um->status;
+}
+
+/********** um_free ********
+ *
+ * Frees all memory of a UM and sets the caller's handle to NULL
+ * 
+ * Parameters:
+ *      UM_T *um: pointer to the UM to free
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um and *um must not be NULL
+ * Notes:
+ *      Will CRE if um or *um is NULL
+ ************************/
+extern void um_free(UM_T *um)
+{
+        assert(um != NULL && *um != NULL);
+        disarm_deadline(*um);
+        um_checkpoint_poll(*um, true);
+        um_set_record(*um, NULL);
+        um_set_replay(*um, NULL);
+        um_set_trace(*um, NULL);
+        free_Segments(&((*um)->Segments));
+        free((*um)->in_buf);
+        free((*um)->breaks);
+        free((*um)->watches);
+        if ((*um)->writer != NULL) {
+                writer_free(&(*um)->writer);
+        }
+        if ((*um)->prefetch != NULL) {
+                prefetch_free(&(*um)->prefetch);
+        }
+        free(*um);
+        *um = NULL;
+}
+
+/********** um_fast_exit ********
+ *
+ * Ends the process without tearing the UM down: output is flushed, but
+ * the segments are left for the kernel to reclaim along with the rest of
+ * the address space
+ * 
+ * Parameters:
+ *      UM_T um: the UM whose output to flush
+ *      int status: process exit status
+ * 
+ * Return: Does not return
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ ************************/
+extern void um_fast_exit(UM_T um, int status)
+{
+        assert(um != NULL);
+        um_checkpoint_poll(um, true);
+        if (um->writer != NULL) {
+                writer_flush(um->writer);
+        }
+        if (um->record != NULL) {
+                replay_flush(um->record);
+        }
+        if (um->trace != NULL) {
+                trace_flush(um->trace);
+        }
+        fflush(um->output);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(status);
+}
+
+/********** um_set_budget ********
+ *
+ * Allows the UM to execute a number of further instructions, counted from
+ * the last block boundary, before um_run returns UM_BUDGET_EXHAUSTED
+ * 
+ * Parameters:
+ *      UM_T um: the UM to limit
+ *      uint64_t instructions: the allowance, or 0 to remove the limit
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ *      The budget is enforced when a load program ends a block, so a run
+ *      may overshoot by the length of one basic block
+ ************************/
+extern void um_set_budget(UM_T um, uint64_t instructions)
+{
+        assert(um != NULL);
+        if (instructions == 0 || 
+            instructions > NEVER - um->instructions) {
+                um->budget_end = NEVER;
+        } else {
+                um->budget_end = um->instructions + instructions;
+        }
+        update_next_event(um);
+}
+
+/********** um_compact ********
+ *
+ * Compacts the UM's small segments into dense slabs in segment ID order,
+ * leaving every segment ID unchanged
+ * 
+ * Parameters:
+ *      UM_T um: the UM to compact
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL; must be called between instructions, e.g. by
+ *      the host after um_run returns
+ * Notes:
+ *      Will CRE if um is NULL
+ *      Also schedules the next periodic compaction, if any
+ ************************/
+extern void um_compact(UM_T um)
+{
+        assert(um != NULL);
+        um->compacted_bytes += compact_segments(um->Segments);
+        um->compactions++;
+        um_set_compaction(um, um->compact_every);
+}
+
+/********** um_set_compaction ********
+ *
+ * Schedules compaction every given number of instructions. It runs at the
+ * first block boundary or input instruction after each interval.
+ * 
+ * Parameters:
+ *      UM_T um: the UM to configure
+ *      uint64_t instructions: interval, counted from now, or 0 for none
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ ************************/
+extern void um_set_compaction(UM_T um, uint64_t instructions)
+{
+        assert(um != NULL);
+        um->compact_every = instructions;
+        if (instructions == 0 || instructions > NEVER - um->instructions) {
+                um->next_compact = NEVER;
+        } else {
+                um->next_compact = um->instructions + instructions;
+        }
+        update_next_event(um);
+}
+
+/********** um_sweep_cold ********
+ *
+ * Compresses every segment other than segment 0 that has not been read or
+ * written since the previous sweep; such a segment is decompressed again
+ * on its next access
+ * 
+ * Parameters:
+ *      UM_T um: the UM to sweep
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL; must be called between instructions
+ * Notes:
+ *      Will CRE if um is NULL
+ *      Also schedules the next periodic sweep, if any
+ ************************/
+extern void um_sweep_cold(UM_T um)
+{
+        assert(um != NULL);
+        freeze_cold_segments(um->Segments);
+        um_set_cold_after(um, um->cold_after);
+}
+
+/********** um_set_cold_after ********
+ *
+ * Compresses segments that go unused for the given number of instructions.
+ * Sweeps run at the first block boundary or input instruction after each
+ * interval, and a segment is compressed by the sweep after the one that
+ * last found it in use, so it is idle for between one and two intervals.
+ * 
+ * Parameters:
+ *      UM_T um: the UM to configure
+ *      uint64_t instructions: interval, counted from now, or 0 for none
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ *      Segments already compressed stay so until accessed
+ ************************/
+extern void um_set_cold_after(UM_T um, uint64_t instructions)
+{
+        assert(um != NULL);
+        um->cold_after = instructions;
+        set_use_tracking(um->Segments, instructions != 0);
+        if (instructions == 0 || instructions > NEVER - um->instructions) {
+                um->next_sweep = NEVER;
+        } else {
+                um->next_sweep = um->instructions + instructions;
+        }
+        update_next_event(um);
+}
+
+/********** um_set_deadline ********
+ *
+ * Arms a wall-clock deadline, after which um_run returns
+ * UM_BUDGET_EXHAUSTED at the next block boundary. Replaces any earlier
+ * deadline, and clears one that has already passed.
+ * 
+ * Parameters:
+ *      UM_T um: the UM to limit
+ *      double seconds: time from now until the deadline, or 0 for none
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um must not be NULL, seconds must not be negative
+ * Notes:
+ *      Will CRE if um is NULL, seconds is negative, the timer cannot
+ *      be created, or DEADLINE_SLOTS UMs already have deadlines
+ *      The timer delivers DEADLINE_SIGNAL, whose handler is installed on
+ *      first use
+ *      Each deadline gets a timer and slot of its own, so a signal of
+ *      the deadline it replaces cannot stop the UM
+ ************************/
+extern void um_set_deadline(UM_T um, double seconds)
+{
+        assert(um != NULL && seconds >= 0);
+        disarm_deadline(um);
+        um->deadline_hit = 0;
+        if (seconds == 0) {
+                return;
+        }
+
+        struct sigaction action;
+        action.sa_sigaction = deadline_handler;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        int failed = sigaction(DEADLINE_SIGNAL, &action, NULL);
+        assert(failed == 0);
+
+        take_deadline_slot(um);
+        struct sigevent event;
+        memset(&event, 0, sizeof(event));
+        event.sigev_notify = SIGEV_SIGNAL;
+        event.sigev_signo = DEADLINE_SIGNAL;
+        event.sigev_value.sival_int = um->deadline_token;
+        failed = timer_create(CLOCK_MONOTONIC, &event, &um->deadline);
+        assert(failed == 0);
+
+        struct itimerspec when = { { 0, 0 }, { 0, 0 } };
+        when.it_value.tv_sec = (time_t)seconds;
+        when.it_value.tv_nsec = (long)((seconds - (time_t)seconds) * 1e9);
+        if (when.it_value.tv_sec == 0 && when.it_value.tv_nsec == 0) {
+                when.it_value.tv_nsec = 1;
+        }
+        failed = timer_settime(um->deadline, 0, &when, NULL);
+        assert(failed == 0);
+}
+
+/********** um_fault_reason ********
+ *
+ * Returns why the UM faulted
+ * 
+ * Parameters:
+ *      UM_T um: the UM to query
+ * 
+ * Return: 
+ *      a static string, or NULL if the UM has not faulted
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ ************************/
+extern const char *um_fault_reason(UM_T um)
+{
+        assert(um != NULL);
+        return um->fault;
+}
+
+/********** um_stats ********
+ *
+ * Returns the UM's resource usage counters
+ * 
+ * Parameters:
+ *      UM_T um: the UM to query
+ * 
+ * Return: 
+ *      a snapshot of the counters
+ *
+ * Expects:
+ *      um must not be NULL
+ * Notes:
+ *      Will CRE if um is NULL
+ ************************/
+extern UM_stats um_stats(UM_T um)
+{
+        assert(um != NULL);
+        UM_stats stats;
+        stats.memory = segment_usage(um->Segments);
+        stats.instructions = um->instructions;
+        stats.blocks = um->blocks;
+        stats.compactions = um->compactions;
+        stats.compacted_bytes = um->compacted_bytes;
+        return stats;
+}
+
+/********** um_print_stats ********
+ *
+ * Writes the UM's counters as one "name: value" pair per line
+ * 
+ * Parameters:
+ *      UM_T um: the UM to report on
+ *      FILE *fp: stream to write to
+ * 
+ * Return: None
+ *
+ * Expects:
+ *      um and fp must not be NULL
+ * Notes:
+ *      Will CRE if um or fp is NULL
+ ************************/
+extern void um_print_stats(UM_T um, FILE *fp)
+{
+        assert(um != NULL && fp != NULL);
+        UM_stats stats = um_stats(um);
+        fprintf(fp, "instructions:        %llu\n", 
+                (unsigned long long)stats.instructions);
+        fprintf(fp, "blocks:              %llu\n", 
+                (unsigned long long)stats.blocks);
+        fprintf(fp, "compactions:         %llu\n", 
+                (unsigned long long)stats.compactions);
+        fprintf(fp, "compacted bytes:     %llu\n", 
+                (unsigned long long)stats.compacted_bytes);
+        fprintf(fp, "live words:          %llu\n", 
+                (unsigned long long)stats.memory.live_words);
+        fprintf(fp, "peak words:          %llu\n", 
+                (unsigned long long)stats.memory.peak_words);
+        fprintf(fp, "live segments:       %lu\n", 
+                (unsigned long)stats.memory.live_segments);
+        fprintf(fp, "peak segments:       %lu\n", 
+                (unsigned long)stats.memory.peak_segments);
+        fprintf(fp, "mapped bytes:        %llu\n", 
+                (unsigned long long)stats.memory.mapped_bytes);
+        fprintf(fp, "huge page bytes:     %llu\n", 
+                (unsigned long long)stats.memory.huge_bytes);
+        fprintf(fp, "sparse pages:        %llu\n", 
+                (unsigned long long)stats.memory.sparse_pages);
+        fprintf(fp, "cold segments:       %lu\n", 
+                (unsigned long)stats.memory.cold_segments);
+        fprintf(fp, "cold bytes:          %llu\n", 
+                (unsigned long long)stats.memory.cold_bytes);
+        fprintf(fp, "cold packed bytes:   %llu\n", 
+                (unsigned long long)stats.memory.packed_bytes);
+        if (stats.memory.packed_bytes != 0) {
+                fprintf(fp, "cold ratio:          %.2f\n", 
+                        (double)stats.memory.cold_bytes / 
+                        stats.memory.packed_bytes);
+        }
+        fprintf(fp, "shared segments:     %lu\n", 
+                (unsigned long)stats.memory.shared_segments);
+        fprintf(fp, "shared bytes:        %llu\n", 
+                (unsigned long long)stats.memory.shared_bytes);
+        fprintf(fp, "shared copies:       %llu\n", 
+                (unsigned long long)stats.memory.unshares);
+        fprintf(fp, "cold compressions:   %llu\n", 
+                (unsigned long long)stats.memory.freezes);
+        fprintf(fp, "cold fault-ins:      %llu\n", 
+                (unsigned long long)stats.memory.thaws);
+        if (stats.memory.thaws != 0) {
+                fprintf(fp, "cold fault-in ns:    %llu\n", 
+                        (unsigned long long)(stats.memory.thaw_ns / 
+                                             stats.memory.thaws));
+        }
+
+        /* Whether the kernel found huge pages is only known per process */
+        FILE *rollup = fopen("/proc/self/smaps_rollup", "r");
+        if (rollup != NULL) {
+                char line[128];
+                unsigned long long kbytes;
+                while (fgets(line, sizeof(line), rollup) != NULL) {
+                        if (sscanf(line, "AnonHugePages: %llu kB", 
+                                   &kbytes) == 1) {
+                                fprintf(fp, "process huge bytes:  %llu\n",
+                                        kbytes * 1024);
+                        }
+                }
+                fclose(rollup);
+        }
+}
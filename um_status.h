@@ -14,19 +14,154 @@
  * 
  *     Also includes struct definition for UM_T, which represents components
  *     of a UM including registers, a program counter, memory segments, and
- *     the number of words (instructions). 
+ *     the number of words (instructions), along with the configuration,
+ *     run status, and statistics a host uses to drive and observe a UM. 
  *
  **************************************************************/
+#ifndef UM_STATUS_INCLUDED
+#define UM_STATUS_INCLUDED
+
 #include <stdint.h>
 #include <stdio.h>
+#include <stdio_ext.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <bitpack.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
 #include <sys/stat.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
 #include "fmt.h"
 #include "operations.h"
 #include "segments.h"
+#include "writer.h"
+#include "prefetch.h"
+#include "replay.h"
+#include "trace.h"
+#include "profile.h"
 
 typedef struct UM_T *UM_T;
 
-void run_um(char* fp);
\ No newline at end of file
+/* Why um_run returned */
+typedef enum UM_status {
+        UM_RUNNING = 0,   /* still executing; never returned by um_run */
+        UM_HALTED,        /* executed halt or ran off the end of segment 0 */
+        UM_FAULT,         /* stopped cleanly by a VM fault */
+        UM_BUDGET_EXHAUSTED, /* out of instructions or past the deadline;
+                               um_run resumes where execution stopped */
+        UM_YIELDED,       /* used up its quantum of blocks; um_run resumes */
+        UM_NEEDS_INPUT,   /* input instruction found no input without
+                             waiting, from a non-blocking descriptor or
+                             um_feed_input; um_run retries it */
+        UM_BREAKPOINT     /* stopped before the instruction at a
+                             breakpoint, or just after a store to a
+                             watched word; um_run resumes */
+} UM_status;
+
+/* Progress of a save started by um_checkpoint_fork */
+typedef enum UM_save {
+        UM_SAVE_NONE = 0, /* no save in progress */
+        UM_SAVE_WRITING,  /* the child is still writing */
+        UM_SAVE_DONE,     /* the checkpoint file was replaced */
+        UM_SAVE_FAILED    /* the previous checkpoint file is unchanged */
+} UM_save;
+
+/* Per-VM settings; a zero-initialized UM_config gives the defaults */
+typedef struct UM_config {
+        Segments_limits limits;   /* quotas on live words and segments */
+        uint64_t        budget;   /* instructions before um_run returns
+                                     UM_BUDGET_EXHAUSTED, 0 for no limit */
+        double          deadline; /* wall-clock seconds before um_run
+                                     returns UM_BUDGET_EXHAUSTED, 0 for none */
+        uint32_t        reclaim_words; /* unmapping a segment this long or
+                                          longer frees it on the reclamation
+                                          thread, 0 to free all inline */
+        Arena_huge      hugepages;     /* transparent huge page policy */
+        uint32_t        sparse_words;  /* map segments this long or longer
+                                          as pages committed on first write,
+                                          0 to map every segment dense */
+        uint64_t        compact_every; /* instructions between compactions
+                                          of small segments, 0 for none */
+        uint64_t        cold_after;    /* compress segments unused for this
+                                          many instructions, 0 for never */
+        const char     *heap_file;     /* back segment memory with this
+                                          file, a resumable heap image;
+                                          NULL for anonymous memory */
+        uint64_t        heap_bytes;    /* most segment memory in the heap
+                                          image, 0 for 256 GiB */
+        uint32_t        dedup_words;   /* share segments this long or
+                                          longer, copy-on-write, with
+                                          identical ones of other UMs in
+                                          the process when cloned or by
+                                          um_share; 0 for never */
+} UM_config;
+
+/* Counters reported through um_stats and um_print_stats */
+typedef struct UM_stats {
+        Segments_usage  memory;        /* live and peak words and segments */
+        uint64_t        instructions;  /* instructions executed */
+        uint64_t        blocks;        /* load program jumps taken */
+        uint64_t        compactions;   /* compaction passes run */
+        uint64_t        compacted_bytes; /* bytes moved by compactions */
+} UM_stats;
+
+/* Where a UM returning UM_BREAKPOINT stopped, from um_stopped */
+typedef struct UM_stop {
+        uint32_t        pc;            /* the breakpoint, or the store */
+        bool            watch;         /* a watched word was stored to */
+        uint32_t        segment;       /* the word stored to, if watch */
+        uint32_t        offset;
+        uint32_t        old_value;     /* its value before and after */
+        uint32_t        value;
+        uint32_t        registers[8];  /* registers when it stopped */
+} UM_stop;
+
+extern UM_T um_new(char *file_name, const UM_config *config);
+extern UM_T um_resume(const char *heap_file, const UM_config *config);
+extern UM_T um_restore(const char *path, const UM_config *config);
+extern UM_T um_clone(UM_T um);
+extern uint32_t um_share(UM_T um);
+extern void um_set_io(UM_T um, FILE *input, FILE *output);
+extern void um_set_async_output(UM_T um, size_t bytes);
+extern void um_set_prefetch(UM_T um, size_t bytes);
+extern void um_set_input_fd(UM_T um, int fd);
+extern void um_set_quantum(UM_T um, uint64_t blocks);
+extern int um_input_fd(UM_T um);
+extern void um_feed_input(UM_T um, const void *bytes, size_t length);
+extern void um_end_input(UM_T um);
+extern bool um_set_record(UM_T um, FILE *log);
+extern bool um_set_replay(UM_T um, FILE *log);
+extern void um_set_trace(UM_T um, Tracer_T tracer);
+extern void um_set_profile(UM_T um, Profile_T profile);
+extern bool um_break(UM_T um, uint32_t pc);
+extern bool um_unbreak(UM_T um, uint32_t pc);
+extern void um_watch(UM_T um, uint32_t segment, uint32_t offset,
+                     uint32_t length);
+extern bool um_unwatch(UM_T um, uint32_t segment, uint32_t offset);
+extern UM_stop um_stopped(UM_T um);
+extern bool um_checkpoint(UM_T um);
+extern bool um_checkpoint_fork(UM_T um, const char *path);
+extern UM_save um_checkpoint_poll(UM_T um, bool wait);
+extern void um_interrupt(UM_T um);
+extern UM_status um_run(UM_T um);
+extern void um_free(UM_T *um);
+extern void um_fast_exit(UM_T um, int status);
+extern void um_set_budget(UM_T um, uint64_t instructions);
+extern void um_set_deadline(UM_T um, double seconds);
+extern void um_compact(UM_T um);
+extern void um_set_compaction(UM_T um, uint64_t instructions);
+extern void um_sweep_cold(UM_T um);
+extern void um_set_cold_after(UM_T um, uint64_t instructions);
+extern const char *um_fault_reason(UM_T um);
+extern UM_stats um_stats(UM_T um);
+extern void um_print_stats(UM_T um, FILE *fp);
+
+#endif
@@ -0,0 +1,77 @@
+/**************************************************************
+ *
+ *                     umdis.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     umdis.c is the command-line front end of the disassembler. It
+ *     writes a UM image's listing, its control-flow graph in DOT, or the
+ *     binary graph described in disasm.h to standard output.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <getopt.h>
+#include "disasm.h"
+
+/********** usage ********
+ *
+ * Prints the command-line synopsis and exits with EXIT_FAILURE
+ ************************/
+static void usage(const char *prog)
+{
+        fprintf(stderr, "usage: %s [--text | --dot | --cfg] program.um\n"
+                "  --text   list the image block by block (default)\n"
+                "  --dot    write the control-flow graph for Graphviz\n"
+                "  --cfg    write the control-flow graph in binary\n", prog);
+        exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+        static const struct option options[] = {
+                { "text", no_argument, NULL, 't' },
+                { "dot",  no_argument, NULL, 'd' },
+                { "cfg",  no_argument, NULL, 'c' },
+                { NULL,   0,           NULL, 0 }
+        };
+        int format = 't';
+        int opt;
+        while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+                if (opt == '?') {
+                        usage(argv[0]);
+                }
+                format = opt;
+        }
+        if (optind != argc - 1) {
+                usage(argv[0]);
+        }
+
+        uint32_t count;
+        uint32_t *words = disasm_load(argv[optind], &count);
+        if (words == NULL) {
+                fprintf(stderr, "%s: cannot read %s\n", argv[0],
+                        argv[optind]);
+                return EXIT_FAILURE;
+        }
+        Disasm_T disasm = disasm_new(words, count);
+        bool ok = true;
+        if (format == 'd') {
+                disasm_dot(disasm, stdout);
+        } else if (format == 'c') {
+                ok = disasm_write_cfg(disasm, stdout);
+        } else {
+                disasm_print(disasm, stdout);
+        }
+        ok = fflush(stdout) == 0 && ok;
+        disasm_free(&disasm);
+        free(words);
+        if (!ok) {
+                fprintf(stderr, "%s: could not write output\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,297 @@
+/**************************************************************
+ *
+ *                     umtrace.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     umtrace.c decodes the execution traces written by um --trace, in
+ *     the format described in trace.h. By default it summarizes a trace:
+ *     instructions and jumps per stream, the opcode mix, and the hottest
+ *     instructions; --dump lists every record instead.
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <getopt.h>
+#include <mem.h>
+#include "trace.h"
+
+#define HOTTEST 20
+
+static const char *const mnemonics[16] = {
+        "cmov", "sload", "sstore", "add", "mul", "div", "nand", "halt",
+        "map", "unmap", "out", "in", "loadp", "ortho", "op14", "op15"
+};
+
+/* Running totals of one stream, which decodes from chunk to chunk */
+typedef struct Stream {
+        uint64_t        instructions;
+        uint64_t        jumps;          /* records whose pc is not the
+                                           previous one's plus one */
+} Stream;
+
+/* What a summary counts */
+typedef struct Summary {
+        Stream         *streams;
+        uint32_t        stream_count;
+        uint64_t        opcodes[16];
+        uint64_t       *pcs;            /* executions per pc */
+        uint32_t        pc_limit;       /* pcs counted, grown on demand */
+        uint64_t        bytes;
+} Summary;
+
+/********** usage ********
+ *
+ * Prints the command-line synopsis and exits with EXIT_FAILURE
+ ************************/
+static void usage(const char *prog)
+{
+        fprintf(stderr, "usage: %s [--dump] trace\n"
+                "  --dump   list every record rather than a summary\n",
+                prog);
+        exit(EXIT_FAILURE);
+}
+
+/********** get_varint ********
+ *
+ * Decodes a zigzag varint
+ *
+ * Return:
+ *      false if the varint runs past end or is longer than five bytes
+ *****************************/
+static bool get_varint(const uint8_t **pos, const uint8_t *end,
+                       uint32_t *difference)
+{
+        uint32_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+                if (*pos == end) {
+                        return false;
+                }
+                uint8_t byte = *(*pos)++;
+                value |= (uint32_t)(byte & 0x7f) << shift;
+                if (byte < 0x80) {
+                        *difference = value >> 1 ^ -(value & 1);
+                        return true;
+                }
+        }
+        return false;
+}
+
+/********** count_pc ********
+ *
+ * Counts an execution of pc, growing the table to cover it
+ *****************************/
+static void count_pc(Summary *summary, uint32_t pc)
+{
+        if (pc >= summary->pc_limit) {
+                uint32_t limit = summary->pc_limit == 0 ? 4096
+                                                        : summary->pc_limit;
+                while (limit <= pc && limit < UINT32_MAX / 2) {
+                        limit *= 2;
+                }
+                limit = limit <= pc ? UINT32_MAX : limit;
+                summary->pcs = realloc(summary->pcs,
+                                      (size_t)limit * sizeof(uint64_t));
+                assert(summary->pcs != NULL);
+                memset(summary->pcs + summary->pc_limit, 0,
+                       (size_t)(limit - summary->pc_limit) *
+                       sizeof(uint64_t));
+                summary->pc_limit = limit;
+        }
+        summary->pcs[pc]++;
+}
+
+/********** decode_chunk ********
+ *
+ * Decodes the records of one chunk, listing them to out if it is not
+ * NULL and counting them in summary otherwise
+ *
+ * Return:
+ *      false if the chunk is corrupt
+ *****************************/
+static bool decode_chunk(uint32_t stream, const uint8_t *pos,
+                         const uint8_t *end, Summary *summary, FILE *out)
+{
+        if (stream >= summary->stream_count) {
+                summary->streams = realloc(summary->streams,
+                                          ((size_t)stream + 1) *
+                                          sizeof(Stream));
+                assert(summary->streams != NULL);
+                memset(summary->streams + summary->stream_count, 0,
+                       (stream + 1 - summary->stream_count) *
+                       sizeof(Stream));
+                summary->stream_count = stream + 1;
+        }
+        Stream *totals = &summary->streams[stream];
+        uint32_t next_pc = 0;
+        uint32_t last[8] = { 0 };
+        while (pos < end) {
+                uint8_t header = *pos++;
+                unsigned opcode = header & 0xf;
+                unsigned reg = header >> 4 & 7;
+                uint32_t pc = next_pc, difference;
+                if (header & 0x80) {
+                        if (!get_varint(&pos, end, &difference)) {
+                                return false;
+                        }
+                        pc += difference;
+                        totals->jumps++;
+                }
+                next_pc = pc + 1;
+                bool writes = (TRACE_WRITES >> opcode & 1) != 0;
+                if (writes) {
+                        if (!get_varint(&pos, end, &difference)) {
+                                return false;
+                        }
+                        last[reg] += difference;
+                }
+                totals->instructions++;
+                if (out != NULL) {
+                        fprintf(out, "%u %08x %-6s", stream, pc,
+                                mnemonics[opcode]);
+                        if (writes) {
+                                fprintf(out, " r%u=0x%08x", reg, last[reg]);
+                        }
+                        fputc('\n', out);
+                } else {
+                        summary->opcodes[opcode]++;
+                        count_pc(summary, pc);
+                }
+        }
+        return true;
+}
+
+/********** compare_hot ********
+ *
+ * Orders pcs by decreasing execution count, then increasing pc
+ *****************************/
+static const uint64_t *hot_counts;
+static int compare_hot(const void *x, const void *y)
+{
+        uint32_t a = *(const uint32_t *)x, b = *(const uint32_t *)y;
+        if (hot_counts[a] != hot_counts[b]) {
+                return hot_counts[a] < hot_counts[b] ? 1 : -1;
+        }
+        return a < b ? -1 : a > b;
+}
+
+/********** print_summary ********
+ *
+ * Writes the totals, opcode mix and hottest instructions of a trace
+ *****************************/
+static void print_summary(Summary *summary, FILE *out)
+{
+        uint64_t total = 0;
+        for (uint32_t s = 0; s < summary->stream_count; s++) {
+                total += summary->streams[s].instructions;
+        }
+        fprintf(out, "%llu instructions in %u streams, %llu bytes "
+                "(%.2f bytes per instruction)\n", (unsigned long long)total,
+                summary->stream_count, (unsigned long long)summary->bytes,
+                total == 0 ? 0.0 : (double)summary->bytes / total);
+        for (uint32_t s = 0; s < summary->stream_count; s++) {
+                fprintf(out, "  stream %u: %llu instructions, %llu jumps\n",
+                        s, (unsigned long long)
+                        summary->streams[s].instructions,
+                        (unsigned long long)summary->streams[s].jumps);
+        }
+
+        fprintf(out, "\nopcode        count  percent\n");
+        for (int op = 0; op < 16; op++) {
+                if (summary->opcodes[op] != 0) {
+                        fprintf(out, "%-6s %12llu  %6.2f%%\n", mnemonics[op],
+                                (unsigned long long)summary->opcodes[op],
+                                100.0 * summary->opcodes[op] / total);
+                }
+        }
+
+        uint32_t used = 0;
+        for (uint32_t pc = 0; pc < summary->pc_limit; pc++) {
+                used += summary->pcs[pc] != 0;
+        }
+        uint32_t *order = CALLOC(used + 1, sizeof(uint32_t));
+        assert(order != NULL);
+        used = 0;
+        for (uint32_t pc = 0; pc < summary->pc_limit; pc++) {
+                if (summary->pcs[pc] != 0) {
+                        order[used++] = pc;
+                }
+        }
+        hot_counts = summary->pcs;
+        qsort(order, used, sizeof(uint32_t), compare_hot);
+        fprintf(out, "\n%u distinct pcs; hottest:\n", used);
+        fprintf(out, "      pc        count  percent\n");
+        for (uint32_t i = 0; i < used && i < HOTTEST; i++) {
+                uint64_t count = summary->pcs[order[i]];
+                fprintf(out, "%08x %12llu  %6.2f%%\n", order[i],
+                        (unsigned long long)count, 100.0 * count / total);
+        }
+        free(order);
+}
+
+int main(int argc, char *argv[])
+{
+        static const struct option options[] = {
+                { "dump", no_argument, NULL, 'd' },
+                { NULL,   0,           NULL, 0 }
+        };
+        bool dump = false;
+        int opt;
+        while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+                if (opt != 'd') {
+                        usage(argv[0]);
+                }
+                dump = true;
+        }
+        if (optind != argc - 1) {
+                usage(argv[0]);
+        }
+        FILE *fp = fopen(argv[optind], "rb");
+        char magic[sizeof(TRACE_MAGIC) - 1];
+        if (fp == NULL || fread(magic, 1, sizeof(magic), fp) !=
+                          sizeof(magic) ||
+            memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+                fprintf(stderr, "%s: %s is not a trace\n", argv[0],
+                        argv[optind]);
+                return EXIT_FAILURE;
+        }
+
+        Summary summary;
+        memset(&summary, 0, sizeof(summary));
+        summary.bytes = sizeof(magic);
+        uint8_t *chunk = NULL;
+        size_t capacity = 0;
+        uint32_t header[2];
+        bool ok = true;
+        while (ok && fread(header, sizeof(uint32_t), 2, fp) == 2) {
+                if (header[1] > capacity) {
+                        capacity = header[1];
+                        chunk = realloc(chunk, capacity);
+                        assert(chunk != NULL);
+                }
+                ok = fread(chunk, 1, header[1], fp) == header[1] &&
+                     decode_chunk(header[0], chunk, chunk + header[1],
+                                  &summary, dump ? stdout : NULL);
+                summary.bytes += sizeof(header) + header[1];
+        }
+        ok = ok && !ferror(fp) && feof(fp);
+        fclose(fp);
+        if (!dump) {
+                print_summary(&summary, stdout);
+        }
+        free(chunk);
+        free(summary.streams);
+        free(summary.pcs);
+        if (!ok) {
+                fprintf(stderr, "%s: %s is truncated or corrupt\n", argv[0],
+                        argv[optind]);
+                return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+}
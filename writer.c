@@ -0,0 +1,327 @@
+/**************************************************************
+ *
+ *                     writer.c
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     writer.c contains the implementation of the asynchronous output
+ *     writer. The ring is a power of two bytes with free-running head and
+ *     tail counters: only the producer stores head and only the writer
+ *     thread stores tail, so neither side takes a lock while the ring is
+ *     neither empty nor full. The writer thread writes everything between
+ *     tail and head, up to the end of the ring, in one call.
+ *
+ *     A side that has to wait, the writer for bytes or the producer for
+ *     space, sets its sleeping flag and checks the ring again before it
+ *     waits on a condition variable. The other side checks the flag after
+ *     moving its counter, and both use sequentially consistent atomics, so
+ *     at least one of them sees the other and no wakeup is lost. The
+ *     mutex is only taken to sleep and to wake a sleeper.
+ *
+ *     The producer wakes an idle writer thread only at a newline or once
+ *     WAKE_BYTES are waiting, and writer_flush wakes it for the rest, so
+ *     a UM that prints slowly costs a write per line rather than per
+ *     byte.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <mem.h>
+#include "writer.h"
+
+#define MIN_BYTES       4096
+#define WAKE_BYTES      4096    /* waiting bytes that wake the writer */
+
+/********** struct Writer_T ********
+ *
+ * atomic_size_t head: bytes ever appended, stored by the producer
+ * atomic_size_t tail: bytes ever written or discarded, stored by the
+ *                     writer thread
+ * size_t mask: ring size minus one
+ * uint8_t *ring: the buffer
+ * int fd: descriptor written to
+ * atomic_bool writer_sleeping: the writer thread is waiting for bytes
+ * atomic_bool producer_sleeping: the producer is waiting for tail to move
+ * atomic_bool closing: writer_free wants the thread to finish
+ * atomic_bool failed: a write failed; later bytes are discarded
+ * pthread_mutex_t lock: taken to sleep on or signal the conditions
+ * pthread_cond_t filled: signaled when head moves or closing is set
+ * pthread_cond_t drained: signaled when tail moves
+ * pthread_t thread: the writer thread
+ *
+ *****************************/
+struct Writer_T {
+        atomic_size_t   head;
+        atomic_size_t   tail;
+        size_t          mask;
+        uint8_t        *ring;
+        int             fd;
+        atomic_bool     writer_sleeping;
+        atomic_bool     producer_sleeping;
+        atomic_bool     closing;
+        atomic_bool     failed;
+        pthread_mutex_t lock;
+        pthread_cond_t  filled;
+        pthread_cond_t  drained;
+        pthread_t       thread;
+};
+
+/********** write_all ********
+ *
+ * Writes a run of bytes, retrying short writes
+ *
+ * Return:
+ *      false if the descriptor failed
+ *****************************/
+static bool write_all(int fd, const uint8_t *bytes, size_t length)
+{
+        while (length > 0) {
+                ssize_t done = write(fd, bytes, length);
+                if (done < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (done <= 0) {
+                        return false;
+                }
+                bytes += done;
+                length -= (size_t)done;
+        }
+        return true;
+}
+
+/********** drain ********
+ *
+ * Body of the writer thread: writes whatever the producer has appended,
+ * sleeping while the ring is empty, until writer_free sets closing and
+ * the ring is empty
+ *****************************/
+static void *drain(void *cl)
+{
+        Writer_T writer = cl;
+        size_t tail = atomic_load(&writer->tail);
+        for (;;) {
+                size_t head = atomic_load(&writer->head);
+                if (head == tail) {
+                        if (atomic_load(&writer->closing)) {
+                                return NULL;
+                        }
+                        pthread_mutex_lock(&writer->lock);
+                        atomic_store(&writer->writer_sleeping, true);
+                        while (atomic_load(&writer->head) == tail &&
+                               !atomic_load(&writer->closing)) {
+                                pthread_cond_wait(&writer->filled,
+                                                  &writer->lock);
+                        }
+                        atomic_store(&writer->writer_sleeping, false);
+                        pthread_mutex_unlock(&writer->lock);
+                        continue;
+                }
+
+                size_t start = tail & writer->mask;
+                size_t length = head - tail;
+                if (length > writer->mask + 1 - start) {
+                        length = writer->mask + 1 - start;
+                }
+                if (!atomic_load(&writer->failed) &&
+                    !write_all(writer->fd, writer->ring + start, length)) {
+                        atomic_store(&writer->failed, true);
+                }
+                tail += length;
+                atomic_store(&writer->tail, tail);
+                if (atomic_load(&writer->producer_sleeping)) {
+                        pthread_mutex_lock(&writer->lock);
+                        pthread_cond_signal(&writer->drained);
+                        pthread_mutex_unlock(&writer->lock);
+                }
+        }
+}
+
+/********** writer_new ********
+ *
+ * Starts a writer thread draining a new ring to a descriptor
+ *
+ * Parameters:
+ *      int fd: descriptor to write to; it stays owned by the caller
+ *      size_t bytes: ring size, rounded up to a power of two of at least
+ *                    4096
+ * Return:
+ *      the writer
+ *
+ * Expects:
+ *      fd must be open for writing
+ * Notes:
+ *      Will CRE if allocation fails or the thread cannot be started
+ *****************************/
+extern Writer_T writer_new(int fd, size_t bytes)
+{
+        size_t size = MIN_BYTES;
+        while (size < bytes && size <= (SIZE_MAX >> 1)) {
+                size <<= 1;
+        }
+        Writer_T writer = CALLOC(1, sizeof(struct Writer_T));
+        assert(writer != NULL);
+        writer->ring = ALLOC(size);
+        assert(writer->ring != NULL);
+        writer->mask = size - 1;
+        writer->fd = fd;
+        atomic_init(&writer->head, 0);
+        atomic_init(&writer->tail, 0);
+        atomic_init(&writer->writer_sleeping, false);
+        atomic_init(&writer->producer_sleeping, false);
+        atomic_init(&writer->closing, false);
+        atomic_init(&writer->failed, false);
+        pthread_mutex_init(&writer->lock, NULL);
+        pthread_cond_init(&writer->filled, NULL);
+        pthread_cond_init(&writer->drained, NULL);
+        int failed = pthread_create(&writer->thread, NULL, drain, writer);
+        assert(failed == 0);
+        (void)failed;
+        return writer;
+}
+
+/********** wake_writer ********
+ *
+ * Signals the writer thread with the lock held, so it cannot miss it
+ *****************************/
+static void wake_writer(Writer_T writer)
+{
+        pthread_mutex_lock(&writer->lock);
+        pthread_cond_signal(&writer->filled);
+        pthread_mutex_unlock(&writer->lock);
+}
+
+/********** wait_tail ********
+ *
+ * Sleeps until the writer thread has taken everything but at most left
+ * bytes out of the ring
+ *****************************/
+static void wait_tail(Writer_T writer, size_t left)
+{
+        size_t head = atomic_load_explicit(&writer->head,
+                                           memory_order_relaxed);
+        if (atomic_load(&writer->writer_sleeping)) {
+                wake_writer(writer);
+        }
+        pthread_mutex_lock(&writer->lock);
+        atomic_store(&writer->producer_sleeping, true);
+        while (head - atomic_load(&writer->tail) > left) {
+                pthread_cond_wait(&writer->drained, &writer->lock);
+        }
+        atomic_store(&writer->producer_sleeping, false);
+        pthread_mutex_unlock(&writer->lock);
+}
+
+/********** writer_put ********
+ *
+ * Appends a byte to the ring, waiting for space if the ring is full
+ *
+ * Parameters:
+ *      Writer_T writer: the writer
+ *      uint8_t byte: the byte
+ * Return: None
+ *
+ * Expects:
+ *      writer must not be NULL, and only one thread may append to it
+ * Notes:
+ *      Will CRE if writer is NULL
+ *****************************/
+extern void writer_put(Writer_T writer, uint8_t byte)
+{
+        assert(writer != NULL);
+        size_t head = atomic_load_explicit(&writer->head,
+                                           memory_order_relaxed);
+        if (head - atomic_load_explicit(&writer->tail,
+                                        memory_order_acquire) > writer->mask) {
+                wait_tail(writer, writer->mask);
+        }
+        writer->ring[head & writer->mask] = byte;
+        atomic_store(&writer->head, head + 1);
+        if (atomic_load(&writer->writer_sleeping) && (byte == '\n' ||
+            head + 1 - atomic_load(&writer->tail) >= WAKE_BYTES)) {
+                wake_writer(writer);
+        }
+}
+
+/********** writer_pending ********
+ *
+ * Tells whether bytes appended have yet to be written
+ *
+ * Parameters:
+ *      Writer_T writer: the writer
+ * Return:
+ *      true if writer_flush would wait
+ *
+ * Expects:
+ *      writer must not be NULL, and must be called by the producer
+ * Notes:
+ *      Will CRE if writer is NULL
+ *****************************/
+extern bool writer_pending(Writer_T writer)
+{
+        assert(writer != NULL);
+        return atomic_load_explicit(&writer->head, memory_order_relaxed) !=
+               atomic_load(&writer->tail);
+}
+
+/********** writer_flush ********
+ *
+ * Waits until every byte appended so far has been written
+ *
+ * Parameters:
+ *      Writer_T writer: the writer
+ * Return:
+ *      false if a write has failed, so that some bytes were discarded
+ *
+ * Expects:
+ *      writer must not be NULL, and must be called by the producer
+ * Notes:
+ *      Will CRE if writer is NULL
+ *****************************/
+extern bool writer_flush(Writer_T writer)
+{
+        assert(writer != NULL);
+        if (atomic_load(&writer->head) != atomic_load(&writer->tail)) {
+                wait_tail(writer, 0);
+        }
+        return !atomic_load(&writer->failed);
+}
+
+/********** writer_free ********
+ *
+ * Writes everything still in the ring, stops the writer thread, frees the
+ * writer and sets it to NULL
+ *
+ * Parameters:
+ *      Writer_T *writer: the writer
+ * Return: None
+ *
+ * Expects:
+ *      writer and *writer must not be NULL
+ * Notes:
+ *      Will CRE if writer or *writer is NULL
+ *      The descriptor is left open
+ *****************************/
+extern void writer_free(Writer_T *writer)
+{
+        assert(writer != NULL && *writer != NULL);
+        Writer_T w = *writer;
+        pthread_mutex_lock(&w->lock);
+        atomic_store(&w->closing, true);
+        pthread_cond_signal(&w->filled);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->thread, NULL);
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->filled);
+        pthread_cond_destroy(&w->drained);
+        free(w->ring);
+        free(w);
+        *writer = NULL;
+}
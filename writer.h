@@ -0,0 +1,33 @@
+/**************************************************************
+ *
+ *                     writer.h
+ *
+ *     Virtual UM
+ *     Authors:  Kevin Yuan & Susie Li
+ *     Date:     Oct 17, 2026
+ *
+ *     summary
+ *
+ *     writer.h contains the interface of an asynchronous output writer.
+ *     One producer thread appends bytes to a ring buffer and a writer
+ *     thread of its own drains the ring to a file descriptor with large
+ *     writes, so a slow pipe or terminal does not stall the producer until
+ *     the ring is full.
+ *
+ **************************************************************/
+#ifndef WRITER_INCLUDED
+#define WRITER_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct Writer_T *Writer_T;
+
+extern Writer_T writer_new(int fd, size_t bytes);
+extern void writer_put(Writer_T writer, uint8_t byte);
+extern bool writer_pending(Writer_T writer);
+extern bool writer_flush(Writer_T writer);
+extern void writer_free(Writer_T *writer);
+
+#endif